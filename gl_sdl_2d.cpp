@@ -1,66 +1,1225 @@
 #include "gl_sdl_2d.hpp"
 #include "gl_sdl_utils.hpp"
+#include "gl_sdl_state.hpp"
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 
-static GLuint prog_rect;
-static GLuint prog_normal = 0;
+#define ARRAY_SIZE(x) ((sizeof(x)) / (sizeof(*x)))
+#define PI 3.1415926f
+#define STR(x) #x
+#define XSTR(x) STR(x)
 
-const char vs_normal[] =
-    "#version 300 es\n"
+enum prog_kind { PROG_BATCH, PROG_INSTANCED, PROG_POLYLINE, PROG_COMPACT,
+                 NUM_PROGS };
+
+static GLuint progs[NUM_PROGS];
+
+/* Looked up once in init_2d */
+struct prog_uniforms {
+    uniform_mat3x2 to_gl;
+    uniform_1ui pass_flag;
+    uniform_1f sdf_scale;
+    uniform_1f sdf_border;
+    uniform_2f half_viewport;
+    uniform_1f miter_limit;
+    uniform_2f tile_origin;
+    uniform_1f tile_scale;
+    uniform_sampler_2d palette;
+};
+
+static prog_uniforms uniforms[NUM_PROGS];
+
+/* Taken from the space passed to start_2d, uploaded when a program gets used */
+static struct {
+    affine_2d to_gl = affine_identity();
+    float px_per_unit = 0.0f;   /* Horizontal, 0 until start_2d ran */
+    float half_viewport[2] = { 1.0f, 1.0f };
+} space_values;
+
+static circle_mode cur_circle_mode = CIRCLE_ADAPTIVE;
+
+static stats_2d stats;
+
+/* Unit circle tables, from CIRCLE_MIN_DIVS doubling up to CIRCLE_MAX_DIVS */
+#define CIRCLE_MIN_DIVS 8
+#define CIRCLE_MAX_DIVS 256
+#define CIRCLE_NUM_LODS 6
+/* The table of CIRCLE_FIXED, 16 divisions */
+#define CIRCLE_FIXED_LOD 1
+/* Furthest a tessellated edge may stray from the true circle */
+#define CIRCLE_MAX_ERROR_PX 0.5f
+
+static std::vector<point> circle_lods[CIRCLE_NUM_LODS];
+
+const char vs_header[] =
+    "#version 300 es\n";
+
+/* The whole space_2d mapping is one affine transform */
+const char space_map[] =
+    "uniform mat3x2 to_gl_m;\n"
+    "vec2 to_gl(vec2 p) {\n"
+    "return to_gl_m * vec3(p, 1.0f);\n"
+    "}\n";
+
+/* Color, offset and rotation travel with every vertex, so shapes with
+ * different transforms can share a single draw call. The rotation comes
+ * as (cos, sin), computed once per set_rot_angle. */
+const char vs_batch[] =
     "layout(location = 0) in vec2 pos;\n"
+    "layout(location = 1) in vec2 offset;\n"
+    "layout(location = 2) in vec2 rot;\n"
+    "layout(location = 3) in vec4 color;\n"
+    "layout(location = 4) in vec3 sdf;\n"
+    "out vec4 v_color;\n"
+    "out vec3 v_sdf;\n"
+    "\n"
     "void main() {\n"
-    "gl_Position = vec4(pos, 0.0f, 1.0f);\n"
+    "vec2 pos_m = mat2(rot.x, rot.y, -rot.y, rot.x) * pos + offset;\n"
+    "v_color = color;\n"
+    "v_sdf = sdf;\n"
+    "gl_Position = vec4(to_gl(pos_m), 0.0f, 1.0f);\n"
     "}\n";
 
-const char vs_rect[] =
-    "#version 300 es\n"
-    "layout(location = 0) in vec2 pos;\n"
-    "uniform vec2 origin;\n"
-    "uniform float aspect;\n"
-    "uniform float scale_w;\n"
-    "uniform float multi_w;\n"
-    "uniform float multi_h;\n"
-    "uniform vec2 offset;\n"
-    "uniform float phi;\n"
+/* A unit mesh vertex gets placed by the per instance axes. Instances not
+ * taking part in the current pass are moved out of the clip volume. */
+const char vs_instanced[] =
+    "layout(location = 0) in vec2 mesh_pos;\n"
+    "layout(location = 1) in vec2 inst_pos;\n"
+    "layout(location = 2) in vec2 axis_x;\n"
+    "layout(location = 3) in vec2 axis_y;\n"
+    "layout(location = 4) in vec2 offset;\n"
+    "layout(location = 5) in vec2 rot;\n"
+    "layout(location = 6) in vec4 color;\n"
+    "layout(location = 7) in uint flags;\n"
+    "uniform uint pass_flag;\n"
+    "uniform float sdf_scale;\n"
+    "uniform float sdf_border;\n"
+    "out vec4 v_color;\n"
+    "out vec3 v_sdf;\n"
+    "\n"
+    "void main() {\n"
+    "v_color = pass_flag == " XSTR(INSTANCE_BORDER) " ?\n"
+    "          vec4(vec3(1.0f) - color.rgb, color.a) : color;\n"
+    "v_sdf = vec3(sdf_scale * mesh_pos, sdf_border);\n"
+    "if ((flags & pass_flag) == 0u) {\n"
+    "gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);\n"
+    "return;\n"
+    "}\n"
+    "vec2 pos = inst_pos + mesh_pos.x * axis_x + mesh_pos.y * axis_y;\n"
+    "vec2 pos_m = mat2(rot.x, rot.y, -rot.y, rot.x) * pos + offset;\n"
+    "gl_Position = vec4(to_gl(pos_m), 0.0f, 1.0f);\n"
+    "}\n";
+
+/* vs_instanced for compact_instance, the color looked up in the palette
+ * texture */
+const char vs_compact[] =
+    "layout(location = 0) in vec2 mesh_pos;\n"
+    "layout(location = 1) in vec2 inst_pos;\n"
+    "layout(location = 2) in vec2 axis_x;\n"
+    "layout(location = 3) in vec2 axis_y;\n"
+    "layout(location = 4) in uint style;\n"
+    "uniform vec2 tile_origin;\n"
+    "uniform float tile_scale;\n"
+    "uniform sampler2D palette;\n"
+    "uniform uint pass_flag;\n"
+    "uniform float sdf_scale;\n"
+    "uniform float sdf_border;\n"
+    "out vec4 v_color;\n"
+    "out vec3 v_sdf;\n"
+    "\n"
+    "void main() {\n"
+    "vec4 color = texelFetch(palette, ivec2(int(style & 0xffu), 0), 0);\n"
+    "uint flags = style >> " XSTR(COMPACT_FLAGS_SHIFT) "u;\n"
+    "v_color = pass_flag == " XSTR(INSTANCE_BORDER) " ?\n"
+    "          vec4(vec3(1.0f) - color.rgb, color.a) : color;\n"
+    "v_sdf = vec3(sdf_scale * mesh_pos, sdf_border);\n"
+    "if ((flags & pass_flag) == 0u) {\n"
+    "gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);\n"
+    "return;\n"
+    "}\n"
+    "vec2 pos = inst_pos + mesh_pos.x * axis_x + mesh_pos.y * axis_y;\n"
+    "gl_Position = vec4(to_gl(tile_origin + tile_scale * pos), 0.0f, 1.0f);\n"
+    "}\n";
+
+/* Polyline segment flags, the join and cap style of both ends */
+#define SEGMENT_HAS_PREV 1u
+#define SEGMENT_HAS_NEXT 2u
+#define SEGMENT_MITER 4u
+#define SEGMENT_SQUARE_CAP 8u
+
+/* Each segment instance is a quad from p0 to p1 followed by the bevel
+ * triangle at p1. Corner x picks the end, y the side and z the role:
+ * 0 for quad corners, 1 for the join center, 2 and 3 for the outer join
+ * corners of this and the next segment. The work happens in pixels so
+ * widths do not depend on the space. An unused join triangle goes out of
+ * the clip volume, some rasterizers drop the whole draw over triangles
+ * collapsed into a point. */
+const char vs_polyline[] =
+    "layout(location = 0) in vec3 corner;\n"
+    "layout(location = 1) in vec2 prev;\n"
+    "layout(location = 2) in vec2 p0;\n"
+    "layout(location = 3) in vec2 p1;\n"
+    "layout(location = 4) in vec2 next;\n"
+    "layout(location = 5) in vec2 offset;\n"
+    "layout(location = 6) in vec2 rot;\n"
+    "layout(location = 7) in float width;\n"
+    "layout(location = 8) in vec4 color;\n"
+    "layout(location = 9) in uint flags;\n"
+    "uniform vec2 half_viewport;\n"
+    "uniform float miter_limit;\n"
+    "out vec4 v_color;\n"
+    "out vec3 v_sdf;\n"
+    "\n"
+    "vec2 to_px(vec2 p) {\n"
+    "vec2 pos_m = mat2(rot.x, rot.y, -rot.y, rot.x) * p + offset;\n"
+    "return to_gl(pos_m) * half_viewport;\n"
+    "}\n"
+    "vec2 dir(vec2 a, vec2 b) {\n"
+    "vec2 d = b - a;\n"
+    "float len = length(d);\n"
+    "return len > 1e-6f ? d / len : vec2(1.0f, 0.0f);\n"
+    "}\n"
+    "vec2 perp(vec2 d) {\n"
+    "return vec2(-d.y, d.x);\n"
+    "}\n"
     "\n"
     "void main() {\n"
-    "vec2 pos_m = mat2(cos(phi), sin(phi), -sin(phi), cos(phi)) * pos + offset;\n"
-    "vec2 loc = scale_w * vec2(multi_w * pos_m.x, multi_h * pos_m.y) + origin;\n"
-    "vec2 opengl_coords = 2.0f * vec2(loc.x, loc.y * aspect) - vec2(1.0f, 1.0f);\n"
-    "gl_Position = vec4(opengl_coords, 0.0f, 1.0f);\n"
+    "v_color = color;\n"
+    "v_sdf = vec3(0.0f);\n"
+    "float hw = 0.5f * width;\n"
+    "vec2 a = to_px(p0);\n"
+    "vec2 b = to_px(p1);\n"
+    "vec2 d = dir(a, b);\n"
+    "vec2 n = perp(d);\n"
+    "bool at_end = corner.x > 0.5f;\n"
+    "bool has_prev = (flags & " XSTR(SEGMENT_HAS_PREV) ") != 0u;\n"
+    "bool has_next = (flags & " XSTR(SEGMENT_HAS_NEXT) ") != 0u;\n"
+    "bool joined = at_end ? has_next : has_prev;\n"
+    "vec2 d_in = !at_end && joined ? dir(to_px(prev), a) : d;\n"
+    "vec2 d_out = at_end && joined ? dir(b, to_px(next)) : d;\n"
+    "vec2 off = n * hw;\n"
+    "bool mitered = false;\n"
+    "/* Both segments meeting at a point run the same test on the same\n"
+    " * directions, so they always agree on miter or bevel */\n"
+    "if (joined && (flags & " XSTR(SEGMENT_MITER) ") != 0u) {\n"
+    "vec2 sum = d_in + d_out;\n"
+    "float proj = sqrt(max(0.5f + 0.5f * dot(d_in, d_out), 0.0f));\n"
+    "if (proj * miter_limit >= 1.0f && dot(sum, sum) >= 1e-6f) {\n"
+    "off = perp(normalize(sum)) * (hw / proj);\n"
+    "mitered = true;\n"
+    "}\n"
+    "}\n"
+    "vec2 pos = at_end ? b : a;\n"
+    "if (!joined && (flags & " XSTR(SEGMENT_SQUARE_CAP) ") != 0u)\n"
+    "    pos += (at_end ? d : -d) * hw;\n"
+    "if (corner.z == 0.0f) {\n"
+    "pos += corner.y * off;\n"
+    "} else if (!joined || mitered) {\n"
+    "gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);\n"
+    "return;\n"
+    "} else if (corner.z > 1.5f) {\n"
+    "float outer = d_in.x * d_out.y - d_in.y * d_out.x > 0.0f ? -1.0f : 1.0f;\n"
+    "pos += outer * hw * (corner.z < 2.5f ? n : perp(d_out));\n"
+    "}\n"
+    "gl_Position = vec4(pos / half_viewport, 0.0f, 1.0f);\n"
     "}\n";
 
+/* v_sdf holds the position relative to a unit circle and, for outlines,
+ * half of the line width in pixels. Everything but SDF circles sits at
+ * (0, 0) and is fully covered. Pixels less than half covered are dropped
+ * so circles match rasterized shapes with blending off, the rest of the
+ * coverage ends up in alpha. */
 const char fs[] = 
     "#version 300 es\n"
     "precision mediump float;\n"
+    "in vec4 v_color;\n"
+    "in vec3 v_sdf;\n"
     "out vec4 frag_color;\n"
-    "uniform vec4 draw_color;\n"
     "void main() {\n"
-    "frag_color = draw_color;\n"
+    "float d = length(v_sdf.xy);\n"
+    "float px = max(fwidth(d), 1e-6f);\n"
+    "float coverage = v_sdf.z > 0.0f ?\n"
+    "                 v_sdf.z - abs(d - 1.0f) / px + 0.5f :\n"
+    "                 (1.0f - d) / px + 0.5f;\n"
+    "coverage = clamp(coverage, 0.0f, 1.0f);\n"
+    "if (coverage < 0.5f)\n"
+    "    discard;\n"
+    "frag_color = vec4(v_color.rgb, v_color.a * coverage);\n"
     "}\n";
 
-int init_2d()
+static GLuint build_program(prog_kind kind, const char *vs_main)
 {
-    GLuint shaders_normal[] = {
-        read_shader(vs_normal, GL_VERTEX_SHADER),
+    std::string vs_src = std::string(vs_header) + space_map + vs_main;
+    GLuint shaders[] = {
+        read_shader(vs_src.c_str(), GL_VERTEX_SHADER),
         read_shader(fs, GL_FRAGMENT_SHADER)
     };
 
-    GLuint shaders_rect[] = {
-        read_shader(vs_rect, GL_VERTEX_SHADER),
-        read_shader(fs, GL_FRAGMENT_SHADER)
-    };
+    GLuint program = create_program(shaders, ARRAY_SIZE(shaders));
+    for (auto shader : shaders)
+        glDeleteShader(shader);
+
+    prog_uniforms *u = &uniforms[kind];
+    u->to_gl = get_uniform<GL_FLOAT_MAT3x2>(program, "to_gl_m");
+    u->pass_flag = get_uniform<GL_UNSIGNED_INT>(program, "pass_flag");
+    u->sdf_scale = get_uniform<GL_FLOAT>(program, "sdf_scale");
+    u->sdf_border = get_uniform<GL_FLOAT>(program, "sdf_border");
+    u->half_viewport = get_uniform<GL_FLOAT_VEC2>(program, "half_viewport");
+    u->miter_limit = get_uniform<GL_FLOAT>(program, "miter_limit");
+    u->tile_origin = get_uniform<GL_FLOAT_VEC2>(program, "tile_origin");
+    u->tile_scale = get_uniform<GL_FLOAT>(program, "tile_scale");
+    u->palette = get_uniform<GL_SAMPLER_2D>(program, "palette");
+    return program;
+}
+
+/* The mapping only gets uploaded when start_2d changed it since the last
+ * use of the program */
+static prog_uniforms *use_prog(prog_kind kind)
+{
+    gl_state_use_program(progs[kind]);
+
+    prog_uniforms *u = &uniforms[kind];
+    set_uniform(u->to_gl, space_values.to_gl.m);
+    return u;
+}
+
+struct batch_vertex {
+    GLfloat pos[2];
+    GLfloat offset[2];
+    GLfloat rot[2];
+    GLubyte color[4];
+    GLfloat sdf[3];
+};
+
+/* One polyline segment with its neighbours, for the joins */
+struct segment_instance {
+    GLfloat prev[2];
+    GLfloat p0[2];
+    GLfloat p1[2];
+    GLfloat next[2];
+    GLfloat offset[2];
+    GLfloat rot[2];
+    GLfloat width;      /* In pixels */
+    GLubyte color[4];
+    GLuint flags;
+};
+
+/* Upper bound for a single submission, keeps the streamed buffer bounded */
+#define BATCH_MAX_VERTS 65536
+#define BATCH_MAX_SEGMENTS 16384
+
+/* Quad plus bevel triangle, see vs_polyline */
+static const GLfloat segment_mesh[][3] = {
+    { 0, -1, 0 }, { 1, -1, 0 }, { 1, 1, 0 },
+    { 0, -1, 0 }, { 1, 1, 0 }, { 0, 1, 0 },
+    { 1, 0, 1 }, { 1, 0, 2 }, { 1, 0, 3 }
+};
+
+/* Vertices and segments never wait together, whichever comes in second
+ * submits the other first so drawing order holds */
+static struct {
+    std::vector<batch_vertex> verts;
+    std::vector<segment_instance> segments;
+    GLenum mode = GL_TRIANGLES;
+    bool active = false;
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint seg_vao = 0;
+    GLuint seg_mesh_vbo = 0;
+    GLuint seg_vbo = 0;
+    /* Attributes applied to new vertices, no rotation to start with */
+    batch_vertex cur = { { 0, 0 }, { 0, 0 }, { 1, 0 }, {}, {} };
+    line_join join = JOIN_MITER;
+    line_cap cap = CAP_BUTT;
+    float miter_limit = 4.0f;
+} batch;
+
+static void init_batch()
+{
+    glGenVertexArrays(1, &batch.vao);
+    glGenBuffers(1, &batch.vbo);
+    gl_state_bind_vertex_array(batch.vao);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch.vbo);
+
+    GLsizei stride = sizeof(batch_vertex);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(batch_vertex, pos));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(batch_vertex, offset));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(batch_vertex, rot));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          (void *)offsetof(batch_vertex, color));
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(batch_vertex, sdf));
+    for (GLuint i = 0; i < 5; i++)
+        glEnableVertexAttribArray(i);
+
+    batch.verts.reserve(BATCH_MAX_VERTS);
+}
+
+static void init_segments()
+{
+    glGenVertexArrays(1, &batch.seg_vao);
+    glGenBuffers(1, &batch.seg_mesh_vbo);
+    glGenBuffers(1, &batch.seg_vbo);
+    gl_state_bind_vertex_array(batch.seg_vao);
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch.seg_mesh_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(segment_mesh), segment_mesh,
+                 GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(*segment_mesh), 0);
+    glEnableVertexAttribArray(0);
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch.seg_vbo);
+    GLsizei stride = sizeof(segment_instance);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, prev));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, p0));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, p1));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, next));
+    glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, offset));
+    glVertexAttribPointer(6, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, rot));
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(segment_instance, width));
+    glVertexAttribPointer(8, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          (void *)offsetof(segment_instance, color));
+    glVertexAttribIPointer(9, 1, GL_UNSIGNED_INT, stride,
+                           (void *)offsetof(segment_instance, flags));
+    for (GLuint i = 1; i <= 9; i++) {
+        glVertexAttribDivisor(i, 1);
+        glEnableVertexAttribArray(i);
+    }
+
+    batch.segments.reserve(BATCH_MAX_SEGMENTS);
+}
+
+/* All pending segments, whatever their width and color, in one draw */
+static void submit_segments()
+{
+    prog_uniforms *u = use_prog(PROG_POLYLINE);
+    set_uniform(u->half_viewport, space_values.half_viewport[0],
+                space_values.half_viewport[1]);
+    set_uniform(u->miter_limit, batch.miter_limit);
+    gl_state_bind_vertex_array(batch.seg_vao);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch.seg_vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 batch.segments.size() * sizeof(segment_instance),
+                 batch.segments.data(), GL_STREAM_DRAW);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, ARRAY_SIZE(segment_mesh),
+                          batch.segments.size());
+    stats.draw_calls++;
+    stats.bytes_uploaded += batch.segments.size() * sizeof(segment_instance);
+
+    batch.segments.clear();
+}
+
+/* Streams gathered vertices and issues one draw for all of them */
+static void submit_batch()
+{
+    if (!batch.segments.empty())
+        submit_segments();
+    if (batch.verts.empty())
+        return;
+
+    /* The batch VAO stays bound, code relying on client side arrays has to
+     * bind VAO 0 through gl_state_bind_vertex_array() first */
+    use_prog(PROG_BATCH);
+    gl_state_bind_vertex_array(batch.vao);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, batch.vbo);
+    glBufferData(GL_ARRAY_BUFFER, batch.verts.size() * sizeof(batch_vertex),
+                 batch.verts.data(), GL_STREAM_DRAW);
+    glDrawArrays(batch.mode, 0, batch.verts.size());
+    stats.draw_calls++;
+    stats.bytes_uploaded += batch.verts.size() * sizeof(batch_vertex);
+
+    batch.verts.clear();
+}
+
+/* Returns storage for num_verts vertices of the given primitive type,
+ * submitting pending ones first if they cannot share a draw call */
+static batch_vertex *batch_reserve(GLenum mode, uint num_verts)
+{
+    if (batch.mode != mode || !batch.segments.empty() ||
+        batch.verts.size() + num_verts > BATCH_MAX_VERTS)
+        submit_batch();
+    batch.mode = mode;
+
+    size_t start = batch.verts.size();
+    batch.verts.resize(start + num_verts, batch.cur);
+    return &batch.verts[start];
+}
+
+/* Segments get the current transform, color, width and join/cap style */
+static segment_instance *segment_reserve(uint num_segments)
+{
+    if (!batch.verts.empty() ||
+        batch.segments.size() + num_segments > BATCH_MAX_SEGMENTS)
+        submit_batch();
+
+    segment_instance seg = {};
+    memcpy(seg.offset, batch.cur.offset, sizeof(seg.offset));
+    memcpy(seg.rot, batch.cur.rot, sizeof(seg.rot));
+    memcpy(seg.color, batch.cur.color, sizeof(seg.color));
+    seg.width = gl_state_get_line_width();
+    seg.flags = (batch.join == JOIN_MITER ? SEGMENT_MITER : 0) |
+                (batch.cap == CAP_SQUARE ? SEGMENT_SQUARE_CAP : 0);
+
+    size_t start = batch.segments.size();
+    batch.segments.resize(start + num_segments, seg);
+    return &batch.segments[start];
+}
+
+/* Fills in the geometry of consecutive segments, open polylines get caps
+ * at both ends */
+static segment_instance *push_polyline(const point *points, uint num_points,
+                                       bool closed)
+{
+    uint num_segments = closed ? num_points : num_points - 1;
+    segment_instance *segs = segment_reserve(num_segments);
+
+    for (uint i = 0; i < num_segments; i++) {
+        point prev = points[(i + num_points - 1) % num_points];
+        point p0 = points[i];
+        point p1 = points[(i + 1) % num_points];
+        point next = points[(i + 2) % num_points];
+
+        segment_instance *seg = &segs[i];
+        seg->prev[0] = prev.x;
+        seg->prev[1] = prev.y;
+        seg->p0[0] = p0.x;
+        seg->p0[1] = p0.y;
+        seg->p1[0] = p1.x;
+        seg->p1[1] = p1.y;
+        seg->next[0] = next.x;
+        seg->next[1] = next.y;
+        if (closed || i > 0)
+            seg->flags |= SEGMENT_HAS_PREV;
+        if (closed || i + 1 < num_segments)
+            seg->flags |= SEGMENT_HAS_NEXT;
+    }
+
+    return segs;
+}
+
+/* glLineWidth above 1 is optional in GLES and most software rasterizers */
+static bool use_thick_lines()
+{
+    return gl_state_get_line_width() > 1.0f;
+}
+
+static void batch_done()
+{
+    if (!batch.active)
+        submit_batch();
+}
+
+int begin_batch_2d()
+{
+    batch.active = true;
+    return 0;
+}
+
+int flush_batch_2d()
+{
+    submit_batch();
+    batch.active = false;
+    return 0;
+}
+
+static void init_circle_lods()
+{
+    for (uint lod = 0; lod < CIRCLE_NUM_LODS; lod++) {
+        uint divs = CIRCLE_MIN_DIVS << lod;
+        circle_lods[lod].resize(divs);
+        for (uint i = 0; i < divs; i++) {
+            float phi = 2.0f * PI * (float)i / (float)divs;
+            circle_lods[lod][i] = { cosf(phi), sinf(phi) };
+        }
+    }
+}
+
+/* Picks the coarsest table keeping the edges within CIRCLE_MAX_ERROR_PX,
+ * the error of n divisions being about r * pi^2 / (2 * n^2) */
+static uint circle_lod(float radius)
+{
+    if (cur_circle_mode == CIRCLE_FIXED || space_values.px_per_unit <= 0.0f)
+        return CIRCLE_FIXED_LOD;
+
+    float r_px = fabsf(radius) * space_values.px_per_unit;
+    float min_divs = PI * sqrtf(r_px / (2.0f * CIRCLE_MAX_ERROR_PX));
+    for (uint lod = 0; lod < CIRCLE_NUM_LODS; lod++) {
+        if ((float)(CIRCLE_MIN_DIVS << lod) >= min_divs)
+            return lod;
+    }
+
+    return CIRCLE_NUM_LODS - 1;
+}
+
+static const std::vector<point> &circle_table(float radius)
+{
+    return circle_lods[circle_lod(radius)];
+}
+
+/* Unit meshes, placed per instance by draw_instances */
+struct mesh_range {
+    GLint first;
+    GLsizei count;
+};
+
+static struct {
+    GLuint vao = 0;
+    GLuint mesh_vbo = 0;
+    GLuint inst_vbo = 0;
+    mesh_range fill[NUM_INSTANCE_MESHES];
+    mesh_range border[NUM_INSTANCE_MESHES];
+    /* Stand in for the circle meshes above, one pair per circle table */
+    mesh_range circle_fill[CIRCLE_NUM_LODS];
+    mesh_range circle_border[CIRCLE_NUM_LODS];
+    mesh_range sdf_quad;
+    GLuint palette_tex = 0;     /* COMPACT_PALETTE_SIZE x 1 */
+    color palette[COMPACT_PALETTE_SIZE];    /* CPU copy, for thick borders */
+    std::vector<point> outline; /* Scratch of push_instance_outline */
+} instancing;
+
+/* Kept away from the low units that textures usually go to */
+#define PALETTE_TEX_UNIT 15
+
+/* Instanced SDF circles use a fixed quad, leaving room for AA and borders */
+#define SDF_QUAD_EXTENT 1.25f
+
+static mesh_range add_mesh(std::vector<point> *verts, const point *mesh,
+                           uint num_verts)
+{
+    mesh_range range = { (GLint)verts->size(), (GLsizei)num_verts };
+    verts->insert(verts->end(), mesh, mesh + num_verts);
+    return range;
+}
+
+/* Unit meshes of rects and tris, their outlines run in this order */
+static const point unit_square[] = { { 0.0f, 0.0f }, { 1.0f, 0.0f },
+                                     { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+static const point unit_tri[] = { { 0.0f, 0.0f }, { 1.0f, 0.0f },
+                                  { 0.0f, 1.0f } };
+
+/* Line list with the outline of a closed polygon */
+static mesh_range add_outline(std::vector<point> *verts, const point *poly,
+                              uint num_points)
+{
+    mesh_range range = { (GLint)verts->size(), (GLsizei)(2 * num_points) };
+    for (uint i = 0; i < num_points; i++) {
+        verts->push_back(poly[i]);
+        verts->push_back(poly[(i + 1) % num_points]);
+    }
+    return range;
+}
+
+/* Points the bound VAO at the unit meshes and at per instance data in
+ * inst_vbo */
+static void setup_instance_attribs(GLuint inst_vbo)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instancing.mesh_vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(point), 0);
+    glEnableVertexAttribArray(0);
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, inst_vbo);
+    GLsizei stride = sizeof(shape_instance);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(shape_instance, pos));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(shape_instance, axis_x));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(shape_instance, axis_y));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(shape_instance, offset));
+    glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)offsetof(shape_instance, rot));
+    glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                          (void *)offsetof(shape_instance, color));
+    glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, stride,
+                           (void *)offsetof(shape_instance, flags));
+    for (GLuint i = 1; i <= 7; i++) {
+        glVertexAttribDivisor(i, 1);
+        glEnableVertexAttribArray(i);
+    }
+}
+
+static void init_instancing()
+{
+    std::vector<point> verts;
+
+    std::vector<point> circle_fill;
+    for (uint lod = 0; lod < CIRCLE_NUM_LODS; lod++) {
+        const std::vector<point> &ring = circle_lods[lod];
+        circle_fill.clear();
+        for (uint i = 0; i < ring.size(); i++) {
+            circle_fill.push_back({ 0.0f, 0.0f });
+            circle_fill.push_back(ring[i]);
+            circle_fill.push_back(ring[(i + 1) % ring.size()]);
+        }
+        instancing.circle_fill[lod] = add_mesh(&verts, circle_fill.data(),
+                                               circle_fill.size());
+        instancing.circle_border[lod] = add_outline(&verts, ring.data(),
+                                                    ring.size());
+    }
+    instancing.fill[INSTANCE_CIRCLE] = instancing.circle_fill[CIRCLE_FIXED_LOD];
+    instancing.border[INSTANCE_CIRCLE] =
+        instancing.circle_border[CIRCLE_FIXED_LOD];
+
+    const float e = SDF_QUAD_EXTENT;
+    const point sdf_quad[] = { { -e, -e }, { e, -e }, { e, e },
+                               { -e, e }, { e, e }, { -e, -e } };
+    instancing.sdf_quad = add_mesh(&verts, sdf_quad, ARRAY_SIZE(sdf_quad));
+
+    const point *square = unit_square;
+    const point square_fill[] = { square[0], square[1], square[2],
+                                  square[3], square[2], square[0] };
+    instancing.fill[INSTANCE_RECT] = add_mesh(&verts, square_fill,
+                                              ARRAY_SIZE(square_fill));
+    instancing.border[INSTANCE_RECT] = add_outline(&verts, unit_square,
+                                                   ARRAY_SIZE(unit_square));
+
+    instancing.fill[INSTANCE_TRI] = add_mesh(&verts, unit_tri,
+                                             ARRAY_SIZE(unit_tri));
+    instancing.border[INSTANCE_TRI] = add_outline(&verts, unit_tri,
+                                                  ARRAY_SIZE(unit_tri));
+
+    glGenVertexArrays(1, &instancing.vao);
+    glGenBuffers(1, &instancing.mesh_vbo);
+    glGenBuffers(1, &instancing.inst_vbo);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instancing.mesh_vbo);
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(point), verts.data(),
+                 GL_STATIC_DRAW);
+
+    gl_state_bind_vertex_array(instancing.vao);
+    setup_instance_attribs(instancing.inst_vbo);
+
+    glGenTextures(1, &instancing.palette_tex);
+    gl_state_bind_texture(GL_TEXTURE_2D, instancing.palette_tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    set_compact_palette(NULL, 0);
+}
+
+/* Squared length of the longer axis, the radius of a circle instance */
+static float axes_extent_sq(float x0, float x1, float y0, float y1)
+{
+    return std::max(x0 * x0 + x1 * x1, y0 * y0 + y1 * y1);
+}
+
+static float instance_extent_sq(const shape_instance *inst)
+{
+    return axes_extent_sq(inst->axis_x[0], inst->axis_x[1], inst->axis_y[0],
+                          inst->axis_y[1]);
+}
+
+static const point *instance_outline(instance_mesh mesh, uint lod,
+                                     uint *num_points)
+{
+    switch (mesh) {
+    case INSTANCE_CIRCLE:
+        *num_points = circle_lods[lod].size();
+        return circle_lods[lod].data();
+    case INSTANCE_RECT:
+        *num_points = ARRAY_SIZE(unit_square);
+        return unit_square;
+    default:
+        *num_points = ARRAY_SIZE(unit_tri);
+        return unit_tri;
+    }
+}
+
+/* The border of an instance as a closed polyline, in the inverted color
+ * the instanced border pass gives it */
+static void push_instance_outline(const shape_instance *inst,
+                                  const point *outline, uint num_points)
+{
+    std::vector<point> &points = instancing.outline;
+    points.resize(num_points);
+    for (uint i = 0; i < num_points; i++) {
+        point m = outline[i];
+        points[i] = { inst->pos[0] + m.x * inst->axis_x[0] +
+                      m.y * inst->axis_y[0],
+                      inst->pos[1] + m.x * inst->axis_x[1] +
+                      m.y * inst->axis_y[1] };
+    }
+
+    segment_instance *segs = push_polyline(points.data(), num_points, true);
+    for (uint i = 0; i < num_points; i++) {
+        memcpy(segs[i].offset, inst->offset, sizeof(segs[i].offset));
+        memcpy(segs[i].rot, inst->rot, sizeof(segs[i].rot));
+        for (uint c = 0; c < 3; c++)
+            segs[i].color[c] = 255 - inst->color[c];
+        segs[i].color[3] = inst->color[3];
+    }
+}
+
+/* GL_LINES are 1px wide on GLES whatever the width, so wider borders of
+ * instances take the polyline path like batched ones. Given a tile the
+ * compact instances get taken back to shape instances. */
+static void draw_thick_borders(instance_mesh mesh, uint lod,
+                               const shape_instance *instances,
+                               uint num_instances, const compact_tile *tile)
+{
+    uint num_points;
+    const point *outline = instance_outline(mesh, lod, &num_points);
+
+    for (uint i = 0; i < num_instances; i++) {
+        shape_instance inst;
+        if (tile) {
+            const compact_instance *c = &tile->instances[i];
+            color col = instancing.palette[c->style & 0xff];
+            for (uint k = 0; k < 2; k++) {
+                inst.pos[k] = tile->scale * c->pos[k];
+                inst.axis_x[k] = tile->scale * c->axis_x[k];
+                inst.axis_y[k] = tile->scale * c->axis_y[k];
+            }
+            inst.offset[0] = tile->origin.x;
+            inst.offset[1] = tile->origin.y;
+            inst.rot[0] = 1.0f;
+            inst.rot[1] = 0.0f;
+            inst.color[0] = col.r;
+            inst.color[1] = col.g;
+            inst.color[2] = col.b;
+            inst.color[3] = col.a;
+            inst.flags = c->style >> COMPACT_FLAGS_SHIFT;
+        } else {
+            inst = instances[i];
+        }
+
+        if (inst.flags & INSTANCE_BORDER)
+            push_instance_outline(&inst, outline, num_points);
+    }
+
+    submit_batch();
+}
+
+/* Fill pass, then border pass, over the instances of the bound VAO. Given
+ * a tile they are compact instances. Circles all take the table that the
+ * largest radius needs. */
+static void draw_instance_passes(instance_mesh mesh, bool fill, bool border,
+                                 const shape_instance *instances,
+                                 uint num_instances, float max_radius,
+                                 const compact_tile *tile = NULL)
+{
+    prog_uniforms *u = use_prog(tile ? PROG_COMPACT : PROG_INSTANCED);
+    if (tile) {
+        set_uniform(u->tile_origin, tile->origin.x, tile->origin.y);
+        set_uniform(u->tile_scale, tile->scale);
+        set_uniform(u->palette, PALETTE_TEX_UNIT);
+        gl_state_active_texture(GL_TEXTURE0 + PALETTE_TEX_UNIT);
+        gl_state_bind_texture(GL_TEXTURE_2D, instancing.palette_tex);
+        gl_state_active_texture(GL_TEXTURE0);
+    }
+    bool sdf = mesh == INSTANCE_CIRCLE && cur_circle_mode == CIRCLE_SDF;
+    set_uniform(u->sdf_scale, sdf ? 1.0f : 0.0f);
+    set_uniform(u->sdf_border, 0.0f);
+
+    mesh_range fill_range = instancing.fill[mesh];
+    mesh_range border_range = instancing.border[mesh];
+    uint lod = CIRCLE_FIXED_LOD;
+    if (sdf) {
+        fill_range = border_range = instancing.sdf_quad;
+    } else if (mesh == INSTANCE_CIRCLE) {
+        lod = circle_lod(max_radius);
+        fill_range = instancing.circle_fill[lod];
+        border_range = instancing.circle_border[lod];
+    }
+
+    if (fill) {
+        mesh_range range = fill_range;
+        set_uniform(u->pass_flag, INSTANCE_FILL);
+        glDrawArraysInstanced(GL_TRIANGLES, range.first, range.count,
+                              num_instances);
+        stats.draw_calls++;
+    }
+
+    if (border && !sdf && use_thick_lines()) {
+        draw_thick_borders(mesh, lod, instances, num_instances, tile);
+    } else if (border) {
+        mesh_range range = border_range;
+        set_uniform(u->pass_flag, INSTANCE_BORDER);
+        if (sdf)
+            set_uniform(u->sdf_border, 0.5f * gl_state_get_line_width());
+        glDrawArraysInstanced(sdf ? GL_TRIANGLES : GL_LINES, range.first,
+                              range.count, num_instances);
+        stats.draw_calls++;
+    }
+}
+
+int draw_instances(instance_mesh mesh, const shape_instance *instances,
+                   uint num_instances)
+{
+    if (mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+    if (!num_instances)
+        return 0;
+
+    /* Pending batched primitives were issued first */
+    submit_batch();
+
+    Uint32 used_flags = 0;
+    float extent_sq = 0.0f;
+    for (uint i = 0; i < num_instances; i++) {
+        used_flags |= instances[i].flags;
+        extent_sq = std::max(extent_sq, instance_extent_sq(&instances[i]));
+    }
+
+    gl_state_bind_vertex_array(instancing.vao);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instancing.inst_vbo);
+    glBufferData(GL_ARRAY_BUFFER, num_instances * sizeof(shape_instance),
+                 instances, GL_STREAM_DRAW);
+    stats.bytes_uploaded += num_instances * sizeof(shape_instance);
+
+    draw_instance_passes(mesh, used_flags & INSTANCE_FILL,
+                         used_flags & INSTANCE_BORDER, instances,
+                         num_instances, sqrtf(extent_sq));
+    return 0;
+}
+
+static void count_flags(instance_buffer *buf, Uint32 flags, int delta)
+{
+    if (flags & INSTANCE_FILL)
+        buf->num_fill += delta;
+    if (flags & INSTANCE_BORDER)
+        buf->num_border += delta;
+}
+
+int init_instance_buffer(instance_buffer *buf, instance_mesh mesh)
+{
+    if (mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+
+    *buf = {};
+    buf->mesh = mesh;
+    return 0;
+}
+
+int destroy_instance_buffer(instance_buffer *buf)
+{
+    /* The VAO may be the bound one */
+    if (buf->vao)
+        gl_state_bind_vertex_array(0);
+    glDeleteBuffers(1, &buf->vbo);
+    glDeleteVertexArrays(1, &buf->vao);
+
+    instance_mesh mesh = buf->mesh;
+    *buf = {};
+    buf->mesh = mesh;
+    return 0;
+}
+
+uint instance_buffer_add(instance_buffer *buf, const shape_instance *inst)
+{
+    uint slot = buf->instances.size();
+    buf->instances.push_back(*inst);
+    buf->slot_dirty.push_back(true);
+    buf->dirty.push_back(slot);
+    count_flags(buf, inst->flags, 1);
+    buf->max_extent_sq = std::max(buf->max_extent_sq,
+                                  instance_extent_sq(inst));
+    return slot;
+}
+
+int instance_buffer_update(instance_buffer *buf, uint slot,
+                           const shape_instance *inst)
+{
+    if (slot >= buf->instances.size())
+        return -1;
+
+    count_flags(buf, buf->instances[slot].flags, -1);
+    count_flags(buf, inst->flags, 1);
+    buf->max_extent_sq = std::max(buf->max_extent_sq,
+                                  instance_extent_sq(inst));
+    buf->instances[slot] = *inst;
+    if (!buf->slot_dirty[slot]) {
+        buf->slot_dirty[slot] = true;
+        buf->dirty.push_back(slot);
+    }
+
+    return 0;
+}
+
+/* Clean slots in gaps up to this size get uploaded along with their dirty
+ * neighbours, rather than paying for another call */
+#define INSTANCE_MERGE_GAP 8
+
+/* Brings the GPU copy up to date. A grown buffer gets reallocated and
+ * filled whole, otherwise dirty slots go up in coalesced ranges. */
+static void sync_instance_buffer(instance_buffer *buf)
+{
+    uint num = buf->instances.size();
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, buf->vbo);
+
+    if (num > buf->gpu_capacity) {
+        buf->gpu_capacity = std::max(num, 2 * buf->gpu_capacity);
+        glBufferData(GL_ARRAY_BUFFER,
+                     buf->gpu_capacity * sizeof(shape_instance), NULL,
+                     GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, num * sizeof(shape_instance),
+                        buf->instances.data());
+        stats.bytes_uploaded += num * sizeof(shape_instance);
+    } else if (!buf->dirty.empty()) {
+        std::sort(buf->dirty.begin(), buf->dirty.end());
+        uint first = buf->dirty[0];
+        uint last = first;
+        for (size_t i = 1; i <= buf->dirty.size(); i++) {
+            if (i < buf->dirty.size() &&
+                buf->dirty[i] - last <= INSTANCE_MERGE_GAP + 1) {
+                last = buf->dirty[i];
+                continue;
+            }
+
+            GLsizeiptr size = (last - first + 1) * sizeof(shape_instance);
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(shape_instance),
+                            size, &buf->instances[first]);
+            stats.bytes_uploaded += size;
+            if (i < buf->dirty.size())
+                first = last = buf->dirty[i];
+        }
+    }
+
+    for (uint slot : buf->dirty)
+        buf->slot_dirty[slot] = false;
+    buf->dirty.clear();
+}
+
+int draw_instance_buffer(instance_buffer *buf)
+{
+    if (buf->mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+    if (buf->instances.empty())
+        return 0;
+
+    submit_batch();
+
+    if (!buf->vao) {
+        glGenVertexArrays(1, &buf->vao);
+        glGenBuffers(1, &buf->vbo);
+        gl_state_bind_vertex_array(buf->vao);
+        setup_instance_attribs(buf->vbo);
+    }
+
+    gl_state_bind_vertex_array(buf->vao);
+    sync_instance_buffer(buf);
+    draw_instance_passes(buf->mesh, buf->num_fill, buf->num_border,
+                         buf->instances.data(), buf->instances.size(),
+                         sqrtf(buf->max_extent_sq));
+    return 0;
+}
+
+int set_compact_palette(const color *colors, uint num_colors)
+{
+    if (num_colors > COMPACT_PALETTE_SIZE)
+        return -1;
+
+    Uint8 texels[4 * COMPACT_PALETTE_SIZE];
+    memset(texels, 255, sizeof(texels));
+    for (uint i = 0; i < COMPACT_PALETTE_SIZE; i++)
+        instancing.palette[i] = i < num_colors ? colors[i] :
+                                                 color { 255, 255, 255, 255 };
+    for (uint i = 0; i < num_colors; i++) {
+        texels[4 * i] = colors[i].r;
+        texels[4 * i + 1] = colors[i].g;
+        texels[4 * i + 2] = colors[i].b;
+        texels[4 * i + 3] = colors[i].a;
+    }
+
+    gl_state_bind_texture(GL_TEXTURE_2D, instancing.palette_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, COMPACT_PALETTE_SIZE, 1, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    stats.bytes_uploaded += sizeof(texels);
+    return 0;
+}
+
+static void setup_compact_attribs(GLuint vbo)
+{
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, instancing.mesh_vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(point), 0);
+    glEnableVertexAttribArray(0);
+
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, vbo);
+    GLsizei stride = sizeof(compact_instance);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, stride,
+                          (void *)offsetof(compact_instance, pos));
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_FALSE, stride,
+                          (void *)offsetof(compact_instance, axis_x));
+    glVertexAttribPointer(3, 2, GL_SHORT, GL_FALSE, stride,
+                          (void *)offsetof(compact_instance, axis_y));
+    glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, stride,
+                           (void *)offsetof(compact_instance, style));
+    for (GLuint i = 1; i <= 4; i++) {
+        glVertexAttribDivisor(i, 1);
+        glEnableVertexAttribArray(i);
+    }
+}
+
+int init_compact_tile(compact_tile *tile, instance_mesh mesh, point origin,
+                      float scale)
+{
+    if (mesh >= NUM_INSTANCE_MESHES || !(scale > 0.0f))
+        return -1;
 
+    *tile = {};
+    tile->mesh = mesh;
+    tile->origin = origin;
+    tile->scale = scale;
+    return 0;
+}
+
+int destroy_compact_tile(compact_tile *tile)
+{
+    if (tile->vao)
+        gl_state_bind_vertex_array(0);
+    glDeleteBuffers(1, &tile->vbo);
+    glDeleteVertexArrays(1, &tile->vao);
+    tile->vao = tile->vbo = 0;
+    tile->dirty = !tile->instances.empty();
+    return 0;
+}
+
+uint compact_tile_add(compact_tile *tile, const compact_instance *inst)
+{
+    tile->instances.push_back(*inst);
+    tile->dirty = true;
+    return tile->instances.size() - 1;
+}
+
+int compact_tile_update(compact_tile *tile, uint slot,
+                        const compact_instance *inst)
+{
+    if (slot >= tile->instances.size())
+        return -1;
+
+    tile->instances[slot] = *inst;
+    tile->dirty = true;
+    return 0;
+}
+
+int draw_compact_tile(compact_tile *tile)
+{
+    if (tile->mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+    if (tile->instances.empty())
+        return 0;
+
+    submit_batch();
+
+    if (!tile->vao) {
+        glGenVertexArrays(1, &tile->vao);
+        glGenBuffers(1, &tile->vbo);
+        gl_state_bind_vertex_array(tile->vao);
+        setup_compact_attribs(tile->vbo);
+        tile->dirty = true;
+    }
+
+    gl_state_bind_vertex_array(tile->vao);
+    if (tile->dirty) {
+        tile->num_fill = tile->num_border = 0;
+        float extent_sq = 0.0f;
+        for (const compact_instance &inst : tile->instances) {
+            Uint32 flags = inst.style >> COMPACT_FLAGS_SHIFT;
+            tile->num_fill += (flags & INSTANCE_FILL) != 0;
+            tile->num_border += (flags & INSTANCE_BORDER) != 0;
+            extent_sq = std::max(extent_sq, axes_extent_sq(inst.axis_x[0],
+                                 inst.axis_x[1], inst.axis_y[0],
+                                 inst.axis_y[1]));
+        }
+        tile->max_radius = tile->scale * sqrtf(extent_sq);
+
+        GLsizeiptr size = tile->instances.size() * sizeof(compact_instance);
+        gl_state_bind_buffer(GL_ARRAY_BUFFER, tile->vbo);
+        glBufferData(GL_ARRAY_BUFFER, size, tile->instances.data(),
+                     GL_STATIC_DRAW);
+        stats.bytes_uploaded += size;
+        tile->dirty = false;
+    }
+
+    draw_instance_passes(tile->mesh, tile->num_fill, tile->num_border, NULL,
+                         tile->instances.size(), tile->max_radius, tile);
+    return 0;
+}
+
+stats_2d get_stats_2d()
+{
+    return stats;
+}
+
+void reset_stats_2d()
+{
+    stats = {};
+}
+
+int set_circle_mode(circle_mode mode)
+{
+    if (mode != CIRCLE_FIXED && mode != CIRCLE_ADAPTIVE && mode != CIRCLE_SDF)
+        return -1;
+
+    cur_circle_mode = mode;
+    return 0;
+}
+
+circle_mode get_circle_mode()
+{
+    return cur_circle_mode;
+}
+
+int init_2d()
+{
     color default_color = { 0, 0, 255 };
 
-    prog_normal = create_program(shaders_normal, 2);
-    prog_rect = create_program(shaders_rect, 2);
+    init_circle_lods();
+
+    progs[PROG_BATCH] = build_program(PROG_BATCH, vs_batch);
+    progs[PROG_INSTANCED] = build_program(PROG_INSTANCED, vs_instanced);
+    progs[PROG_POLYLINE] = build_program(PROG_POLYLINE, vs_polyline);
+    progs[PROG_COMPACT] = build_program(PROG_COMPACT, vs_compact);
+
+    init_batch();
+    init_segments();
+    init_instancing();
     set_draw_color(&default_color);
     return 0;
 }
 
+int destroy_2d()
+{
+    batch.verts.clear();
+    batch.segments.clear();
+    batch.active = false;
+    glDeleteBuffers(1, &batch.vbo);
+    glDeleteVertexArrays(1, &batch.vao);
+    glDeleteBuffers(1, &batch.seg_mesh_vbo);
+    glDeleteBuffers(1, &batch.seg_vbo);
+    glDeleteVertexArrays(1, &batch.seg_vao);
+    glDeleteBuffers(1, &instancing.mesh_vbo);
+    glDeleteBuffers(1, &instancing.inst_vbo);
+    glDeleteVertexArrays(1, &instancing.vao);
+    glDeleteTextures(1, &instancing.palette_tex);
+    gl_state_invalidate();
+
+    for (uint kind = 0; kind < NUM_PROGS; kind++) {
+        delete_program(progs[kind]);
+        progs[kind] = 0;
+        uniforms[kind] = {};
+    }
+
+    batch.vbo = batch.vao = 0;
+    batch.seg_vao = batch.seg_mesh_vbo = batch.seg_vbo = 0;
+    instancing = {};
+    return 0;
+}
+
 int use_opengl_coords(space_2d *space)
 {
     space->use_normal = true;
+    space->cached = false;
     return 0;
 }
 
@@ -71,101 +1230,116 @@ int use_rectangle(space_2d *space, rect *drawing_space, float w_int)
     space->w_loc = drawing_space->w;
     space->h_loc = drawing_space->h;
     space->w_int = w_int;
+    space->cached = false;
     return 0;
 }
 
-int start_2d(space_2d *space)
+int update_space_2d(space_2d *space, int view_w, int view_h,
+                    int window_w, int window_h)
 {
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    if (space->use_normal) {
-        glUseProgram(prog_normal);
-        return 0;
-    }
+    if (view_w <= 0 || view_h <= 0 || window_w <= 0 || window_h <= 0)
+        return -1;
 
-    glUseProgram(prog_rect);
-    GLint vp_rect[4];
-    glGetIntegerv(GL_VIEWPORT, vp_rect);
+    space->view_w = view_w;
+    space->view_h = view_h;
+    space->window_w = window_w;
+    space->window_h = window_h;
+
+    if (space->use_normal) {
+        space->to_gl = affine_identity();
+    } else {
+        /* Width of the drawing space maps to w_int units, the same scale
+         * applies vertically */
+        float aspect = (float)view_w / (float)view_h;
+        float scale = fabs(space->w_loc) / space->w_int;
+        float sx = space->w_loc < 0.0f ? -scale : scale;
+        float sy = space->h_loc < 0.0f ? -scale : scale;
 
-    float aspect = (float)vp_rect[2] / (float)vp_rect[3];
-    float scale_w = fabs(space->w_loc) / space->w_int;
-    float multi_w = space->w_loc < 0.0f ? -1.0f : 1.0f;
-    float multi_h = space->h_loc < 0.0f ? -1.0f : 1.0f;
+        space->to_gl = { { 2.0f * sx, 0.0f,
+                           0.0f, 2.0f * aspect * sy,
+                           2.0f * space->origin.x - 1.0f,
+                           2.0f * aspect * space->origin.y - 1.0f } };
+    }
 
-    GLint aspect_loc = glGetUniformLocation(prog_rect, "aspect");
-    GLint scale_w_loc = glGetUniformLocation(prog_rect, "scale_w");
-    GLint multi_w_loc = glGetUniformLocation(prog_rect, "multi_w");
-    GLint multi_h_loc = glGetUniformLocation(prog_rect, "multi_h");
-    GLint origin_loc = glGetUniformLocation(prog_rect, "origin");
+    if (!affine_invert(&space->to_gl, &space->from_gl))
+        return -1;
 
-    glUniform1f(aspect_loc, aspect);
-    glUniform1f(scale_w_loc, scale_w);
-    glUniform1f(multi_w_loc, multi_w);
-    glUniform1f(multi_h_loc, multi_h);
-    glUniform2f(origin_loc, space->origin.x, space->origin.y);
+    space->cached = true;
     return 0;
 }
 
-#define ARRAY_SIZE(x) ((sizeof(x)) / (sizeof(*x)))
-
-int set_draw_color(color *color)
+int start_2d(space_2d *space)
 {
-    GLuint progs[] = { prog_rect /*, prog_normal*/ };
-    GLfloat f_color[] = { color->r / 255.0f, color->g / 255.0f,
-                          color->b / 255.0f, color->a / 255.0f };
+    submit_batch();
+    gl_state_disable(GL_CULL_FACE);
+    gl_state_disable(GL_DEPTH_TEST);
+    gl_state_clear(GL_DEPTH_BUFFER_BIT);
 
-    for (uint i = 0; i < ARRAY_SIZE(progs); i++) {
-        GLint loc = glGetUniformLocation (progs[i], "draw_color");
-
-        if (loc >= 0)
-            glUniform4fv(loc, 1, f_color);
+    GLint vp_rect[4];
+    gl_state_get_viewport(vp_rect);
+    if (!space->cached || space->view_w != vp_rect[2] ||
+        space->view_h != vp_rect[3]) {
+        /* Without a window size, assume it matches the drawable */
+        bool known = space->cached;
+        update_space_2d(space, vp_rect[2], vp_rect[3],
+                        known ? space->window_w : vp_rect[2],
+                        known ? space->window_h : vp_rect[3]);
     }
 
+    space_values.to_gl = space->to_gl;
+    space_values.px_per_unit = 0.5f * fabsf(space->to_gl.m[0]) * vp_rect[2];
+    space_values.half_viewport[0] = 0.5f * vp_rect[2];
+    space_values.half_viewport[1] = 0.5f * vp_rect[3];
+    use_prog(PROG_BATCH);
     return 0;
 }
 
-static GLint get_cur_uniform_loc(const char *name)
+int set_draw_color(color *color)
 {
-    GLint prog = 0;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &prog);
-    if (prog <= 0)
-        return -1;
-
-    GLint loc = glGetUniformLocation(prog, name);
-    if (loc < 0)
-        return -1;
-    
-    return loc;
+    batch.cur.color[0] = color->r;
+    batch.cur.color[1] = color->g;
+    batch.cur.color[2] = color->b;
+    batch.cur.color[3] = color->a;
+    return 0;
 }
 
 int set_rot_angle(float phi) {
-    GLint loc = glGetUniformLocation(prog_rect, "phi");
-    if (loc < 0)
-        std::runtime_error("Current program does not contain a rotation component");
-
-    glUniform1f(loc, phi);
+    batch.cur.rot[0] = cosf(phi);
+    batch.cur.rot[1] = sinf(phi);
     return 0;
 }
 
 int set_offset(point *offset) {
-    GLint loc = get_cur_uniform_loc("offset");
-    if (loc < 0)
-        std::runtime_error("Current program does not contain an offset component");
-
-    glUniform2f(loc, offset->x, offset->y);
+    batch.cur.offset[0] = offset->x;
+    batch.cur.offset[1] = offset->y;
     return 0;
 }
 
+static inline void set_pos(batch_vertex *vert, float x, float y)
+{
+    vert->pos[0] = x;
+    vert->pos[1] = y;
+}
+
 static void draw_tri_generic(tri *tri, bool border)
 {
-    GLfloat verts[] = { tri->points[0].x, tri->points[0].y,
-                        tri->points[1].x, tri->points[1].y,
-                        tri->points[2].x, tri->points[2].y };
+    if (!border) {
+        batch_vertex *verts = batch_reserve(GL_TRIANGLES, 3);
+        for (uint i = 0; i < 3; i++)
+            set_pos(&verts[i], tri->points[i].x, tri->points[i].y);
+    } else if (use_thick_lines()) {
+        push_polyline(tri->points, 3, true);
+    } else {
+        batch_vertex *verts = batch_reserve(GL_LINES, 6);
+        for (uint i = 0; i < 3; i++) {
+            point p1 = tri->points[i];
+            point p2 = tri->points[(i + 1) % 3];
+            set_pos(&verts[2 * i], p1.x, p1.y);
+            set_pos(&verts[2 * i + 1], p2.x, p2.y);
+        }
+    }
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(border ? GL_LINE_LOOP : GL_TRIANGLES, 0, 3);
+    batch_done();
 }
 
 /* TODO : use actual input */
@@ -183,16 +1357,29 @@ int draw_tri_border(tri *tri)
 
 static void draw_rect_generic(rect *rect, bool border)
 {
-    GLfloat verts[] = { rect->x, rect->y,
-                        rect->x + rect->w, rect->y,
-                        rect->x + rect->w, rect->y + rect->h,
-                        rect->x, rect->y + rect->h,
-                        rect->x + rect->w, rect->y + rect->h,
-                        rect->x, rect->y };
+    point corners[] = { { rect->x, rect->y },
+                        { rect->x + rect->w, rect->y },
+                        { rect->x + rect->w, rect->y + rect->h },
+                        { rect->x, rect->y + rect->h } };
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(border ? GL_LINE_LOOP : GL_TRIANGLES, 0, border ? 4 : 6);
+    if (!border) {
+        static const uint order[] = { 0, 1, 2, 3, 2, 0 };
+        batch_vertex *verts = batch_reserve(GL_TRIANGLES, ARRAY_SIZE(order));
+        for (uint i = 0; i < ARRAY_SIZE(order); i++)
+            set_pos(&verts[i], corners[order[i]].x, corners[order[i]].y);
+    } else if (use_thick_lines()) {
+        push_polyline(corners, ARRAY_SIZE(corners), true);
+    } else {
+        batch_vertex *verts = batch_reserve(GL_LINES, 8);
+        for (uint i = 0; i < 4; i++) {
+            point p1 = corners[i];
+            point p2 = corners[(i + 1) % 4];
+            set_pos(&verts[2 * i], p1.x, p1.y);
+            set_pos(&verts[2 * i + 1], p2.x, p2.y);
+        }
+    }
+
+    batch_done();
 }
 
 int draw_rect(rect *rect)
@@ -207,36 +1394,109 @@ int draw_rect_border(rect *rect)
     return 0;
 }
 
-#define PI 3.1415926f
-#define CIRCLE_DIVS 16
+int draw_tri_mesh(const point *points, const uint32_t *indices,
+                  uint num_indices)
+{
+    batch_vertex *verts = batch_reserve(GL_TRIANGLES, num_indices);
+    for (uint i = 0; i < num_indices; i++)
+        set_pos(&verts[i], points[indices[i]].x, points[indices[i]].y);
 
-static void draw_circle_generic(circle *circle, bool border)
+    batch_done();
+    return 0;
+}
+
+int draw_rings_border(const point *points, const uint32_t *ring_ends,
+                      uint num_rings)
 {
-    GLfloat verts[2 * CIRCLE_DIVS + 4];
-    uint offset = 0;
-    if (!border) {
-        verts[0] = circle->center.x;
-        verts[1] = circle->center.y;
-        offset = 1;
+    uint begin = 0;
+    for (uint r = 0; r < num_rings; r++) {
+        uint num = ring_ends[r] - begin;
+        if (num < 2) {
+            begin = ring_ends[r];
+            continue;
+        }
+
+        if (use_thick_lines()) {
+            push_polyline(&points[begin], num, true);
+        } else {
+            batch_vertex *verts = batch_reserve(GL_LINES, 2 * num);
+            for (uint i = 0; i < num; i++) {
+                point p1 = points[begin + i];
+                point p2 = points[begin + (i + 1) % num];
+                set_pos(&verts[2 * i], p1.x, p1.y);
+                set_pos(&verts[2 * i + 1], p2.x, p2.y);
+            }
+        }
+        begin = ring_ends[r];
     }
 
-    for (uint i = offset; i < CIRCLE_DIVS + offset; i++) {
-        float phi = 2.0f * PI * (float)i / (float)CIRCLE_DIVS;
-        verts[i * 2] = circle->center.x + circle->radius * cosf(phi);
-        verts[i * 2 + 1] = circle->center.y + circle->radius * sinf(phi);
+    batch_done();
+    return 0;
+}
+
+static void draw_circle_tessellated(circle *circle, bool border)
+{
+    const std::vector<point> &table = circle_table(circle->radius);
+    uint divs = table.size();
+    point c = circle->center;
+    float r = circle->radius;
+
+    if (border && use_thick_lines()) {
+        static std::vector<point> ring;
+        ring.resize(divs);
+        for (uint i = 0; i < divs; i++)
+            ring[i] = { c.x + r * table[i].x, c.y + r * table[i].y };
+        push_polyline(ring.data(), divs, true);
+        return;
     }
 
-    if (!border) {
-        verts[CIRCLE_DIVS * 2 + 2] = verts[2];
-        verts[CIRCLE_DIVS * 2 + 3] = verts[3];
+    /* Fans and loops are unrolled so circles batch with other shapes */
+    batch_vertex *verts = batch_reserve(border ? GL_LINES : GL_TRIANGLES,
+                                        (border ? 2 : 3) * divs);
+    for (uint i = 0; i < divs; i++) {
+        point p1 = table[i];
+        point p2 = table[(i + 1) % divs];
+        if (!border)
+            set_pos(verts++, c.x, c.y);
+        set_pos(verts++, c.x + r * p1.x, c.y + r * p1.y);
+        set_pos(verts++, c.x + r * p2.x, c.y + r * p2.y);
     }
+}
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-    glEnableVertexAttribArray(0);
-    if (border)
-        glDrawArrays(GL_LINE_LOOP, 0, CIRCLE_DIVS);
+/* One quad, the fragment shader cuts out the circle */
+static void draw_circle_sdf(circle *circle, bool border)
+{
+    float r = fabsf(circle->radius);
+    if (r <= 0.0f)
+        return;
+
+    float half_width = border ? 0.5f * gl_state_get_line_width() : 0.0f;
+    float margin = 0.25f * r;
+    if (space_values.px_per_unit > 0.0f)
+        margin = (half_width + 1.0f) / space_values.px_per_unit;
+    float e = (r + margin) / r;    /* Quad extent in radii */
+
+    static const float corners[][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 },
+                                        { -1, 1 }, { 1, 1 }, { -1, -1 } };
+    batch_vertex *verts = batch_reserve(GL_TRIANGLES, ARRAY_SIZE(corners));
+    for (uint i = 0; i < ARRAY_SIZE(corners); i++) {
+        float u = e * corners[i][0];
+        float v = e * corners[i][1];
+        set_pos(&verts[i], circle->center.x + r * u, circle->center.y + r * v);
+        verts[i].sdf[0] = u;
+        verts[i].sdf[1] = v;
+        verts[i].sdf[2] = half_width;
+    }
+}
+
+static void draw_circle_generic(circle *circle, bool border)
+{
+    if (cur_circle_mode == CIRCLE_SDF)
+        draw_circle_sdf(circle, border);
     else
-        glDrawArrays(GL_TRIANGLE_FAN, 0, ARRAY_SIZE(verts) / 2);
+        draw_circle_tessellated(circle, border);
+
+    batch_done();
 }
 
 int draw_circle(circle *circle)
@@ -253,24 +1513,92 @@ int draw_circle_border(circle *circle)
 
 int draw_line(line *line)
 {
-    GLfloat verts[4] = {line->start.x, line->start.y,
-                        line->end.x, line->end.y};
+    if (use_thick_lines()) {
+        point ends[] = { line->start, line->end };
+        push_polyline(ends, ARRAY_SIZE(ends), false);
+        batch_done();
+        return 0;
+    }
 
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(GL_LINE_STRIP, 0, 2);
+    batch_vertex *verts = batch_reserve(GL_LINES, 2);
+    set_pos(&verts[0], line->start.x, line->start.y);
+    set_pos(&verts[1], line->end.x, line->end.y);
+
+    batch_done();
+    return 0;
+}
+
+int draw_polyline(const point *points, uint num_points, bool closed)
+{
+    if (!points || num_points < 2)
+        return -1;
+
+    push_polyline(points, num_points, closed);
+    batch_done();
+    return 0;
+}
+
+int draw_polyline_styled(const point *points, uint num_points, bool closed,
+                         const float *widths, const color *colors)
+{
+    if (!points || num_points < 2)
+        return -1;
+
+    uint num_segments = closed ? num_points : num_points - 1;
+    segment_instance *segs = push_polyline(points, num_points, closed);
+    for (uint i = 0; i < num_segments; i++) {
+        if (widths)
+            segs[i].width = widths[i];
+        if (colors) {
+            segs[i].color[0] = colors[i].r;
+            segs[i].color[1] = colors[i].g;
+            segs[i].color[2] = colors[i].b;
+            segs[i].color[3] = colors[i].a;
+        }
+    }
+
+    batch_done();
+    return 0;
+}
+
+int set_line_join(line_join join, float miter_limit)
+{
+    if ((join != JOIN_MITER && join != JOIN_BEVEL) || miter_limit < 1.0f)
+        return -1;
+
+    /* The limit is a uniform, pending segments were made with the old one */
+    if (miter_limit != batch.miter_limit)
+        submit_batch();
+    batch.join = join;
+    batch.miter_limit = miter_limit;
+    return 0;
+}
+
+int set_line_cap(line_cap cap)
+{
+    if (cap != CAP_BUTT && cap != CAP_SQUARE)
+        return -1;
+
+    batch.cap = cap;
     return 0;
 }
 
 void set_line_width(float w)
 {
-    glLineWidth(w);
+    if (w == gl_state_get_line_width())
+        return;
+
+    /* GL lines sample the width at draw time, pending ones keep the old
+     * one. Segments carry their own. */
+    if (batch.mode == GL_LINES && !batch.verts.empty())
+        submit_batch();
+    gl_state_line_width(w);
 }
 
 float get_h_to_w_aspect()
 {
     GLint vp_rect[4];
-    glGetIntegerv(GL_VIEWPORT, vp_rect);
+    gl_state_get_viewport(vp_rect);
 
     float aspect = (float)vp_rect[3] / (float)vp_rect[2];
     return aspect;
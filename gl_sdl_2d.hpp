@@ -1,7 +1,9 @@
 #ifndef GL_SDL_2D_H
 #define GL_SDL_2D_H
 
+#include <GL/glew.h>
 #include <SDL.h>
+#include <vector>
 #include "gl_sdl_geometry.hpp"
 
 typedef SDL_Color color;
@@ -14,19 +16,174 @@ int destroy_2d();
 
 int use_opengl_coords(space_2d *space);
 int use_rectangle(space_2d *space, rect *drawing_space, float w_int);
+/* Caches the space -> OpenGL mapping and its inverse, call it whenever the
+ * viewport or window size changes. start_2d falls back to the viewport. */
+int update_space_2d(space_2d *space, int view_w, int view_h,
+                    int window_w, int window_h);
 int start_2d(space_2d *space);
 
+/* Draw calls between these two are gathered and submitted together */
+int begin_batch_2d();
+int flush_batch_2d();
+
 int set_draw_color(color *color);
 
+enum circle_mode {
+    CIRCLE_FIXED,       /* 16 segments regardless of size */
+    CIRCLE_ADAPTIVE,    /* Segment count picked from the on-screen radius,
+                         * for instanced draws the largest one's */
+    CIRCLE_SDF          /* A quad per circle, shaded in the fragment shader */
+};
+
+int set_circle_mode(circle_mode mode);
+circle_mode get_circle_mode();
+
 int draw_rect(rect *rect);
 int draw_tri(tri *tri);
 int draw_circle(circle *circle);
 int draw_line(line *line);
 
+/* Triangles by indices into points, three per triangle. The batch is not
+ * indexed, they land in its vertex stream and share its one draw. */
+int draw_tri_mesh(const point *points, const uint32_t *indices,
+                  uint num_indices);
+
 int draw_tri_border(tri *tri);
 int draw_rect_border(rect *rect);
 int draw_circle_border(circle *circle);
+/* Closed rings one after another, ring_ends[i] one past the last point of
+ * ring i */
+int draw_rings_border(const point *points, const uint32_t *ring_ends,
+                      uint num_rings);
+
+/* Unit meshes for instanced drawing: a circle of radius 1 around (0, 0),
+ * the square (0, 0)-(1, 1) and the triangle (0, 0), (1, 0), (0, 1) */
+enum instance_mesh {
+    INSTANCE_CIRCLE,
+    INSTANCE_RECT,
+    INSTANCE_TRI,
+    NUM_INSTANCE_MESHES,
+    INSTANCE_NONE = NUM_INSTANCE_MESHES     /* Drawn through the batch */
+};
+
+#define INSTANCE_FILL 1u
+#define INSTANCE_BORDER 2u    /* Drawn in the complementary color */
+
+/* Mesh vertex m lands at R * (pos + m.x * axis_x + m.y * axis_y) + offset,
+ * R being the rotation by the angle with cosine rot[0] and sine rot[1] */
+struct shape_instance {
+    float pos[2];
+    float axis_x[2];
+    float axis_y[2];
+    float offset[2];
+    float rot[2];
+    Uint8 color[4];
+    Uint32 flags;
+};
+
+/* All fills go out in one instanced draw, followed by all borders */
+int draw_instances(instance_mesh mesh, const shape_instance *instances,
+                   uint num_instances);
+
+/* Instances that stay on the GPU between frames. Each one keeps its slot,
+ * only slots changed since the last draw get uploaded again. */
+struct instance_buffer {
+    instance_mesh mesh = INSTANCE_CIRCLE;
+    std::vector<shape_instance> instances;
+    std::vector<bool> slot_dirty;
+    std::vector<uint> dirty;        /* Slots to upload */
+    uint num_fill = 0;              /* Instances per pass, empty ones skip */
+    uint num_border = 0;
+    uint gpu_capacity = 0;          /* In instances */
+    float max_extent_sq = 0.0f;     /* Longest axis seen, for circle LODs */
+    GLuint vao = 0;
+    GLuint vbo = 0;
+};
+
+int init_instance_buffer(instance_buffer *buf, instance_mesh mesh);
+int destroy_instance_buffer(instance_buffer *buf);
+uint instance_buffer_add(instance_buffer *buf, const shape_instance *inst);
+int instance_buffer_update(instance_buffer *buf, uint slot,
+                           const shape_instance *inst);
+/* Same passes as draw_instances, after uploading the dirty slots */
+int draw_instance_buffer(instance_buffer *buf);
+
+/* Quantized instance for large static scenes, 16 bytes against the 48 of
+ * a shape_instance. Coordinates count steps of the tile scale from the
+ * tile origin: mesh vertex m lands at
+ * origin + scale * (pos + m.x * axis_x + m.y * axis_y). Rotations are
+ * baked into the axes, the color is an index into the compact palette. */
+struct compact_instance {
+    Sint16 pos[2];
+    Sint16 axis_x[2];
+    Sint16 axis_y[2];
+    Uint32 style;       /* Palette index in the low byte, flags above */
+};
+
+#define COMPACT_PALETTE_SIZE 256
+#define COMPACT_FLAGS_SHIFT 8
+
+/* Colors of all compact instances, the rest of the palette stays white */
+int set_compact_palette(const color *colors, uint num_colors);
+
+/* Compact instances of one mesh sharing an origin and a scale. Uploaded
+ * whole after a change, meant for shapes that rarely do. */
+struct compact_tile {
+    instance_mesh mesh = INSTANCE_CIRCLE;
+    point origin = { 0.0f, 0.0f };
+    float scale = 1.0f;             /* Units per step */
+    std::vector<compact_instance> instances;
+    bool dirty = false;
+    uint num_fill = 0;              /* Instances per pass, empty ones skip */
+    uint num_border = 0;
+    float max_radius = 0.0f;        /* Longest axis in units, for circle LODs */
+    GLuint vao = 0;
+    GLuint vbo = 0;
+};
+
+int init_compact_tile(compact_tile *tile, instance_mesh mesh, point origin,
+                      float scale);
+int destroy_compact_tile(compact_tile *tile);
+uint compact_tile_add(compact_tile *tile, const compact_instance *inst);
+int compact_tile_update(compact_tile *tile, uint slot,
+                        const compact_instance *inst);
+/* Same passes as draw_instances, decoded in the vertex shader */
+int draw_compact_tile(compact_tile *tile);
+
+/* Work handed to GL by this module since the last reset */
+struct stats_2d {
+    unsigned long draw_calls = 0;
+    unsigned long bytes_uploaded = 0;
+};
+
+stats_2d get_stats_2d();
+void reset_stats_2d();
+
+enum line_join {
+    JOIN_MITER,     /* Beveled past the miter limit */
+    JOIN_BEVEL
+};
+
+enum line_cap {
+    CAP_BUTT,
+    CAP_SQUARE      /* Extended by half the width */
+};
+
+/* The limit is the longest miter allowed, in line widths */
+int set_line_join(line_join join, float miter_limit);
+int set_line_cap(line_cap cap);
+
+/* Polylines are expanded into quads on the GPU, any width works and all
+ * segments between flushes share one draw. Closed polylines join the last
+ * point back to the first. */
+int draw_polyline(const point *points, uint num_points, bool closed);
+/* Segment i, from points[i] to the next point, takes widths[i] and
+ * colors[i]. Either may be NULL to keep the current width or color. */
+int draw_polyline_styled(const point *points, uint num_points, bool closed,
+                         const float *widths, const color *colors);
 
+/* In pixels, lines and borders wider than 1 go through the polyline path,
+ * borders of instances too unless they are SDF circles */
 void set_line_width(float w);
 float get_h_to_w_aspect();
 
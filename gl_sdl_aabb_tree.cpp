@@ -0,0 +1,422 @@
+#include "gl_sdl_aabb_tree.hpp"
+#include <algorithm>
+
+static bool is_leaf(const aabb_tree_node *node)
+{
+    return node->child[0] == AABB_TREE_NULL;
+}
+
+static float perimeter(const aabb *box)
+{
+    return 2.0f * ((box->max.x - box->min.x) + (box->max.y - box->min.y));
+}
+
+static bool contains(const aabb *outer, const aabb *inner)
+{
+    return outer->min.x <= inner->min.x && outer->min.y <= inner->min.y &&
+           inner->max.x <= outer->max.x && inner->max.y <= outer->max.y;
+}
+
+/* Whether a is drawn after b */
+static bool drawn_later(uint64_t order_a, uint32_t user_a, uint64_t order_b,
+                        uint32_t user_b)
+{
+    return order_a > order_b || (order_a == order_b && user_a > user_b);
+}
+
+static uint32_t allocate_node(aabb_tree *tree)
+{
+    uint32_t idx = tree->free_list;
+    if (idx != AABB_TREE_NULL) {
+        tree->free_list = tree->nodes[idx].parent;
+    } else {
+        idx = tree->nodes.size();
+        tree->nodes.emplace_back();
+    }
+
+    aabb_tree_node *node = &tree->nodes[idx];
+    node->parent = AABB_TREE_NULL;
+    node->child[0] = AABB_TREE_NULL;
+    node->child[1] = AABB_TREE_NULL;
+    node->height = 0;
+    return idx;
+}
+
+static void free_node(aabb_tree *tree, uint32_t idx)
+{
+    tree->nodes[idx].parent = tree->free_list;
+    tree->nodes[idx].height = -1;
+    tree->free_list = idx;
+}
+
+/* Box, height and topmost leaf from the two children */
+static void refit(aabb_tree *tree, uint32_t idx)
+{
+    aabb_tree_node *node = &tree->nodes[idx];
+    const aabb_tree_node *a = &tree->nodes[node->child[0]];
+    const aabb_tree_node *b = &tree->nodes[node->child[1]];
+
+    node->box = aabb_union(&a->box, &b->box);
+    node->height = 1 + std::max(a->height, b->height);
+    if (drawn_later(a->order, a->order_user, b->order, b->order_user)) {
+        node->order = a->order;
+        node->order_user = a->order_user;
+    } else {
+        node->order = b->order;
+        node->order_user = b->order_user;
+    }
+}
+
+/* Lifts the taller grandchild when the children of a differ in height by
+ * more than one, returns the node now in the place of a */
+static uint32_t balance(aabb_tree *tree, uint32_t ia)
+{
+    std::vector<aabb_tree_node> &n = tree->nodes;
+    aabb_tree_node *a = &n[ia];
+    if (is_leaf(a) || a->height < 2)
+        return ia;
+
+    uint32_t ib = a->child[0];
+    uint32_t ic = a->child[1];
+    int32_t diff = n[ic].height - n[ib].height;
+    if (diff >= -1 && diff <= 1)
+        return ia;
+
+    /* c is the taller child, a swaps places with it */
+    int side = diff > 1 ? 1 : 0;
+    if (side == 0)
+        std::swap(ib, ic);
+
+    uint32_t if_ = n[ic].child[0];
+    uint32_t ig = n[ic].child[1];
+
+    n[ic].child[0] = ia;
+    n[ic].parent = n[ia].parent;
+    n[ia].parent = ic;
+
+    if (n[ic].parent == AABB_TREE_NULL) {
+        tree->root = ic;
+    } else {
+        aabb_tree_node *p = &n[n[ic].parent];
+        p->child[p->child[0] == ia ? 0 : 1] = ic;
+    }
+
+    /* The taller grandchild stays under c, the other one replaces c */
+    if (n[if_].height < n[ig].height)
+        std::swap(if_, ig);
+    n[ic].child[1] = if_;
+    n[ia].child[side] = ig;
+    n[ig].parent = ia;
+
+    refit(tree, ia);
+    refit(tree, ic);
+    return ic;
+}
+
+static void refit_ancestors(aabb_tree *tree, uint32_t idx)
+{
+    while (idx != AABB_TREE_NULL) {
+        idx = balance(tree, idx);
+        refit(tree, idx);
+        idx = tree->nodes[idx].parent;
+    }
+}
+
+/* Descends towards the sibling that grows the total perimeter least */
+static uint32_t find_sibling(aabb_tree *tree, const aabb *box)
+{
+    uint32_t idx = tree->root;
+    while (!is_leaf(&tree->nodes[idx])) {
+        const aabb_tree_node *node = &tree->nodes[idx];
+        aabb combined = aabb_union(&node->box, box);
+        float combined_perimeter = perimeter(&combined);
+
+        /* Creating a parent here, and what descending passes on */
+        float cost = 2.0f * combined_perimeter;
+        float inherited = 2.0f * (combined_perimeter - perimeter(&node->box));
+
+        float child_cost[2];
+        for (int i = 0; i < 2; i++) {
+            const aabb_tree_node *child = &tree->nodes[node->child[i]];
+            aabb grown = aabb_union(&child->box, box);
+            child_cost[i] = perimeter(&grown) + inherited;
+            if (!is_leaf(child))
+                child_cost[i] -= perimeter(&child->box);
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+        idx = node->child[child_cost[0] <= child_cost[1] ? 0 : 1];
+    }
+
+    return idx;
+}
+
+static void insert_leaf(aabb_tree *tree, uint32_t leaf)
+{
+    if (tree->root == AABB_TREE_NULL) {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = AABB_TREE_NULL;
+        return;
+    }
+
+    aabb box = tree->nodes[leaf].box;
+    uint32_t sibling = find_sibling(tree, &box);
+
+    uint32_t parent = allocate_node(tree);
+    uint32_t old_parent = tree->nodes[sibling].parent;
+    tree->nodes[parent].parent = old_parent;
+    tree->nodes[parent].child[0] = sibling;
+    tree->nodes[parent].child[1] = leaf;
+    tree->nodes[sibling].parent = parent;
+    tree->nodes[leaf].parent = parent;
+
+    if (old_parent == AABB_TREE_NULL) {
+        tree->root = parent;
+    } else {
+        aabb_tree_node *p = &tree->nodes[old_parent];
+        p->child[p->child[0] == sibling ? 0 : 1] = parent;
+    }
+
+    refit_ancestors(tree, parent);
+}
+
+static void remove_leaf(aabb_tree *tree, uint32_t leaf)
+{
+    if (leaf == tree->root) {
+        tree->root = AABB_TREE_NULL;
+        return;
+    }
+
+    uint32_t parent = tree->nodes[leaf].parent;
+    const aabb_tree_node *p = &tree->nodes[parent];
+    uint32_t sibling = p->child[p->child[0] == leaf ? 1 : 0];
+    uint32_t grand_parent = p->parent;
+
+    tree->nodes[sibling].parent = grand_parent;
+    free_node(tree, parent);
+    if (grand_parent == AABB_TREE_NULL) {
+        tree->root = sibling;
+        return;
+    }
+
+    aabb_tree_node *g = &tree->nodes[grand_parent];
+    g->child[g->child[0] == parent ? 0 : 1] = sibling;
+    refit_ancestors(tree, grand_parent);
+}
+
+static bool valid_leaf(const aabb_tree *tree, uint32_t leaf)
+{
+    return leaf < tree->nodes.size() && tree->nodes[leaf].height == 0;
+}
+
+static aabb fatten(const aabb_tree *tree, const aabb *box)
+{
+    return { { box->min.x - tree->margin, box->min.y - tree->margin },
+             { box->max.x + tree->margin, box->max.y + tree->margin } };
+}
+
+int aabb_tree_init(aabb_tree *tree, float margin)
+{
+    if (!(margin >= 0.0f))
+        return -1;
+
+    tree->margin = margin;
+    aabb_tree_clear(tree);
+    return 0;
+}
+
+void aabb_tree_clear(aabb_tree *tree)
+{
+    tree->nodes.clear();
+    tree->root = AABB_TREE_NULL;
+    tree->free_list = AABB_TREE_NULL;
+}
+
+uint32_t aabb_tree_insert(aabb_tree *tree, const aabb *box, uint32_t user,
+                          uint64_t order)
+{
+    uint32_t leaf = allocate_node(tree);
+    aabb_tree_node *node = &tree->nodes[leaf];
+    node->box = fatten(tree, box);
+    node->user = user;
+    node->order = order;
+    node->order_user = user;
+
+    insert_leaf(tree, leaf);
+    return leaf;
+}
+
+int aabb_tree_remove(aabb_tree *tree, uint32_t leaf)
+{
+    if (!valid_leaf(tree, leaf))
+        return -1;
+
+    remove_leaf(tree, leaf);
+    free_node(tree, leaf);
+    return 0;
+}
+
+int aabb_tree_move(aabb_tree *tree, uint32_t leaf, const aabb *box)
+{
+    if (!valid_leaf(tree, leaf))
+        return -1;
+    if (contains(&tree->nodes[leaf].box, box))
+        return 0;
+
+    remove_leaf(tree, leaf);
+    tree->nodes[leaf].box = fatten(tree, box);
+    insert_leaf(tree, leaf);
+    return 1;
+}
+
+int aabb_tree_set_order(aabb_tree *tree, uint32_t leaf, uint64_t order)
+{
+    if (!valid_leaf(tree, leaf))
+        return -1;
+    if (tree->nodes[leaf].order == order)
+        return 0;
+
+    tree->nodes[leaf].order = order;
+    /* Ancestors only change while they had this leaf or now get it on top */
+    for (uint32_t idx = tree->nodes[leaf].parent; idx != AABB_TREE_NULL;
+         idx = tree->nodes[idx].parent) {
+        aabb_tree_node *node = &tree->nodes[idx];
+        uint64_t old_order = node->order;
+        uint32_t old_user = node->order_user;
+        refit(tree, idx);
+        if (node->order == old_order && node->order_user == old_user)
+            break;
+    }
+
+    return 0;
+}
+
+int aabb_tree_height(const aabb_tree *tree)
+{
+    if (tree->root == AABB_TREE_NULL)
+        return 0;
+    return tree->nodes[tree->root].height;
+}
+
+void aabb_tree_query(aabb_tree *tree, const aabb *box,
+                     std::vector<uint32_t> *hits)
+{
+    hits->clear();
+    if (tree->root == AABB_TREE_NULL)
+        return;
+
+    /* Leaves first, mapped to users once sorted */
+    std::vector<uint32_t> &stack = tree->stack;
+    stack.clear();
+    stack.push_back(tree->root);
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const aabb_tree_node *node = &tree->nodes[idx];
+        if (!intersect(&node->box, box))
+            continue;
+
+        if (is_leaf(node)) {
+            hits->push_back(idx);
+        } else {
+            stack.push_back(node->child[0]);
+            stack.push_back(node->child[1]);
+        }
+    }
+
+    const aabb_tree_node *nodes = tree->nodes.data();
+    std::sort(hits->begin(), hits->end(), [nodes](uint32_t a, uint32_t b) {
+        return drawn_later(nodes[a].order, nodes[a].user,
+                           nodes[b].order, nodes[b].user);
+    });
+    for (auto &hit : *hits)
+        hit = nodes[hit].user;
+}
+
+uint32_t aabb_tree_pick(aabb_tree *tree, point p,
+                        bool (*accept)(uint32_t user, void *data),
+                        void *data)
+{
+    uint32_t best = AABB_TREE_NULL;
+    if (tree->root == AABB_TREE_NULL)
+        return best;
+
+    /* Children with the later topmost leaf are visited first, subtrees
+     * with nothing above the best so far are skipped */
+    std::vector<uint32_t> &stack = tree->stack;
+    stack.clear();
+    stack.push_back(tree->root);
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const aabb_tree_node *node = &tree->nodes[idx];
+        if (!point_in_aabb(p, &node->box))
+            continue;
+        if (best != AABB_TREE_NULL &&
+            !drawn_later(node->order, node->order_user,
+                         tree->nodes[best].order, tree->nodes[best].user))
+            continue;
+
+        if (is_leaf(node)) {
+            if (accept(node->user, data))
+                best = idx;
+            continue;
+        }
+
+        const aabb_tree_node *a = &tree->nodes[node->child[0]];
+        const aabb_tree_node *b = &tree->nodes[node->child[1]];
+        bool a_first = drawn_later(a->order, a->order_user, b->order,
+                                   b->order_user);
+        stack.push_back(node->child[a_first ? 1 : 0]);
+        stack.push_back(node->child[a_first ? 0 : 1]);
+    }
+
+    return best == AABB_TREE_NULL ? AABB_TREE_NULL : tree->nodes[best].user;
+}
+
+void aabb_tree_cast(aabb_tree *tree, const line *segment,
+                    float (*cast)(uint32_t user, void *data), void *data)
+{
+    if (tree->root == AABB_TREE_NULL)
+        return;
+
+    float max_t = 1.0f;
+    std::vector<uint32_t> &stack = tree->stack;
+    stack.clear();
+    stack.push_back(tree->root);
+    while (!stack.empty()) {
+        uint32_t idx = stack.back();
+        stack.pop_back();
+
+        const aabb_tree_node *node = &tree->nodes[idx];
+        float t;
+        if (!segment_enters(segment, &node->box, max_t, &t))
+            continue;
+
+        if (is_leaf(node)) {
+            float hit = cast(node->user, data);
+            if (hit >= 0.0f && hit < max_t)
+                max_t = hit;
+            continue;
+        }
+
+        /* The child entered first goes on top */
+        float t0, t1;
+        bool enters0 = segment_enters(segment, &tree->nodes[node->child[0]].box,
+                                      max_t, &t0);
+        bool enters1 = segment_enters(segment, &tree->nodes[node->child[1]].box,
+                                      max_t, &t1);
+        if (enters0 && enters1) {
+            bool first0 = t0 <= t1;
+            stack.push_back(node->child[first0 ? 1 : 0]);
+            stack.push_back(node->child[first0 ? 0 : 1]);
+        } else if (enters0) {
+            stack.push_back(node->child[0]);
+        } else if (enters1) {
+            stack.push_back(node->child[1]);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef GL_SDL_AABB_TREE_H
+#define GL_SDL_AABB_TREE_H
+
+#include "gl_sdl_geometry.hpp"
+#include <stdint.h>
+#include <vector>
+
+#define AABB_TREE_NULL 0xffffffffu
+
+/* Leaves carry a draw order, higher is drawn later. Equal orders are
+ * broken by the user value, the higher one being drawn later. */
+struct aabb_tree_node {
+    aabb box;               /* Fattened by the margin for leaves */
+    uint64_t order;         /* Inner nodes: of the topmost leaf below */
+    uint32_t order_user;
+    uint32_t parent;        /* Next free node while unused */
+    uint32_t child[2];      /* AABB_TREE_NULL for leaves */
+    uint32_t user;
+    int32_t height;         /* 0 for leaves, -1 while unused */
+};
+
+/* Dynamic bounding volume tree, kept balanced by rotations. Leaves hold
+ * boxes grown by the margin, a box moving within its fat box costs
+ * nothing, one leaving it is reinserted. */
+struct aabb_tree {
+    std::vector<aabb_tree_node> nodes;
+    uint32_t root = AABB_TREE_NULL;
+    uint32_t free_list = AABB_TREE_NULL;
+    float margin = 0.0f;
+    std::vector<uint32_t> stack;    /* Traversal scratch */
+};
+
+int aabb_tree_init(aabb_tree *tree, float margin);
+void aabb_tree_clear(aabb_tree *tree);
+/* Returns the leaf for the calls below */
+uint32_t aabb_tree_insert(aabb_tree *tree, const aabb *box, uint32_t user,
+                          uint64_t order);
+int aabb_tree_remove(aabb_tree *tree, uint32_t leaf);
+/* Returns 1 when the leaf had to be reinserted, 0 when it fit */
+int aabb_tree_move(aabb_tree *tree, uint32_t leaf, const aabb *box);
+int aabb_tree_set_order(aabb_tree *tree, uint32_t leaf, uint64_t order);
+int aabb_tree_height(const aabb_tree *tree);
+
+/* Users of all leaves whose fat box overlaps box, topmost first. hits is
+ * cleared first. */
+void aabb_tree_query(aabb_tree *tree, const aabb *box,
+                     std::vector<uint32_t> *hits);
+/* Topmost user whose fat box holds p and that accept agrees to, or
+ * AABB_TREE_NULL. accept only runs for leaves above the best so far. */
+uint32_t aabb_tree_pick(aabb_tree *tree, point p,
+                        bool (*accept)(uint32_t user, void *data),
+                        void *data);
+/* Runs cast for the users whose fat box the segment crosses, nearer boxes
+ * first. cast returns the t of a hit on its user or a negative value, boxes
+ * entered past the nearest hit so far are skipped. */
+void aabb_tree_cast(aabb_tree *tree, const line *segment,
+                    float (*cast)(uint32_t user, void *data), void *data);
+
+#endif
@@ -0,0 +1,506 @@
+#include "gl_sdl_broadphase.hpp"
+#include "gl_sdl_thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define MIN_BUCKETS 256
+/* Work of one task of the threaded rebuild */
+#define PROXIES_PER_TASK 4096
+#define BUCKET_RANGE_SHIFT 12
+/* Beyond this cell coordinates no longer fit an int32_t */
+#define CELL_LIMIT 1073741824.0f
+
+static uint32_t bucket_of(int32_t cell_x, int32_t cell_y, uint32_t mask)
+{
+    uint32_t h = (uint32_t)cell_x * 0x8da6b343u ^ (uint32_t)cell_y * 0xd8163841u;
+    return (h ^ h >> 15) & mask;
+}
+
+/* False for boxes spanning too many cells, including NaN ones */
+static bool cell_range(const spatial_hash *hash, const aabb *box,
+                       float max_cells, int32_t *cell_min, int32_t *cell_max)
+{
+    float x0 = floorf(box->min.x * hash->inv_cell_size);
+    float y0 = floorf(box->min.y * hash->inv_cell_size);
+    float x1 = floorf(box->max.x * hash->inv_cell_size);
+    float y1 = floorf(box->max.y * hash->inv_cell_size);
+    if (!(x0 >= -CELL_LIMIT && y0 >= -CELL_LIMIT &&
+          x1 <= CELL_LIMIT && y1 <= CELL_LIMIT && x0 <= x1 && y0 <= y1))
+        return false;
+    if ((x1 - x0 + 1.0f) * (y1 - y0 + 1.0f) > max_cells)
+        return false;
+
+    cell_min[0] = (int32_t)x0;
+    cell_min[1] = (int32_t)y0;
+    cell_max[0] = (int32_t)x1;
+    cell_max[1] = (int32_t)y1;
+    return true;
+}
+
+static void set_box(spatial_hash *hash, spatial_hash_proxy *p,
+                    const aabb *box)
+{
+    p->box = *box;
+    p->large = !cell_range(hash, box, SPATIAL_HASH_MAX_CELLS, p->cell_min,
+                           p->cell_max);
+}
+
+template<typename F>
+static void for_each_cell(const spatial_hash_proxy *p, F f)
+{
+    for (int32_t y = p->cell_min[1]; y <= p->cell_max[1]; y++) {
+        for (int32_t x = p->cell_min[0]; x <= p->cell_max[0]; x++)
+            f(x, y);
+    }
+}
+
+static uint32_t num_cells(const spatial_hash_proxy *p)
+{
+    return (p->cell_max[0] - p->cell_min[0] + 1) *
+           (p->cell_max[1] - p->cell_min[1] + 1);
+}
+
+/* About one bucket per entry */
+static uint32_t bucket_count(uint32_t num_entries)
+{
+    uint32_t num_buckets = MIN_BUCKETS;
+    while (num_buckets < num_entries)
+        num_buckets *= 2;
+    return num_buckets;
+}
+
+/* Counting sort of all entries by bucket */
+static void rebuild_grid(spatial_hash *hash)
+{
+    hash->large.clear();
+    uint32_t num_entries = 0;
+    for (uint32_t i = 0; i < hash->proxies.size(); i++) {
+        const spatial_hash_proxy *p = &hash->proxies[i];
+        if (!p->in_use)
+            continue;
+        if (p->large) {
+            hash->large.push_back(i);
+            continue;
+        }
+        num_entries += num_cells(p);
+    }
+
+    uint32_t num_buckets = bucket_count(num_entries);
+    uint32_t mask = num_buckets - 1;
+
+    std::vector<uint32_t> &start = hash->bucket_start;
+    start.assign(num_buckets + 1, 0);
+    for (auto &p : hash->proxies) {
+        if (!p.in_use || p.large)
+            continue;
+        for_each_cell(&p, [&](int32_t x, int32_t y) {
+            start[bucket_of(x, y, mask)]++;
+        });
+    }
+    for (uint32_t i = 1; i < num_buckets; i++)
+        start[i] += start[i - 1];
+
+    /* Filled from the back, start[] ends up at the first entry of each */
+    hash->entries.resize(num_entries);
+    std::vector<spatial_hash_entry> &entries = hash->entries;
+    for (auto &p : hash->proxies) {
+        if (!p.in_use || p.large)
+            continue;
+        for_each_cell(&p, [&](int32_t x, int32_t y) {
+            uint32_t slot = --start[bucket_of(x, y, mask)];
+            entries[slot] = { x, y, { p.cell_min[0], p.cell_min[1] }, p.box,
+                              p.user };
+        });
+    }
+    start[num_buckets] = num_entries;
+
+    hash->stale = false;
+}
+
+struct rebuild_job {
+    spatial_hash *hash;
+    uint32_t num_chunks;
+    uint32_t num_ranges;
+    uint32_t mask;
+};
+
+static void count_chunk_entries(uint32_t begin, uint32_t end, void *data)
+{
+    rebuild_job *job = (rebuild_job *)data;
+    spatial_hash *hash = job->hash;
+    for (uint32_t c = begin; c < end; c++) {
+        uint32_t last = std::min((c + 1) * PROXIES_PER_TASK,
+                                 (uint32_t)hash->proxies.size());
+        uint32_t entries = 0, large = 0;
+        for (uint32_t i = c * PROXIES_PER_TASK; i < last; i++) {
+            const spatial_hash_proxy *p = &hash->proxies[i];
+            if (!p->in_use)
+                continue;
+            if (p->large)
+                large++;
+            else
+                entries += num_cells(p);
+        }
+        hash->chunk_entries[c] = entries;
+        hash->chunk_large[c] = large;
+    }
+}
+
+static void count_chunk_ranges(uint32_t begin, uint32_t end, void *data)
+{
+    rebuild_job *job = (rebuild_job *)data;
+    spatial_hash *hash = job->hash;
+    for (uint32_t c = begin; c < end; c++) {
+        uint32_t *counts = &hash->range_offsets[c * job->num_ranges];
+        std::fill(counts, counts + job->num_ranges, 0);
+        uint32_t last = std::min((c + 1) * PROXIES_PER_TASK,
+                                 (uint32_t)hash->proxies.size());
+        for (uint32_t i = c * PROXIES_PER_TASK; i < last; i++) {
+            const spatial_hash_proxy *p = &hash->proxies[i];
+            if (!p->in_use || p->large)
+                continue;
+            for_each_cell(p, [&](int32_t x, int32_t y) {
+                counts[bucket_of(x, y, job->mask) >> BUCKET_RANGE_SHIFT]++;
+            });
+        }
+    }
+}
+
+/* Proxy order is kept within each bucket range */
+static void scatter_chunk(uint32_t begin, uint32_t end, void *data)
+{
+    rebuild_job *job = (rebuild_job *)data;
+    spatial_hash *hash = job->hash;
+    for (uint32_t c = begin; c < end; c++) {
+        uint32_t *offsets = &hash->range_offsets[c * job->num_ranges];
+        uint32_t large = hash->chunk_large[c];
+        uint32_t last = std::min((c + 1) * PROXIES_PER_TASK,
+                                 (uint32_t)hash->proxies.size());
+        for (uint32_t i = c * PROXIES_PER_TASK; i < last; i++) {
+            const spatial_hash_proxy *p = &hash->proxies[i];
+            if (!p->in_use)
+                continue;
+            if (p->large) {
+                hash->large[large++] = i;
+                continue;
+            }
+            for_each_cell(p, [&](int32_t x, int32_t y) {
+                uint32_t range = bucket_of(x, y, job->mask) >>
+                                 BUCKET_RANGE_SHIFT;
+                hash->unsorted[offsets[range]++] =
+                    { x, y, { p->cell_min[0], p->cell_min[1] }, p->box,
+                      p->user };
+            });
+        }
+    }
+}
+
+/* The serial counting sort confined to one bucket range */
+static void sort_range(uint32_t begin, uint32_t end, void *data)
+{
+    rebuild_job *job = (rebuild_job *)data;
+    spatial_hash *hash = job->hash;
+    uint32_t num_buckets = job->mask + 1;
+    for (uint32_t r = begin; r < end; r++) {
+        /* Entries of the range end where the next one starts */
+        uint32_t first = r ? hash->range_offsets[(job->num_chunks - 1) *
+                                                 job->num_ranges + r - 1] : 0;
+        uint32_t last = hash->range_offsets[(job->num_chunks - 1) *
+                                            job->num_ranges + r];
+        uint32_t first_bucket = r << BUCKET_RANGE_SHIFT;
+        uint32_t end_bucket = std::min((r + 1) << BUCKET_RANGE_SHIFT,
+                                       num_buckets);
+
+        uint32_t *start = hash->bucket_start.data();
+        std::fill(start + first_bucket, start + end_bucket, 0);
+        start[first_bucket] = first;
+        const spatial_hash_entry *unsorted = hash->unsorted.data();
+        for (uint32_t i = first; i < last; i++)
+            start[bucket_of(unsorted[i].cell_x, unsorted[i].cell_y,
+                            job->mask)]++;
+        for (uint32_t b = first_bucket + 1; b < end_bucket; b++)
+            start[b] += start[b - 1];
+        if (first == last)
+            continue;
+
+        for (uint32_t i = first; i < last; i++) {
+            uint32_t bucket = bucket_of(unsorted[i].cell_x, unsorted[i].cell_y,
+                                        job->mask);
+            hash->entries[--start[bucket]] = unsorted[i];
+        }
+    }
+}
+
+/* rebuild_grid in passes over fixed chunks of proxies: count, partition
+ * into bucket ranges, then sort each range on its own */
+static void rebuild_grid_parallel(spatial_hash *hash, thread_pool *pool)
+{
+    rebuild_job job;
+    job.hash = hash;
+    job.num_chunks = (hash->proxies.size() + PROXIES_PER_TASK - 1) /
+                     PROXIES_PER_TASK;
+    if (!job.num_chunks) {
+        rebuild_grid(hash);
+        return;
+    }
+
+    hash->chunk_entries.resize(job.num_chunks);
+    hash->chunk_large.resize(job.num_chunks);
+    thread_pool_parallel_for(pool, job.num_chunks, 1, count_chunk_entries,
+                             &job);
+
+    uint32_t num_entries = 0, num_large = 0;
+    for (uint32_t c = 0; c < job.num_chunks; c++) {
+        num_entries += hash->chunk_entries[c];
+        uint32_t large = hash->chunk_large[c];
+        hash->chunk_large[c] = num_large;
+        num_large += large;
+    }
+
+    uint32_t num_buckets = bucket_count(num_entries);
+    job.mask = num_buckets - 1;
+    job.num_ranges = ((num_buckets - 1) >> BUCKET_RANGE_SHIFT) + 1;
+    hash->range_offsets.resize(job.num_chunks * job.num_ranges);
+    thread_pool_parallel_for(pool, job.num_chunks, 1, count_chunk_ranges,
+                             &job);
+
+    /* Ranges one after another, chunks in order within each */
+    uint32_t offset = 0;
+    for (uint32_t r = 0; r < job.num_ranges; r++) {
+        for (uint32_t c = 0; c < job.num_chunks; c++) {
+            uint32_t *count = &hash->range_offsets[c * job.num_ranges + r];
+            uint32_t n = *count;
+            *count = offset;
+            offset += n;
+        }
+    }
+
+    hash->large.resize(num_large);
+    hash->unsorted.resize(num_entries);
+    thread_pool_parallel_for(pool, job.num_chunks, 1, scatter_chunk, &job);
+
+    /* Offsets of the last chunk now end each range */
+    hash->bucket_start.resize(num_buckets + 1);
+    hash->entries.resize(num_entries);
+    thread_pool_parallel_for(pool, job.num_ranges, 1, sort_range, &job);
+    hash->bucket_start[num_buckets] = num_entries;
+
+    hash->stale = false;
+}
+
+int spatial_hash_init(spatial_hash *hash, float cell_size)
+{
+    if (!(cell_size > 0.0f))
+        return -1;
+
+    hash->cell_size = cell_size;
+    hash->inv_cell_size = 1.0f / cell_size;
+    hash->proxies.clear();
+    hash->free_proxies.clear();
+    hash->stale = true;
+    return 0;
+}
+
+void spatial_hash_clear(spatial_hash *hash)
+{
+    spatial_hash_init(hash, hash->cell_size > 0.0f ? hash->cell_size : 1.0f);
+}
+
+uint32_t spatial_hash_insert(spatial_hash *hash, const aabb *box,
+                             uint32_t user)
+{
+    if (!(hash->cell_size > 0.0f))
+        return SPATIAL_HASH_NULL;
+
+    uint32_t proxy;
+    if (!hash->free_proxies.empty()) {
+        proxy = hash->free_proxies.back();
+        hash->free_proxies.pop_back();
+    } else {
+        proxy = hash->proxies.size();
+        hash->proxies.emplace_back();
+    }
+
+    spatial_hash_proxy *p = &hash->proxies[proxy];
+    set_box(hash, p, box);
+    p->user = user;
+    p->in_use = true;
+    hash->stale = true;
+    return proxy;
+}
+
+int spatial_hash_move(spatial_hash *hash, uint32_t proxy, const aabb *box)
+{
+    if (proxy >= hash->proxies.size() || !hash->proxies[proxy].in_use)
+        return -1;
+
+    spatial_hash_proxy *p = &hash->proxies[proxy];
+    if (!memcmp(&p->box, box, sizeof(aabb)))
+        return 0;
+
+    set_box(hash, p, box);
+    hash->stale = true;
+    return 0;
+}
+
+int spatial_hash_set_user(spatial_hash *hash, uint32_t proxy, uint32_t user)
+{
+    if (proxy >= hash->proxies.size() || !hash->proxies[proxy].in_use)
+        return -1;
+
+    /* Entries hold a copy */
+    hash->proxies[proxy].user = user;
+    hash->stale = true;
+    return 0;
+}
+
+bool spatial_hash_move_unsynced(spatial_hash *hash, uint32_t proxy,
+                                const aabb *box)
+{
+    spatial_hash_proxy *p = &hash->proxies[proxy];
+    if (!p->in_use || !memcmp(&p->box, box, sizeof(aabb)))
+        return false;
+
+    set_box(hash, p, box);
+    return true;
+}
+
+void spatial_hash_invalidate(spatial_hash *hash)
+{
+    hash->stale = true;
+}
+
+int spatial_hash_remove(spatial_hash *hash, uint32_t proxy)
+{
+    if (proxy >= hash->proxies.size() || !hash->proxies[proxy].in_use)
+        return -1;
+
+    hash->proxies[proxy].in_use = false;
+    hash->free_proxies.push_back(proxy);
+    hash->stale = true;
+    return 0;
+}
+
+static void add_pair(std::vector<broadphase_pair> *pairs, uint32_t a,
+                     uint32_t b)
+{
+    if (a < b)
+        pairs->push_back({ a, b });
+    else
+        pairs->push_back({ b, a });
+}
+
+/* intersect() for aabbs, inlined into the pair loops */
+static bool boxes_touch(const aabb *a, const aabb *b)
+{
+    return (a->min.x <= b->max.x) & (b->min.x <= a->max.x) &
+           (a->min.y <= b->max.y) & (b->min.y <= a->max.y);
+}
+
+/* A pair sharing several cells is only reported from the one holding the
+ * larger of their minimum corners */
+static bool is_reference_cell(const int32_t *cell_min_a,
+                              const int32_t *cell_min_b, int32_t x, int32_t y)
+{
+    return (x == std::max(cell_min_a[0], cell_min_b[0])) &
+           (y == std::max(cell_min_a[1], cell_min_b[1]));
+}
+
+void spatial_hash_find_pairs(spatial_hash *hash,
+                             std::vector<broadphase_pair> *pairs)
+{
+    pairs->clear();
+    uint32_t num_buckets = spatial_hash_prepare(hash, nullptr);
+    spatial_hash_find_pairs_in(hash, 0, num_buckets, pairs);
+    spatial_hash_find_large_pairs(hash, pairs);
+}
+
+uint32_t spatial_hash_prepare(spatial_hash *hash, thread_pool *pool)
+{
+    if (hash->stale && pool && thread_pool_size(pool) > 1)
+        rebuild_grid_parallel(hash, pool);
+    else if (hash->stale)
+        rebuild_grid(hash);
+    return hash->bucket_start.size() - 1;
+}
+
+void spatial_hash_find_pairs_in(const spatial_hash *hash, uint32_t first_bucket,
+                                uint32_t end_bucket,
+                                std::vector<broadphase_pair> *pairs)
+{
+    const spatial_hash_entry *entries = hash->entries.data();
+    for (uint32_t bucket = first_bucket; bucket < end_bucket; bucket++) {
+        uint32_t end = hash->bucket_start[bucket + 1];
+        for (uint32_t i = hash->bucket_start[bucket]; i < end; i++) {
+            const spatial_hash_entry *a = &entries[i];
+            for (uint32_t j = i + 1; j < end; j++) {
+                /* Evaluated in full, the branches would mispredict */
+                const spatial_hash_entry *b = &entries[j];
+                bool hit = (b->cell_x == a->cell_x) & (b->cell_y == a->cell_y) &
+                           is_reference_cell(a->cell_min, b->cell_min,
+                                             a->cell_x, a->cell_y) &
+                           boxes_touch(&a->box, &b->box);
+                if (hit)
+                    add_pair(pairs, a->user, b->user);
+            }
+        }
+    }
+}
+
+void spatial_hash_find_large_pairs(const spatial_hash *hash,
+                                   std::vector<broadphase_pair> *pairs)
+{
+    /* Large boxes meet everything, other large boxes only once */
+    const spatial_hash_proxy *proxies = hash->proxies.data();
+    for (uint32_t l : hash->large) {
+        const spatial_hash_proxy *a = &proxies[l];
+        for (uint32_t i = 0; i < hash->proxies.size(); i++) {
+            const spatial_hash_proxy *b = &proxies[i];
+            if (!b->in_use || i == l || (b->large && i < l))
+                continue;
+            if (intersect(&a->box, &b->box))
+                add_pair(pairs, a->user, b->user);
+        }
+    }
+}
+
+void spatial_hash_query(spatial_hash *hash, const aabb *box,
+                        std::vector<uint32_t> *hits)
+{
+    hits->clear();
+    if (hash->stale)
+        rebuild_grid(hash);
+
+    for (uint32_t l : hash->large) {
+        if (intersect(&hash->proxies[l].box, box))
+            hits->push_back(hash->proxies[l].user);
+    }
+
+    /* Boxes covering more cells than there are entries are cheaper to test
+     * one by one */
+    int32_t query_min[2], query_max[2];
+    if (!cell_range(hash, box, (float)hash->entries.size(), query_min,
+                    query_max)) {
+        for (auto &p : hash->proxies) {
+            if (p.in_use && !p.large && intersect(&p.box, box))
+                hits->push_back(p.user);
+        }
+        return;
+    }
+
+    uint32_t mask = hash->bucket_start.size() - 2;
+    for (int32_t y = query_min[1]; y <= query_max[1]; y++) {
+        for (int32_t x = query_min[0]; x <= query_max[0]; x++) {
+            uint32_t bucket = bucket_of(x, y, mask);
+            uint32_t end = hash->bucket_start[bucket + 1];
+            for (uint32_t i = hash->bucket_start[bucket]; i < end; i++) {
+                const spatial_hash_entry *e = &hash->entries[i];
+                if (e->cell_x == x && e->cell_y == y &&
+                    is_reference_cell(e->cell_min, query_min, x, y) &&
+                    intersect(&e->box, box))
+                    hits->push_back(e->user);
+            }
+        }
+    }
+}
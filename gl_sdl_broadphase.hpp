@@ -0,0 +1,98 @@
+#ifndef GL_SDL_BROADPHASE_H
+#define GL_SDL_BROADPHASE_H
+
+#include "gl_sdl_geometry.hpp"
+#include <stdint.h>
+#include <vector>
+
+/* Two bounding boxes that touch, by the values passed at insertion.
+ * Narrowphase tests decide whether the shapes really intersect. */
+struct broadphase_pair {
+    uint32_t a;
+    uint32_t b;
+};
+
+struct thread_pool;
+
+#define SPATIAL_HASH_NULL 0xffffffffu
+/* Boxes covering more cells than this skip the grid and get tested
+ * against everything instead */
+#define SPATIAL_HASH_MAX_CELLS 16
+
+struct spatial_hash_proxy {
+    aabb box;
+    int32_t cell_min[2];    /* Range of cells overlapped */
+    int32_t cell_max[2];
+    uint32_t user;
+    bool large;             /* Too many cells, tested against everything */
+    bool in_use;
+};
+
+/* A box in one of its cells, with what pair tests need copied in */
+struct spatial_hash_entry {
+    int32_t cell_x;
+    int32_t cell_y;
+    int32_t cell_min[2];
+    aabb box;
+    uint32_t user;
+};
+
+/* Uniform grid over the plane, cells hashed into a power of two number of
+ * buckets. Insert, move and remove only touch the proxy. The grid is
+ * rebuilt in one counting sort pass by the next query after something
+ * changed, cheaper than editing buckets when most boxes move every frame,
+ * and free when nothing did. */
+struct spatial_hash {
+    float cell_size = 0.0f;
+    float inv_cell_size = 0.0f;
+    std::vector<spatial_hash_proxy> proxies;
+    std::vector<uint32_t> free_proxies;
+
+    bool stale = true;                      /* Grid behind the proxies */
+    std::vector<uint32_t> bucket_start;     /* Into entries, one extra */
+    std::vector<spatial_hash_entry> entries;
+    std::vector<uint32_t> large;            /* Proxies */
+
+    /* Scratch of the threaded rebuild */
+    std::vector<spatial_hash_entry> unsorted;   /* By bucket range */
+    std::vector<uint32_t> chunk_entries;    /* Per proxy chunk, then offset */
+    std::vector<uint32_t> chunk_large;
+    std::vector<uint32_t> range_offsets;    /* Per proxy chunk, bucket range */
+};
+
+/* Cells around twice the size of a typical box work best */
+int spatial_hash_init(spatial_hash *hash, float cell_size);
+void spatial_hash_clear(spatial_hash *hash);
+/* Returns the proxy for move and remove, user comes back in pairs and
+ * query results */
+uint32_t spatial_hash_insert(spatial_hash *hash, const aabb *box,
+                             uint32_t user);
+int spatial_hash_move(spatial_hash *hash, uint32_t proxy, const aabb *box);
+int spatial_hash_remove(spatial_hash *hash, uint32_t proxy);
+/* For users that renumber their boxes */
+int spatial_hash_set_user(spatial_hash *hash, uint32_t proxy, uint32_t user);
+/* spatial_hash_move for threads moving distinct proxies side by side, true
+ * if the box changed. The grid is not marked stale, spatial_hash_invalidate
+ * has to follow once if any box changed. */
+bool spatial_hash_move_unsynced(spatial_hash *hash, uint32_t proxy,
+                                const aabb *box);
+void spatial_hash_invalidate(spatial_hash *hash);
+/* Every overlapping pair exactly once, pairs is cleared first */
+void spatial_hash_find_pairs(spatial_hash *hash,
+                             std::vector<broadphase_pair> *pairs);
+/* spatial_hash_find_pairs in pieces, for threads. After prepare, which
+ * returns the number of buckets, bucket ranges and the large boxes can be
+ * searched concurrently. Both append, consecutive ranges followed by the
+ * large pairs come out in the order of spatial_hash_find_pairs. Given a
+ * pool prepare rebuilds the grid on it, into the same grid as without. */
+uint32_t spatial_hash_prepare(spatial_hash *hash, thread_pool *pool);
+void spatial_hash_find_pairs_in(const spatial_hash *hash, uint32_t first_bucket,
+                                uint32_t end_bucket,
+                                std::vector<broadphase_pair> *pairs);
+void spatial_hash_find_large_pairs(const spatial_hash *hash,
+                                   std::vector<broadphase_pair> *pairs);
+/* Users of all boxes overlapping box, each once, hits is cleared first */
+void spatial_hash_query(spatial_hash *hash, const aabb *box,
+                        std::vector<uint32_t> *hits);
+
+#endif
@@ -0,0 +1,214 @@
+#include "gl_sdl_compact.hpp"
+#include <cmath>
+
+int compact_palette_index(compact_palette *palette, color c)
+{
+    Uint32 key = (Uint32)c.r | (Uint32)c.g << 8 | (Uint32)c.b << 16 |
+                 (Uint32)c.a << 24;
+    auto it = palette->lookup.find(key);
+    if (it != palette->lookup.end())
+        return it->second;
+    if (palette->colors.size() >= COMPACT_PALETTE_SIZE)
+        return -1;
+
+    uint8_t index = palette->colors.size();
+    palette->colors.push_back(c);
+    palette->lookup[key] = index;
+    return index;
+}
+
+static bool quantize(float x, Sint16 *q)
+{
+    float r = roundf(x);
+    if (!(r >= -32768.0f && r <= 32767.0f))
+        return false;
+    *q = (Sint16)r;
+    return true;
+}
+
+int compact_encode(const compact_tile *tile, const shape_instance *inst,
+                   uint8_t palette_index, compact_instance *out)
+{
+    float c = inst->rot[0];
+    float s = inst->rot[1];
+    float inv = 1.0f / tile->scale;
+    float px = inst->pos[0], py = inst->pos[1];
+    float pos[2] = {
+        (c * px - s * py + inst->offset[0] - tile->origin.x) * inv,
+        (s * px + c * py + inst->offset[1] - tile->origin.y) * inv
+    };
+    float axes[2][2];
+    const float *in_axes[2] = { inst->axis_x, inst->axis_y };
+    for (int k = 0; k < 2; k++) {
+        axes[k][0] = (c * in_axes[k][0] - s * in_axes[k][1]) * inv;
+        axes[k][1] = (s * in_axes[k][0] + c * in_axes[k][1]) * inv;
+    }
+
+    compact_instance q;
+    for (int k = 0; k < 2; k++) {
+        if (!quantize(pos[k], &q.pos[k]) ||
+            !quantize(axes[0][k], &q.axis_x[k]) ||
+            !quantize(axes[1][k], &q.axis_y[k]))
+            return -1;
+    }
+
+    q.style = palette_index | inst->flags << COMPACT_FLAGS_SHIFT;
+    *out = q;
+    return 0;
+}
+
+void compact_decode(const compact_tile *tile, const compact_palette *palette,
+                    const compact_instance *inst, shape_instance *out)
+{
+    float scale = tile->scale;
+    for (int k = 0; k < 2; k++) {
+        out->pos[k] = scale * inst->pos[k];
+        out->axis_x[k] = scale * inst->axis_x[k];
+        out->axis_y[k] = scale * inst->axis_y[k];
+    }
+    out->offset[0] = tile->origin.x;
+    out->offset[1] = tile->origin.y;
+    out->rot[0] = 1.0f;
+    out->rot[1] = 0.0f;
+
+    uint index = inst->style & 0xffu;
+    color c = index < palette->colors.size() ? palette->colors[index]
+                                             : color { 255, 255, 255, 255 };
+    out->color[0] = c.r;
+    out->color[1] = c.g;
+    out->color[2] = c.b;
+    out->color[3] = c.a;
+    out->flags = inst->style >> COMPACT_FLAGS_SHIFT;
+}
+
+static point to_steps(const compact_tile *tile, point p)
+{
+    float inv = 1.0f / tile->scale;
+    return { (p.x - tile->origin.x) * inv, (p.y - tile->origin.y) * inv };
+}
+
+static circle step_circle(const compact_instance *inst)
+{
+    float ax = inst->axis_x[0], ay = inst->axis_x[1];
+    return { { (float)inst->pos[0], (float)inst->pos[1] },
+             sqrtf(ax * ax + ay * ay) };
+}
+
+static quad step_quad(const compact_instance *inst)
+{
+    point p = { (float)inst->pos[0], (float)inst->pos[1] };
+    vect ax = { (float)inst->axis_x[0], (float)inst->axis_x[1] };
+    vect ay = { (float)inst->axis_y[0], (float)inst->axis_y[1] };
+    return { { p, { p.x + ax.x, p.y + ax.y },
+               { p.x + ax.x + ay.x, p.y + ax.y + ay.y },
+               { p.x + ay.x, p.y + ay.y } } };
+}
+
+static tri step_tri(const compact_instance *inst)
+{
+    quad q = step_quad(inst);
+    return { { q.points[0], q.points[1], q.points[3] } };
+}
+
+static aabb step_box(const compact_tile *tile, const compact_instance *inst)
+{
+    float px = inst->pos[0], py = inst->pos[1];
+    if (tile->mesh == INSTANCE_CIRCLE) {
+        float r = step_circle(inst).radius;
+        return { { px - r, py - r }, { px + r, py + r } };
+    }
+
+    /* Tris and rects both reach pos + axis_x and pos + axis_y, rects also
+     * their sum */
+    float min[2] = { 0.0f, 0.0f }, max[2] = { 0.0f, 0.0f };
+    for (int k = 0; k < 2; k++) {
+        float ax = inst->axis_x[k], ay = inst->axis_y[k];
+        float sum = tile->mesh == INSTANCE_RECT ? ax + ay : 0.0f;
+        float corners[3] = { ax, ay, sum };
+        for (float c : corners) {
+            min[k] = fminf(min[k], c);
+            max[k] = fmaxf(max[k], c);
+        }
+    }
+    return { { px + min[0], py + min[1] }, { px + max[0], py + max[1] } };
+}
+
+uint32_t compact_tile_pick(const compact_tile *tile, point p)
+{
+    point q = to_steps(tile, p);
+    for (size_t i = tile->instances.size(); i-- > 0;) {
+        const compact_instance *inst = &tile->instances[i];
+        aabb box = step_box(tile, inst);
+        if (!(inst->style >> COMPACT_FLAGS_SHIFT) || !point_in_aabb(q, &box))
+            continue;
+
+        bool hit;
+        if (tile->mesh == INSTANCE_CIRCLE) {
+            circle c = step_circle(inst);
+            hit = point_in_circle(q, &c);
+        } else if (tile->mesh == INSTANCE_RECT) {
+            quad r = step_quad(inst);
+            hit = point_in_quad(q, &r);
+        } else {
+            tri t = step_tri(inst);
+            hit = point_in_tri(q, &t);
+        }
+        if (hit)
+            return i;
+    }
+
+    return COMPACT_NONE;
+}
+
+/* Exact tests of an instance against a query, in steps */
+static bool touches(circle *c, quad *area) { return intersect(c, area); }
+static bool touches(quad *r, quad *area) { return intersect(r, area); }
+static bool touches(tri *t, quad *area) { return intersect(t, area); }
+static bool touches(circle *c, circle *q) { return intersect(q, c); }
+static bool touches(quad *r, circle *q) { return intersect(q, r); }
+static bool touches(tri *t, circle *q) { return intersect(q, t); }
+
+template<typename Q>
+static void query_steps(const compact_tile *tile, const aabb *q_box, Q *q,
+                        std::vector<uint32_t> *hits)
+{
+    hits->clear();
+    for (uint32_t i = 0; i < tile->instances.size(); i++) {
+        const compact_instance *inst = &tile->instances[i];
+        aabb inst_box = step_box(tile, inst);
+        if (!(inst->style >> COMPACT_FLAGS_SHIFT) ||
+            !intersect(q_box, &inst_box))
+            continue;
+
+        bool hit;
+        if (tile->mesh == INSTANCE_CIRCLE) {
+            circle c = step_circle(inst);
+            hit = touches(&c, q);
+        } else if (tile->mesh == INSTANCE_RECT) {
+            quad r = step_quad(inst);
+            hit = touches(&r, q);
+        } else {
+            tri t = step_tri(inst);
+            hit = touches(&t, q);
+        }
+        if (hit)
+            hits->push_back(i);
+    }
+}
+
+void compact_tile_query(const compact_tile *tile, const aabb *box,
+                        std::vector<uint32_t> *hits)
+{
+    aabb q = { to_steps(tile, box->min), to_steps(tile, box->max) };
+    quad area = { { q.min, { q.max.x, q.min.y }, q.max,
+                    { q.min.x, q.max.y } } };
+    query_steps(tile, &q, &area, hits);
+}
+
+void compact_tile_overlap(const compact_tile *tile, const circle *c,
+                          std::vector<uint32_t> *hits)
+{
+    circle q = { to_steps(tile, c->center), c->radius / tile->scale };
+    aabb q_box = bounding_box(&q);
+    query_steps(tile, &q_box, &q, hits);
+}
@@ -0,0 +1,46 @@
+#ifndef GL_SDL_COMPACT_H
+#define GL_SDL_COMPACT_H
+
+#include "gl_sdl_2d.hpp"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/* Building and querying compact tiles, see compact_instance. Tiles of 2^16
+ * steps reach 65536 * scale units across, a step of 1/256 unit covers a
+ * 256 unit map tile. */
+
+#define COMPACT_NONE 0xffffffffu
+
+/* CPU side of the palette, set_compact_palette uploads colors */
+struct compact_palette {
+    std::vector<color> colors;
+    std::unordered_map<Uint32, uint8_t> lookup;
+};
+
+/* Index of the color, added when missing. -1 once the palette is full. */
+int compact_palette_index(compact_palette *palette, color c);
+
+/* Quantizes an instance for the tile, rotation and offset folded into the
+ * position and axes. Corners land within 1.5 steps of where the instance
+ * puts them. Fails when the position or an axis lies over 32767 steps
+ * out. */
+int compact_encode(const compact_tile *tile, const shape_instance *inst,
+                   uint8_t palette_index, compact_instance *out);
+/* Back to a shape_instance in world units, colored by the palette */
+void compact_decode(const compact_tile *tile, const compact_palette *palette,
+                    const compact_instance *inst, shape_instance *out);
+
+/* Collision kernels, working on the quantized values: the query is taken
+ * into tile steps once, shapes are never decoded to world units. Instances
+ * without flags are skipped. */
+
+/* Last instance containing p, the one drawn on top, or COMPACT_NONE */
+uint32_t compact_tile_pick(const compact_tile *tile, point p);
+/* Instances intersecting the box or the circle, hits is cleared first */
+void compact_tile_query(const compact_tile *tile, const aabb *box,
+                        std::vector<uint32_t> *hits);
+void compact_tile_overlap(const compact_tile *tile, const circle *circle,
+                          std::vector<uint32_t> *hits);
+
+#endif
@@ -2,6 +2,52 @@
 #include <cmath>
 #include <limits>
 
+affine_2d affine_identity()
+{
+    return { { 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f } };
+}
+
+point affine_apply(const affine_2d *a, point p)
+{
+    return { a->m[0] * p.x + a->m[2] * p.y + a->m[4],
+             a->m[1] * p.x + a->m[3] * p.y + a->m[5] };
+}
+
+vect affine_apply_vect(const affine_2d *a, vect v)
+{
+    return { a->m[0] * v.x + a->m[2] * v.y,
+             a->m[1] * v.x + a->m[3] * v.y };
+}
+
+affine_2d affine_mul(const affine_2d *a, const affine_2d *b)
+{
+    const float *x = a->m;
+    const float *y = b->m;
+    return { { x[0] * y[0] + x[2] * y[1],
+               x[1] * y[0] + x[3] * y[1],
+               x[0] * y[2] + x[2] * y[3],
+               x[1] * y[2] + x[3] * y[3],
+               x[0] * y[4] + x[2] * y[5] + x[4],
+               x[1] * y[4] + x[3] * y[5] + x[5] } };
+}
+
+bool affine_invert(const affine_2d *a, affine_2d *inv)
+{
+    const float *m = a->m;
+    float det = m[0] * m[3] - m[2] * m[1];
+    if (det == 0.0f)
+        return false;
+
+    float id = 1.0f / det;
+    float i0 = m[3] * id;
+    float i1 = -m[1] * id;
+    float i2 = -m[2] * id;
+    float i3 = m[0] * id;
+    *inv = { { i0, i1, i2, i3,
+               -(i0 * m[4] + i2 * m[5]),
+               -(i1 * m[4] + i3 * m[5]) } };
+    return true;
+}
 
 void rotate_tri(tri *tri, float angle)
 {
@@ -36,6 +82,33 @@ void move_circle(circle *circle, vect v)
     circle->center.y += v.y;
 }
 
+quad rect_corners(rect *rect)
+{
+    return { { { rect->x, rect->y }, { rect->x + rect->w, rect->y },
+               { rect->x + rect->w, rect->y + rect->h },
+               { rect->x, rect->y + rect->h } } };
+}
+
+void rotate_quad(quad *quad, float angle)
+{
+    float s = sinf(angle);
+    float c = cosf(angle);
+
+    for (unsigned int i = 0; i < 4; i++) {
+        float x = quad->points[i].x;
+        float y = quad->points[i].y;
+        quad->points[i] = { x * c - y * s, x * s + y * c };
+    }
+}
+
+void move_quad(quad *quad, vect v)
+{
+    for (unsigned int i = 0; i < 4; i++) {
+        quad->points[i].x += v.x;
+        quad->points[i].y += v.y;
+    }
+}
+
 bool point_in_circle(point p, circle *circle)
 {
     float dist_x = p.x - circle->center.x;
@@ -89,6 +162,29 @@ bool point_in_tri(point p, tri *tri)
            points_on_same_side(&p, &c, &a, &b);
 }
 
+/* Either winding, on an edge counts */
+bool point_in_convex(point p, const point *poly, unsigned int num)
+{
+    bool any_left = false;
+    bool any_right = false;
+    for (unsigned int i = 0; i < num; i++) {
+        point a = poly[i];
+        point b = poly[i + 1 < num ? i + 1 : 0];
+        vect a_b = { b.x - a.x, b.y - a.y };
+        vect a_p = { p.x - a.x, p.y - a.y };
+        float z = cross_z(&a_b, &a_p);
+        any_left = any_left || z > 0.0f;
+        any_right = any_right || z < 0.0f;
+    }
+
+    return !(any_left && any_right);
+}
+
+bool point_in_quad(point p, quad *quad)
+{
+    return point_in_convex(p, quad->points, 4);
+}
+
 static float point_point_dist_sq(point p1, point p2)
 {
     return (p1.x - p2.x) * (p1.x - p2.x) + (p1.y - p2.y) * (p1.y - p2.y);
@@ -143,4 +239,317 @@ bool intersect(circle *circle, line *line)
 {
     float r2 = circle->radius * circle->radius;
     return line_point_dist_sq(line->start, line->end, circle->center) < r2;
-}
\ No newline at end of file
+}
+
+bool intersect_convex(circle *circle, const point *poly, unsigned int num)
+{
+    if (point_in_convex(circle->center, poly, num))
+        return true;
+
+    float r2 = circle->radius * circle->radius;
+    for (unsigned int i = 0; i < num; i++) {
+        if (line_point_dist_sq(poly[i], poly[i + 1 < num ? i + 1 : 0],
+                               circle->center) < r2)
+            return true;
+    }
+
+    return false;
+}
+
+bool intersect(circle *circle, quad *quad)
+{
+    return intersect_convex(circle, quad->points, 4);
+}
+
+/* Whether the normal of an edge of a has both polygons on disjoint
+ * intervals. Degenerate edges project everything to 0 and never do. */
+static bool edge_separates(const point *a, unsigned int num_a,
+                           const point *b, unsigned int num_b)
+{
+    for (unsigned int i = 0; i < num_a; i++) {
+        point p = a[i];
+        point q = a[i + 1 < num_a ? i + 1 : 0];
+        vect normal = { p.y - q.y, q.x - p.x };
+
+        float min_a = std::numeric_limits<float>::infinity();
+        float max_a = -min_a;
+        for (unsigned int j = 0; j < num_a; j++) {
+            float d = normal.x * a[j].x + normal.y * a[j].y;
+            min_a = fminf(min_a, d);
+            max_a = fmaxf(max_a, d);
+        }
+
+        float min_b = std::numeric_limits<float>::infinity();
+        float max_b = -min_b;
+        for (unsigned int j = 0; j < num_b; j++) {
+            float d = normal.x * b[j].x + normal.y * b[j].y;
+            min_b = fminf(min_b, d);
+            max_b = fmaxf(max_b, d);
+        }
+
+        if (max_a < min_b || max_b < min_a)
+            return true;
+    }
+
+    return false;
+}
+
+bool intersect_convex(const point *a, unsigned int num_a,
+                      const point *b, unsigned int num_b)
+{
+    return !edge_separates(a, num_a, b, num_b) &&
+           !edge_separates(b, num_b, a, num_a);
+}
+
+bool intersect(rect *rect_1, rect *rect_2)
+{
+    /* Both only have the x and y axes */
+    aabb box_1 = bounding_box(rect_1);
+    aabb box_2 = bounding_box(rect_2);
+    return intersect(&box_1, &box_2);
+}
+
+bool intersect(rect *rect, tri *tri)
+{
+    quad corners = rect_corners(rect);
+    return intersect_convex(corners.points, 4, tri->points, 3);
+}
+
+bool intersect(rect *rect, quad *quad)
+{
+    ::quad corners = rect_corners(rect);
+    return intersect_convex(corners.points, 4, quad->points, 4);
+}
+
+bool intersect(tri *tri_1, tri *tri_2)
+{
+    return intersect_convex(tri_1->points, 3, tri_2->points, 3);
+}
+
+bool intersect(tri *tri, quad *quad)
+{
+    return intersect_convex(tri->points, 3, quad->points, 4);
+}
+
+bool intersect(quad *quad_1, quad *quad_2)
+{
+    return intersect_convex(quad_1->points, 4, quad_2->points, 4);
+}
+
+static vect unit_vect(vect v)
+{
+    float len = sqrtf(v.x * v.x + v.y * v.y);
+    if (len == 0.0f)
+        return { 0.0f, 0.0f };
+    return { v.x / len, v.y / len };
+}
+
+static void set_hit(line *segment, float t, vect normal, segment_hit *hit)
+{
+    vect d = { segment->end.x - segment->start.x,
+               segment->end.y - segment->start.y };
+    hit->t = t;
+    hit->p = { segment->start.x + t * d.x, segment->start.y + t * d.y };
+    hit->normal = unit_vect(normal);
+}
+
+bool cast_segment(line *segment, circle *circle, segment_hit *hit)
+{
+    vect d = { segment->end.x - segment->start.x,
+               segment->end.y - segment->start.y };
+    vect m = { segment->start.x - circle->center.x,
+               segment->start.y - circle->center.y };
+    float c = m.x * m.x + m.y * m.y - circle->radius * circle->radius;
+    if (c <= 0.0f) {
+        set_hit(segment, 0.0f, { -d.x, -d.y }, hit);
+        return true;
+    }
+
+    /* |m + t d| = r, the smaller root */
+    float a = d.x * d.x + d.y * d.y;
+    float b = m.x * d.x + m.y * d.y;
+    float disc = b * b - a * c;
+    if (a == 0.0f || b >= 0.0f || disc < 0.0f)
+        return false;
+
+    float t = (-b - sqrtf(disc)) / a;
+    if (t > 1.0f)
+        return false;
+
+    set_hit(segment, t, { m.x + t * d.x, m.y + t * d.y }, hit);
+    return true;
+}
+
+/* Clips the segment against the inside of every edge */
+bool cast_segment_convex(line *segment, const point *v, unsigned int num,
+                         segment_hit *hit)
+{
+    float area = 0.0f;
+    for (unsigned int i = 0; i < num; i++) {
+        const point *a = &v[i];
+        const point *b = &v[i + 1 < num ? i + 1 : 0];
+        area += a->x * b->y - a->y * b->x;
+    }
+    if (area == 0.0f)
+        return false;
+
+    vect d = { segment->end.x - segment->start.x,
+               segment->end.y - segment->start.y };
+    float t_enter = 0.0f;
+    float t_exit = 1.0f;
+    vect normal = { -d.x, -d.y };
+    for (unsigned int i = 0; i < num; i++) {
+        const point *a = &v[i];
+        const point *b = &v[i + 1 < num ? i + 1 : 0];
+        vect e = { b->x - a->x, b->y - a->y };
+        vect n = area > 0.0f ? vect { e.y, -e.x } : vect { -e.y, e.x };
+
+        /* Inside while t * denom <= num */
+        float num_t = n.x * (a->x - segment->start.x) +
+                      n.y * (a->y - segment->start.y);
+        float denom = n.x * d.x + n.y * d.y;
+        if (denom == 0.0f) {
+            if (num_t < 0.0f)
+                return false;
+            continue;
+        }
+
+        float t = num_t / denom;
+        if (denom < 0.0f) {
+            if (t > t_enter) {
+                t_enter = t;
+                normal = n;
+            }
+        } else {
+            t_exit = fminf(t_exit, t);
+        }
+        if (t_enter > t_exit)
+            return false;
+    }
+
+    set_hit(segment, t_enter, normal, hit);
+    return true;
+}
+
+bool cast_segment(line *segment, rect *rect, segment_hit *hit)
+{
+    quad corners = rect_corners(rect);
+    return cast_segment_convex(segment, corners.points, 4, hit);
+}
+
+bool cast_segment(line *segment, tri *tri, segment_hit *hit)
+{
+    return cast_segment_convex(segment, tri->points, 3, hit);
+}
+
+bool cast_segment(line *segment, quad *quad, segment_hit *hit)
+{
+    return cast_segment_convex(segment, quad->points, 4, hit);
+}
+
+line ray_segment(point start, vect dir, float max_dist)
+{
+    vect u = unit_vect(dir);
+    return { start, { start.x + u.x * max_dist, start.y + u.y * max_dist } };
+}
+
+bool segment_enters(const line *segment, const aabb *box, float max_t,
+                    float *t)
+{
+    const float start[2] = { segment->start.x, segment->start.y };
+    const float d[2] = { segment->end.x - segment->start.x,
+                         segment->end.y - segment->start.y };
+    const float mins[2] = { box->min.x, box->min.y };
+    const float maxs[2] = { box->max.x, box->max.y };
+
+    float t_min = 0.0f;
+    float t_max = max_t;
+    for (int axis = 0; axis < 2; axis++) {
+        if (d[axis] == 0.0f) {
+            if (start[axis] < mins[axis] || start[axis] > maxs[axis])
+                return false;
+            continue;
+        }
+
+        float inv = 1.0f / d[axis];
+        float t0 = (mins[axis] - start[axis]) * inv;
+        float t1 = (maxs[axis] - start[axis]) * inv;
+        if (t0 > t1)
+            swapf(t0, t1);
+        t_min = fmaxf(t_min, t0);
+        t_max = fminf(t_max, t1);
+        if (t_min > t_max)
+            return false;
+    }
+
+    *t = t_min;
+    return true;
+}
+
+aabb bounding_box(circle *circle)
+{
+    float r = fabsf(circle->radius);
+    return { { circle->center.x - r, circle->center.y - r },
+             { circle->center.x + r, circle->center.y + r } };
+}
+
+aabb bounding_box(rect *rect)
+{
+    aabb box = { { rect->x, rect->y },
+                 { rect->x + rect->w, rect->y + rect->h } };
+    if (rect->w < 0.0f)
+        swapf(box.min.x, box.max.x);
+    if (rect->h < 0.0f)
+        swapf(box.min.y, box.max.y);
+
+    return box;
+}
+
+aabb bounding_box(tri *tri)
+{
+    aabb box = { tri->points[0], tri->points[0] };
+    for (unsigned int i = 1; i < 3; i++) {
+        box.min.x = fminf(box.min.x, tri->points[i].x);
+        box.min.y = fminf(box.min.y, tri->points[i].y);
+        box.max.x = fmaxf(box.max.x, tri->points[i].x);
+        box.max.y = fmaxf(box.max.y, tri->points[i].y);
+    }
+
+    return box;
+}
+
+aabb bounding_box(quad *quad)
+{
+    return bounding_box(quad->points, 4);
+}
+
+aabb bounding_box(const point *points, unsigned int num)
+{
+    aabb box = { points[0], points[0] };
+    for (unsigned int i = 1; i < num; i++) {
+        box.min.x = fminf(box.min.x, points[i].x);
+        box.min.y = fminf(box.min.y, points[i].y);
+        box.max.x = fmaxf(box.max.x, points[i].x);
+        box.max.y = fmaxf(box.max.y, points[i].y);
+    }
+
+    return box;
+}
+
+aabb aabb_union(const aabb *a, const aabb *b)
+{
+    return { { fminf(a->min.x, b->min.x), fminf(a->min.y, b->min.y) },
+             { fmaxf(a->max.x, b->max.x), fmaxf(a->max.y, b->max.y) } };
+}
+
+bool point_in_aabb(point p, const aabb *box)
+{
+    return p.x >= box->min.x && p.x <= box->max.x &&
+           p.y >= box->min.y && p.y <= box->max.y;
+}
+
+bool intersect(const aabb *a, const aabb *b)
+{
+    return a->min.x <= b->max.x && b->min.x <= a->max.x &&
+           a->min.y <= b->max.y && b->min.y <= a->max.y;
+}
@@ -13,15 +13,30 @@ struct point {
     float y;
 };
 
+typedef point vect;
+
+/* Column major 3x2 matrix, the layout of a GLSL mat3x2:
+ * x' = m[0] * x + m[2] * y + m[4], y' = m[1] * x + m[3] * y + m[5] */
+struct affine_2d {
+    float m[6];
+};
+
 struct space_2d {
     bool use_normal;
     point origin;
     float w_loc;
     float h_loc;
     float w_int;
-};
 
-typedef point vect;
+    /* Filled by update_space_2d, shared by drawing and picking */
+    bool cached = false;
+    affine_2d to_gl;
+    affine_2d from_gl;
+    int view_w;     /* Drawable size in pixels */
+    int view_h;
+    int window_w;   /* Window size in SDL mouse coordinates */
+    int window_h;
+};
 
 struct circle {
     point center;
@@ -37,18 +52,87 @@ struct tri {
     point points[3];
 };
 
+/* Convex quadrilateral, a rect once rotated */
+struct quad {
+    point points[4];
+};
+
+/* Axis aligned bounding box, min <= max on both axes */
+struct aabb {
+    point min;
+    point max;
+};
+
+/* Where a segment first enters a shape, t runs from 0 at its start to 1 at
+ * its end. The normal has unit length and faces the segment. */
+struct segment_hit {
+    float t;
+    point p;
+    vect normal;
+};
+
+affine_2d affine_identity();
+point affine_apply(const affine_2d *a, point p);
+vect affine_apply_vect(const affine_2d *a, vect v);
+affine_2d affine_mul(const affine_2d *a, const affine_2d *b);    /* a after b */
+bool affine_invert(const affine_2d *a, affine_2d *inv);
+
 void rotate_tri(tri *tri, float angle);
 void move_tri(tri *tri, vect v);
 void move_rect(rect *rect, vect v);
 void move_circle(circle *circle, vect v);
+quad rect_corners(rect *rect);
+void rotate_quad(quad *quad, float angle);     /* Around (0, 0), as tris */
+void move_quad(quad *quad, vect v);
 
 bool point_in_circle(point p, circle *circle);
 bool point_in_rect(point p, rect *rect);
 bool point_in_tri(point p, tri *tri);
+bool point_in_quad(point p, quad *quad);
 
 bool intersect(circle *circle_1, circle *circle_2);
 bool intersect(circle *circle, rect *rect);
 bool intersect(circle *circle, tri *tri);
 bool intersect(circle *circle, line *line);
+bool intersect(circle *circle, quad *quad);
+
+/* Separating axis tests, touching counts */
+bool intersect(rect *rect_1, rect *rect_2);
+bool intersect(rect *rect, tri *tri);
+bool intersect(rect *rect, quad *quad);
+bool intersect(tri *tri_1, tri *tri_2);
+bool intersect(tri *tri, quad *quad);
+bool intersect(quad *quad_1, quad *quad_2);
+
+/* Convex polygons given as num points in either winding, for shapes made
+ * of convex pieces */
+bool point_in_convex(point p, const point *poly, unsigned int num);
+bool intersect_convex(circle *circle, const point *poly, unsigned int num);
+bool intersect_convex(const point *a, unsigned int num_a,
+                      const point *b, unsigned int num_b);
+
+/* A segment starting inside hits at t = 0, the normal pointing back along
+ * the segment */
+bool cast_segment(line *segment, circle *circle, segment_hit *hit);
+bool cast_segment(line *segment, rect *rect, segment_hit *hit);
+bool cast_segment(line *segment, tri *tri, segment_hit *hit);
+bool cast_segment(line *segment, quad *quad, segment_hit *hit);
+bool cast_segment_convex(line *segment, const point *poly, unsigned int num,
+                         segment_hit *hit);
+/* Segment from start along dir, max_dist long */
+line ray_segment(point start, vect dir, float max_dist);
+/* Parameter at which the segment enters the box, false if it misses it
+ * before max_t */
+bool segment_enters(const line *segment, const aabb *box, float max_t,
+                    float *t);
+
+aabb bounding_box(circle *circle);
+aabb bounding_box(rect *rect);
+aabb bounding_box(tri *tri);
+aabb bounding_box(quad *quad);
+aabb bounding_box(const point *points, unsigned int num);  /* num > 0 */
+aabb aabb_union(const aabb *a, const aabb *b);
+bool point_in_aabb(point p, const aabb *box);
+bool intersect(const aabb *a, const aabb *b);   /* Touching counts */
 
 #endif
@@ -0,0 +1,299 @@
+#include "gl_sdl_geometry_batch.hpp"
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+/* Lane operations, every kernel is written once against these. The tests
+ * use the same operations in the same order as gl_sdl_geometry.cpp, and
+ * none of them fuse, so each lane rounds exactly like the scalar code as
+ * long as the compiler doesn't fuse the scalar code either: both files
+ * need -ffp-contract=off (see samples/Makefile). */
+
+struct scalar_ops {
+    typedef float vec;
+    typedef bool cond;
+    static const unsigned int width = 1;
+
+    static vec load(const float *p) { return *p; }
+    static vec set1(float x) { return x; }
+    static vec add(vec a, vec b) { return a + b; }
+    static vec sub(vec a, vec b) { return a - b; }
+    static vec mul(vec a, vec b) { return a * b; }
+    static cond lt(vec a, vec b) { return a < b; }
+    static cond le(vec a, vec b) { return a <= b; }
+    static cond ge(vec a, vec b) { return a >= b; }
+    static cond both(cond a, cond b) { return a && b; }
+    static vec select(cond c, vec a, vec b) { return c ? a : b; }
+    static uint32_t bits(cond c) { return c; }
+};
+
+#if defined(__AVX__)
+#define BATCH_ISA "avx"
+struct simd_ops {
+    typedef __m256 vec;
+    typedef __m256 cond;
+    static const unsigned int width = 8;
+
+    static vec load(const float *p) { return _mm256_loadu_ps(p); }
+    static vec set1(float x) { return _mm256_set1_ps(x); }
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static cond lt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static cond le(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static cond ge(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static cond both(cond a, cond b) { return _mm256_and_ps(a, b); }
+    static vec select(cond c, vec a, vec b) { return _mm256_blendv_ps(b, a, c); }
+    static uint32_t bits(cond c) { return _mm256_movemask_ps(c); }
+};
+#elif defined(__SSE2__) || defined(_M_X64)
+#define BATCH_ISA "sse2"
+struct simd_ops {
+    typedef __m128 vec;
+    typedef __m128 cond;
+    static const unsigned int width = 4;
+
+    static vec load(const float *p) { return _mm_loadu_ps(p); }
+    static vec set1(float x) { return _mm_set1_ps(x); }
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+    static cond lt(vec a, vec b) { return _mm_cmplt_ps(a, b); }
+    static cond le(vec a, vec b) { return _mm_cmple_ps(a, b); }
+    static cond ge(vec a, vec b) { return _mm_cmpge_ps(a, b); }
+    static cond both(cond a, cond b) { return _mm_and_ps(a, b); }
+    static vec select(cond c, vec a, vec b) {
+        return _mm_or_ps(_mm_and_ps(c, a), _mm_andnot_ps(c, b));
+    }
+    static uint32_t bits(cond c) { return _mm_movemask_ps(c); }
+};
+#elif defined(__wasm_simd128__)
+#define BATCH_ISA "wasm_simd128"
+struct simd_ops {
+    typedef v128_t vec;
+    typedef v128_t cond;
+    static const unsigned int width = 4;
+
+    static vec load(const float *p) { return wasm_v128_load(p); }
+    static vec set1(float x) { return wasm_f32x4_splat(x); }
+    static vec add(vec a, vec b) { return wasm_f32x4_add(a, b); }
+    static vec sub(vec a, vec b) { return wasm_f32x4_sub(a, b); }
+    static vec mul(vec a, vec b) { return wasm_f32x4_mul(a, b); }
+    static cond lt(vec a, vec b) { return wasm_f32x4_lt(a, b); }
+    static cond le(vec a, vec b) { return wasm_f32x4_le(a, b); }
+    static cond ge(vec a, vec b) { return wasm_f32x4_ge(a, b); }
+    static cond both(cond a, cond b) { return wasm_v128_and(a, b); }
+    static vec select(cond c, vec a, vec b) { return wasm_v128_bitselect(a, b, c); }
+    static uint32_t bits(cond c) { return wasm_i32x4_bitmask(c); }
+};
+#else
+#define BATCH_ISA "scalar"
+typedef scalar_ops simd_ops;
+#endif
+
+struct circle_test {
+    enum { PX, PY, CX, CY, R, NUM_INPUTS };
+
+    template<typename V>
+    static typename V::cond eval(const typename V::vec *in)
+    {
+        typename V::vec dist_x = V::sub(in[PX], in[CX]);
+        typename V::vec dist_y = V::sub(in[PY], in[CY]);
+        typename V::vec dist_sq = V::add(V::mul(dist_x, dist_x),
+                                         V::mul(dist_y, dist_y));
+        return V::le(dist_sq, V::mul(in[R], in[R]));
+    }
+};
+
+struct rect_test {
+    enum { PX, PY, X, Y, W, H, NUM_INPUTS };
+
+    template<typename V>
+    static typename V::cond eval(const typename V::vec *in)
+    {
+        typename V::vec zero = V::set1(0.0f);
+        typename V::vec x_end = V::add(in[X], in[W]);
+        typename V::vec y_end = V::add(in[Y], in[H]);
+        typename V::cond flip_x = V::lt(in[W], zero);
+        typename V::cond flip_y = V::lt(in[H], zero);
+        typename V::vec x_min = V::select(flip_x, x_end, in[X]);
+        typename V::vec x_max = V::select(flip_x, in[X], x_end);
+        typename V::vec y_min = V::select(flip_y, y_end, in[Y]);
+        typename V::vec y_max = V::select(flip_y, in[Y], y_end);
+
+        return V::both(V::both(V::le(in[PX], x_max), V::ge(in[PX], x_min)),
+                       V::both(V::le(in[PY], y_max), V::ge(in[PY], y_min)));
+    }
+};
+
+struct tri_test {
+    enum { PX, PY, AX, AY, BX, BY, CX, CY, NUM_INPUTS };
+
+    /* points_on_same_side(p, q, a, b) */
+    template<typename V>
+    static typename V::cond same_side(const typename V::vec *in, int q, int a,
+                                      int b)
+    {
+        typename V::vec a_p1_x = V::sub(in[PX], in[a]);
+        typename V::vec a_p1_y = V::sub(in[PY], in[a + 1]);
+        typename V::vec a_p2_x = V::sub(in[q], in[a]);
+        typename V::vec a_p2_y = V::sub(in[q + 1], in[a + 1]);
+        typename V::vec a_b_x = V::sub(in[b], in[a]);
+        typename V::vec a_b_y = V::sub(in[b + 1], in[a + 1]);
+
+        typename V::vec z1 = V::sub(V::mul(a_b_x, a_p1_y), V::mul(a_b_y, a_p1_x));
+        typename V::vec z2 = V::sub(V::mul(a_b_x, a_p2_y), V::mul(a_b_y, a_p2_x));
+        return V::ge(V::mul(z1, z2), V::set1(0.0f));
+    }
+
+    template<typename V>
+    static typename V::cond eval(const typename V::vec *in)
+    {
+        return V::both(V::both(same_side<V>(in, AX, BX, CX),
+                               same_side<V>(in, BX, CX, AX)),
+                       same_side<V>(in, CX, AX, BX));
+    }
+};
+
+/* A kernel input, either one value per element or one shared by all */
+struct lane_input {
+    const float *array;
+    float value;
+};
+
+static lane_input per_element(const float *array)
+{
+    return { array, 0.0f };
+}
+
+static lane_input shared(float value)
+{
+    return { NULL, value };
+}
+
+static unsigned int count_bits(uint32_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(bits);
+#else
+    unsigned int count = 0;
+    for (; bits; bits &= bits - 1)
+        count++;
+    return count;
+#endif
+}
+
+template<typename V, typename T>
+static uint32_t eval_at(const lane_input *inputs, unsigned int i)
+{
+    typename V::vec in[T::NUM_INPUTS];
+    for (unsigned int k = 0; k < T::NUM_INPUTS; k++) {
+        in[k] = inputs[k].array ? V::load(inputs[k].array + i)
+                                : V::set1(inputs[k].value);
+    }
+
+    return V::bits(T::template eval<V>(in));
+}
+
+/* Full vectors first, the remainder one element at a time. Vector widths
+ * divide 64, so a vector never straddles two mask words. */
+template<typename T>
+static unsigned int run_test(const lane_input *inputs, unsigned int count,
+                             uint64_t *mask)
+{
+    memset(mask, 0, BATCH_MASK_WORDS(count) * sizeof(*mask));
+
+    unsigned int hits = 0;
+    unsigned int i = 0;
+    for (; i + simd_ops::width <= count; i += simd_ops::width) {
+        uint32_t bits = eval_at<simd_ops, T>(inputs, i);
+        mask[i / 64] |= (uint64_t)bits << (i % 64);
+        hits += count_bits(bits);
+    }
+
+    for (; i < count; i++) {
+        uint32_t bit = eval_at<scalar_ops, T>(inputs, i);
+        mask[i / 64] |= (uint64_t)bit << (i % 64);
+        hits += bit;
+    }
+
+    return hits;
+}
+
+unsigned int points_in_circle(const points_soa *points, const circle *circle,
+                              uint64_t *mask)
+{
+    const lane_input inputs[] = { per_element(points->x),
+                                  per_element(points->y),
+                                  shared(circle->center.x),
+                                  shared(circle->center.y),
+                                  shared(circle->radius) };
+    return run_test<circle_test>(inputs, points->count, mask);
+}
+
+unsigned int points_in_rect(const points_soa *points, const rect *rect,
+                            uint64_t *mask)
+{
+    const lane_input inputs[] = { per_element(points->x),
+                                  per_element(points->y),
+                                  shared(rect->x), shared(rect->y),
+                                  shared(rect->w), shared(rect->h) };
+    return run_test<rect_test>(inputs, points->count, mask);
+}
+
+unsigned int points_in_tri(const points_soa *points, const tri *tri,
+                           uint64_t *mask)
+{
+    const lane_input inputs[] = { per_element(points->x),
+                                  per_element(points->y),
+                                  shared(tri->points[0].x),
+                                  shared(tri->points[0].y),
+                                  shared(tri->points[1].x),
+                                  shared(tri->points[1].y),
+                                  shared(tri->points[2].x),
+                                  shared(tri->points[2].y) };
+    return run_test<tri_test>(inputs, points->count, mask);
+}
+
+unsigned int point_in_circles(point p, const circles_soa *circles,
+                              uint64_t *mask)
+{
+    const lane_input inputs[] = { shared(p.x), shared(p.y),
+                                  per_element(circles->x),
+                                  per_element(circles->y),
+                                  per_element(circles->r) };
+    return run_test<circle_test>(inputs, circles->count, mask);
+}
+
+unsigned int point_in_rects(point p, const rects_soa *rects, uint64_t *mask)
+{
+    const lane_input inputs[] = { shared(p.x), shared(p.y),
+                                  per_element(rects->x),
+                                  per_element(rects->y),
+                                  per_element(rects->w),
+                                  per_element(rects->h) };
+    return run_test<rect_test>(inputs, rects->count, mask);
+}
+
+unsigned int point_in_tris(point p, const tris_soa *tris, uint64_t *mask)
+{
+    const lane_input inputs[] = { shared(p.x), shared(p.y),
+                                  per_element(tris->x[0]),
+                                  per_element(tris->y[0]),
+                                  per_element(tris->x[1]),
+                                  per_element(tris->y[1]),
+                                  per_element(tris->x[2]),
+                                  per_element(tris->y[2]) };
+    return run_test<tri_test>(inputs, tris->count, mask);
+}
+
+const char *geometry_batch_isa()
+{
+    return BATCH_ISA;
+}
@@ -0,0 +1,59 @@
+#ifndef GL_SDL_GEOMETRY_BATCH_H
+#define GL_SDL_GEOMETRY_BATCH_H
+
+#include "gl_sdl_geometry.hpp"
+#include <stdint.h>
+
+/* Containment tests over many points or many shapes at once. Inputs are
+ * structures of arrays, results are bitmasks with bit i % 64 of
+ * mask[i / 64] set when element i is inside. Every bit matches what the
+ * matching point_in_* call returns for that element. */
+
+#define BATCH_MASK_WORDS(_count) (((_count) + 63) / 64)
+
+struct points_soa {
+    const float *x;
+    const float *y;
+    unsigned int count;
+};
+
+struct circles_soa {
+    const float *x;     /* Center */
+    const float *y;
+    const float *r;
+    unsigned int count;
+};
+
+struct rects_soa {
+    const float *x;
+    const float *y;
+    const float *w;
+    const float *h;
+    unsigned int count;
+};
+
+struct tris_soa {
+    const float *x[3];
+    const float *y[3];
+    unsigned int count;
+};
+
+/* Many points against one shape, return the number of points inside */
+unsigned int points_in_circle(const points_soa *points, const circle *circle,
+                              uint64_t *mask);
+unsigned int points_in_rect(const points_soa *points, const rect *rect,
+                            uint64_t *mask);
+unsigned int points_in_tri(const points_soa *points, const tri *tri,
+                           uint64_t *mask);
+
+/* One point against many shapes, return the number of shapes hit */
+unsigned int point_in_circles(point p, const circles_soa *circles,
+                              uint64_t *mask);
+unsigned int point_in_rects(point p, const rects_soa *rects, uint64_t *mask);
+unsigned int point_in_tris(point p, const tris_soa *tris, uint64_t *mask);
+
+/* Instruction set picked at build time: "avx", "sse2", "wasm_simd128" or
+ * "scalar". AVX needs -mavx or better in the compiler flags. */
+const char *geometry_batch_isa();
+
+#endif
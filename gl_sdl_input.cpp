@@ -0,0 +1,53 @@
+#include "gl_sdl_input.hpp"
+
+void begin_input_frame(input_frame *input)
+{
+    Uint32 buttons = input->buttons;
+    point mouse = input->mouse;
+    *input = input_frame();
+    input->buttons = buttons;
+    input->mouse = mouse;
+}
+
+bool input_frame_add(input_frame *input, const SDL_Event *event)
+{
+    switch (event->type) {
+    case SDL_MOUSEMOTION: {
+        const SDL_MouseMotionEvent *motion = &event->motion;
+        vect rel = { (float)motion->xrel, (float)motion->yrel };
+        input->window_id = motion->windowID;
+        input->mouse = { (float)motion->x, (float)motion->y };
+        input->motion.x += rel.x;
+        input->motion.y += rel.y;
+        input->buttons = motion->state;
+        if (motion->state & SDL_BUTTON_LMASK) {
+            if (!input->dragging)
+                input->drag_start = input->mouse;
+            input->dragging = true;
+            input->drag.x += rel.x;
+            input->drag.y += rel.y;
+        }
+        break;
+    }
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP: {
+        const SDL_MouseButtonEvent *button = &event->button;
+        Uint32 mask = SDL_BUTTON(button->button);
+        input->window_id = button->windowID;
+        input->mouse = { (float)button->x, (float)button->y };
+        if (event->type == SDL_MOUSEBUTTONDOWN) {
+            input->buttons |= mask;
+            input->pressed |= mask;
+        } else {
+            input->buttons &= ~mask;
+            input->released |= mask;
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+
+    input->num_events++;
+    return true;
+}
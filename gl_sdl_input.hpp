@@ -0,0 +1,31 @@
+#ifndef GL_SDL_INPUT_H
+#define GL_SDL_INPUT_H
+
+#include "gl_sdl_utils.hpp"
+#include "gl_sdl_geometry.hpp"
+
+/* Mouse input of one frame, gathered from every event so that picking and
+ * dragging run once per frame rather than once per event. Positions and
+ * motion are in window coordinates, buttons are SDL_BUTTON masks. */
+struct input_frame {
+    uint num_events;        /* Mouse events gathered */
+    Uint32 window_id;       /* Of the last one */
+    point mouse;            /* Last position */
+    vect motion;            /* Sum of the relative motion */
+    Uint32 buttons;         /* Held after the last event */
+    Uint32 pressed;         /* Went down during the frame */
+    Uint32 released;        /* Went up during the frame */
+    /* Motion with the left button held: where the first of it ended and
+     * its sum */
+    bool dragging;
+    point drag_start;
+    vect drag;
+};
+
+/* Forgets the last frame's events, keeping the held buttons and the mouse
+ * position. Zero an input_frame before its first frame. */
+void begin_input_frame(input_frame *input);
+/* Adds a mouse event to the frame, false for other events */
+bool input_frame_add(input_frame *input, const SDL_Event *event);
+
+#endif
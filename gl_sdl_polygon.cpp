@@ -0,0 +1,348 @@
+#include "gl_sdl_polygon.hpp"
+#include <algorithm>
+#include <cmath>
+
+/* Positive when a, b, c turn counterclockwise */
+static float turn(point a, point b, point c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static bool same_point(point a, point b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+/* Twice the signed area, positive counterclockwise */
+static float ring_area(const point *points, uint32_t begin, uint32_t end)
+{
+    float area = 0.0f;
+    for (uint32_t i = begin; i < end; i++) {
+        point a = points[i];
+        point b = points[i + 1 < end ? i + 1 : begin];
+        area += a.x * b.y - a.y * b.x;
+    }
+
+    return area;
+}
+
+static void append_ring(const point *points, uint32_t begin, uint32_t end,
+                        bool ccw, std::vector<uint32_t> *ring)
+{
+    ring->clear();
+    bool reverse = (ring_area(points, begin, end) > 0.0f) != ccw;
+    for (uint32_t i = begin; i < end; i++)
+        ring->push_back(reverse ? end - 1 - (i - begin) : i);
+}
+
+/* Whether direction p -> m starts into the polygon at the corner p */
+static bool corner_faces(point prev, point p, point next, point m)
+{
+    bool left_in = turn(prev, p, m) > 0.0f;
+    bool left_out = turn(p, next, m) > 0.0f;
+    return turn(prev, p, next) >= 0.0f ? left_in && left_out
+                                       : left_in || left_out;
+}
+
+static bool in_triangle(point a, point b, point c, point p)
+{
+    return turn(a, b, p) >= 0.0f && turn(b, c, p) >= 0.0f &&
+           turn(c, a, p) >= 0.0f;
+}
+
+/* Joins a clockwise hole to the counterclockwise polygon through a cut
+ * from its rightmost point to a polygon corner it can see (Eberly) */
+static void bridge_hole(const point *points, const std::vector<uint32_t> &hole,
+                        std::vector<uint32_t> *poly)
+{
+    uint32_t m_pos = 0;
+    for (uint32_t i = 1; i < hole.size(); i++) {
+        if (points[hole[i]].x > points[hole[m_pos]].x)
+            m_pos = i;
+    }
+    point m = points[hole[m_pos]];
+
+    /* Nearest edge crossed by the ray to +x, going up so that it leaves
+     * the inside */
+    uint32_t n = poly->size();
+    uint32_t edge = n;
+    float nearest = INFINITY;
+    for (uint32_t i = 0; i < n; i++) {
+        point a = points[(*poly)[i]];
+        point b = points[(*poly)[(i + 1) % n]];
+        if (!(a.y <= m.y && m.y <= b.y && a.y < b.y))
+            continue;
+        float x = a.x + (m.y - a.y) * (b.x - a.x) / (b.y - a.y);
+        if (x >= m.x && x < nearest) {
+            nearest = x;
+            edge = i;
+        }
+    }
+    if (edge == n)
+        return;
+
+    uint32_t p_pos = points[(*poly)[edge]].x > points[(*poly)[(edge + 1) % n]].x ?
+                     edge : (edge + 1) % n;
+    point hit = { nearest, m.y };
+    point p = points[(*poly)[p_pos]];
+
+    /* Corners inside the triangle m, hit, p would block the cut, the one
+     * closest in angle to the ray is visible */
+    if (!same_point(hit, p)) {
+        float best_cos = -2.0f;
+        float best_dist = INFINITY;
+        point a = m, b = hit, c = p;
+        if (turn(a, b, c) < 0.0f)
+            std::swap(b, c);
+        for (uint32_t i = 0; i < n; i++) {
+            point q = points[(*poly)[i]];
+            if (same_point(q, p) || !in_triangle(a, b, c, q))
+                continue;
+            float dx = q.x - m.x, dy = q.y - m.y;
+            float dist = sqrtf(dx * dx + dy * dy);
+            float cos = dist > 0.0f ? dx / dist : -2.0f;
+            if (cos > best_cos || (cos == best_cos && dist < best_dist)) {
+                best_cos = cos;
+                best_dist = dist;
+                p_pos = i;
+            }
+        }
+    }
+
+    /* Earlier cuts visit some corners twice, the cut goes out of the copy
+     * whose corner faces m */
+    point target = points[(*poly)[p_pos]];
+    for (uint32_t i = 0; i < n; i++) {
+        if (!same_point(points[(*poly)[i]], target))
+            continue;
+        point prev = points[(*poly)[(i + n - 1) % n]];
+        point next = points[(*poly)[(i + 1) % n]];
+        if (corner_faces(prev, target, next, m)) {
+            p_pos = i;
+            break;
+        }
+    }
+
+    std::vector<uint32_t> cut;
+    for (uint32_t i = 0; i <= hole.size(); i++)
+        cut.push_back(hole[(m_pos + i) % hole.size()]);
+    cut.push_back((*poly)[p_pos]);
+    poly->insert(poly->begin() + p_pos + 1, cut.begin(), cut.end());
+}
+
+int triangulate_polygon(const point *points, const uint32_t *ring_ends,
+                        uint32_t num_rings, std::vector<uint32_t> *triangles)
+{
+    triangles->clear();
+    if (!num_rings || ring_ends[0] < 3 ||
+        ring_area(points, 0, ring_ends[0]) == 0.0f)
+        return -1;
+
+    std::vector<uint32_t> poly, hole;
+    append_ring(points, 0, ring_ends[0], true, &poly);
+
+    /* Rightmost holes first, so that each cut only crosses the outline or
+     * holes already joined */
+    std::vector<uint32_t> holes;
+    for (uint32_t r = 1; r < num_rings; r++) {
+        if (ring_ends[r] - ring_ends[r - 1] >= 3 &&
+            ring_area(points, ring_ends[r - 1], ring_ends[r]) != 0.0f)
+            holes.push_back(r);
+    }
+    std::vector<float> max_x(num_rings, -INFINITY);
+    for (uint32_t r : holes) {
+        for (uint32_t i = ring_ends[r - 1]; i < ring_ends[r]; i++)
+            max_x[r] = fmaxf(max_x[r], points[i].x);
+    }
+    std::stable_sort(holes.begin(), holes.end(), [&](uint32_t a, uint32_t b) {
+        return max_x[a] > max_x[b];
+    });
+    for (uint32_t r : holes) {
+        append_ring(points, ring_ends[r - 1], ring_ends[r], false, &hole);
+        bridge_hole(points, hole, &poly);
+    }
+
+    /* Doubly linked over positions in poly */
+    uint32_t n = poly.size();
+    std::vector<uint32_t> prev(n), next(n);
+    for (uint32_t i = 0; i < n; i++) {
+        prev[i] = (i + n - 1) % n;
+        next[i] = (i + 1) % n;
+    }
+
+    uint32_t remaining = n;
+    uint32_t node = 0;
+    uint32_t misses = 0;
+    while (remaining > 3) {
+        point a = points[poly[prev[node]]];
+        point b = points[poly[node]];
+        point c = points[poly[next[node]]];
+
+        bool ear = turn(a, b, c) > 0.0f;
+        for (uint32_t i = next[next[node]]; ear && i != prev[node]; i = next[i]) {
+            point q = points[poly[i]];
+            ear = same_point(q, a) || same_point(q, b) || same_point(q, c) ||
+                  !in_triangle(a, b, c, q);
+        }
+
+        if (!ear && ++misses < remaining) {
+            node = next[node];
+            continue;
+        }
+
+        /* Without an ear only a corner adding no area may go */
+        if (!ear) {
+            uint32_t i = node;
+            do {
+                if (turn(points[poly[prev[i]]], points[poly[i]],
+                         points[poly[next[i]]]) == 0.0f)
+                    break;
+                i = next[i];
+            } while (i != node);
+            if (turn(points[poly[prev[i]]], points[poly[i]],
+                     points[poly[next[i]]]) != 0.0f)
+                return -1;
+            node = i;
+        } else {
+            triangles->push_back(poly[prev[node]]);
+            triangles->push_back(poly[node]);
+            triangles->push_back(poly[next[node]]);
+        }
+
+        next[prev[node]] = next[node];
+        prev[next[node]] = prev[node];
+        node = prev[node];
+        remaining--;
+        misses = 0;
+    }
+
+    if (turn(points[poly[prev[node]]], points[poly[node]],
+             points[poly[next[node]]]) > 0.0f) {
+        triangles->push_back(poly[prev[node]]);
+        triangles->push_back(poly[node]);
+        triangles->push_back(poly[next[node]]);
+    }
+
+    return 0;
+}
+
+/* A straight corner still counts, going back on itself does not */
+static bool convex_corner(point prev, point p, point next)
+{
+    float t = turn(prev, p, next);
+    float dot = (p.x - prev.x) * (next.x - p.x) + (p.y - prev.y) * (next.y - p.y);
+    return t > 0.0f || (t == 0.0f && dot > 0.0f);
+}
+
+struct edge_ref {
+    uint64_t key;       /* Lower index in the high half */
+    uint32_t tri;
+    uint32_t from;
+};
+
+static uint32_t find_root(std::vector<uint32_t> *parent, uint32_t i)
+{
+    while ((*parent)[i] != i)
+        i = (*parent)[i] = (*parent)[(*parent)[i]];
+    return i;
+}
+
+static uint32_t find_edge(const std::vector<uint32_t> &poly, uint32_t from,
+                          uint32_t to)
+{
+    uint32_t n = poly.size();
+    for (uint32_t i = 0; i < n; i++) {
+        if (poly[i] == from && poly[(i + 1) % n] == to)
+            return i;
+    }
+
+    return n;
+}
+
+void decompose_convex(const point *points, const uint32_t *triangles,
+                      uint32_t num_triangles, std::vector<uint32_t> *pieces,
+                      std::vector<uint32_t> *piece_ends)
+{
+    pieces->clear();
+    piece_ends->clear();
+
+    /* Diagonals are the edges two triangles share, in opposite directions */
+    std::vector<edge_ref> edges;
+    for (uint32_t t = 0; t < num_triangles; t++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t a = triangles[3 * t + k];
+            uint32_t b = triangles[3 * t + (k + 1) % 3];
+            edges.push_back({ (uint64_t)std::min(a, b) << 32 | std::max(a, b),
+                              t, a });
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const edge_ref &x,
+                                             const edge_ref &y) {
+        return x.key != y.key ? x.key < y.key : x.tri < y.tri;
+    });
+
+    std::vector<std::vector<uint32_t>> polys(num_triangles);
+    std::vector<uint32_t> parent(num_triangles);
+    for (uint32_t t = 0; t < num_triangles; t++) {
+        polys[t].assign(&triangles[3 * t], &triangles[3 * t + 3]);
+        parent[t] = t;
+    }
+
+    for (uint32_t e = 0; e + 1 < edges.size(); e++) {
+        const edge_ref *x = &edges[e];
+        const edge_ref *y = &edges[e + 1];
+        if (x->key != y->key || x->from == y->from)
+            continue;
+
+        uint32_t a = x->from;
+        uint32_t b = (uint32_t)(x->key >> 32) == a ? (uint32_t)x->key
+                                                   : (uint32_t)(x->key >> 32);
+        uint32_t p = find_root(&parent, x->tri);
+        uint32_t q = find_root(&parent, y->tri);
+        if (p == q)
+            continue;
+
+        std::vector<uint32_t> &pp = polys[p];
+        std::vector<uint32_t> &qq = polys[q];
+        uint32_t np = pp.size(), nq = qq.size();
+        uint32_t i = find_edge(pp, a, b);
+        uint32_t j = find_edge(qq, b, a);
+        if (i == np || j == nq)
+            continue;
+
+        /* Corners a and b once the diagonal between them is gone */
+        if (!convex_corner(points[pp[(i + np - 1) % np]], points[a],
+                           points[qq[(j + 2) % nq]]) ||
+            !convex_corner(points[qq[(j + nq - 1) % nq]], points[b],
+                           points[pp[(i + 2) % np]]))
+            continue;
+
+        std::vector<uint32_t> merged;
+        for (uint32_t k = 0; k < np; k++)
+            merged.push_back(pp[(i + 1 + k) % np]);
+        for (uint32_t k = 0; k + 2 < nq; k++)
+            merged.push_back(qq[(j + 2 + k) % nq]);
+
+        pp.swap(merged);
+        qq.clear();
+        parent[q] = p;
+    }
+
+    for (uint32_t t = 0; t < num_triangles; t++) {
+        if (parent[t] != t)
+            continue;
+        pieces->insert(pieces->end(), polys[t].begin(), polys[t].end());
+        piece_ends->push_back(pieces->size());
+    }
+}
+
+int build_polygon_mesh(const point *points, const uint32_t *ring_ends,
+                       uint32_t num_rings, polygon_mesh *mesh)
+{
+    int ret = triangulate_polygon(points, ring_ends, num_rings,
+                                  &mesh->triangles);
+    decompose_convex(points, mesh->triangles.data(),
+                     mesh->triangles.size() / 3, &mesh->pieces,
+                     &mesh->piece_ends);
+    return ret;
+}
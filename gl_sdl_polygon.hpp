@@ -0,0 +1,35 @@
+#ifndef GL_SDL_POLYGON_H
+#define GL_SDL_POLYGON_H
+
+#include "gl_sdl_geometry.hpp"
+#include <stdint.h>
+#include <vector>
+
+/* Polygons come as rings of points, one after another: the outline first,
+ * then the holes. ring_ends[i] is one past the last point of ring i. Any
+ * winding, rings must not cross each other or themselves. */
+
+/* Triangles and convex pieces of a polygon, as indices into its points.
+ * Both are counterclockwise. */
+struct polygon_mesh {
+    std::vector<uint32_t> triangles;    /* Three per triangle */
+    std::vector<uint32_t> pieces;
+    std::vector<uint32_t> piece_ends;   /* One past the last index of each */
+};
+
+/* Ear clipping, with the holes bridged into the outline beforehand. Fails
+ * on an outline of fewer than three points or without area, and when no
+ * ear is left, with self crossing rings, triangles then holds what was
+ * clipped so far. Holes of that kind are left out. */
+int triangulate_polygon(const point *points, const uint32_t *ring_ends,
+                        uint32_t num_rings, std::vector<uint32_t> *triangles);
+/* Hertel-Mehlhorn: triangles are merged across their diagonals as long as
+ * the pieces stay convex, at most four times the fewest pieces possible */
+void decompose_convex(const point *points, const uint32_t *triangles,
+                      uint32_t num_triangles, std::vector<uint32_t> *pieces,
+                      std::vector<uint32_t> *piece_ends);
+/* Both of the above */
+int build_polygon_mesh(const point *points, const uint32_t *ring_ends,
+                       uint32_t num_rings, polygon_mesh *mesh);
+
+#endif
@@ -0,0 +1,81 @@
+#include "gl_sdl_render_queue.hpp"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+static uint64_t field(uint32_t value, uint32_t bits)
+{
+    return value & ((1ull << bits) - 1);
+}
+
+sort_key make_sort_key(uint32_t layer, uint32_t depth, uint32_t program,
+                       uint32_t primitive, uint32_t material)
+{
+    sort_key key = field(layer, SORT_LAYER_BITS);
+    key = key << SORT_DEPTH_BITS | field(depth, SORT_DEPTH_BITS);
+    key = key << SORT_PROGRAM_BITS | field(program, SORT_PROGRAM_BITS);
+    key = key << SORT_PRIMITIVE_BITS | field(primitive, SORT_PRIMITIVE_BITS);
+    key = key << SORT_MATERIAL_BITS | field(material, SORT_MATERIAL_BITS);
+    return key;
+}
+
+void render_queue_clear(render_queue *queue)
+{
+    queue->keys.clear();
+    queue->items.clear();
+}
+
+void render_queue_submit(render_queue *queue, sort_key key, uint32_t item)
+{
+    queue->keys.push_back(key);
+    queue->items.push_back(item);
+}
+
+/* LSD radix sort, one byte per pass. All histograms are built in a single
+ * read, passes where every key has the same byte are skipped. */
+void render_queue_sort(render_queue *queue)
+{
+    size_t count = queue->keys.size();
+    if (count < 2)
+        return;
+
+    uint32_t hist[RADIX_PASSES][RADIX_BUCKETS];
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        for (uint32_t i = 0; i < RADIX_BUCKETS; i++)
+            hist[pass][i] = 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        sort_key key = queue->keys[i];
+        for (uint32_t pass = 0; pass < RADIX_PASSES; pass++)
+            hist[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    queue->tmp_keys.resize(count);
+    queue->tmp_items.resize(count);
+
+    for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+        uint32_t shift = pass * RADIX_BITS;
+        uint32_t *h = hist[pass];
+        if (h[(queue->keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < RADIX_BUCKETS; i++) {
+            uint32_t bucket_size = h[i];
+            h[i] = offset;
+            offset += bucket_size;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            sort_key key = queue->keys[i];
+            uint32_t dst = h[(key >> shift) & (RADIX_BUCKETS - 1)]++;
+            queue->tmp_keys[dst] = key;
+            queue->tmp_items[dst] = queue->items[i];
+        }
+
+        queue->keys.swap(queue->tmp_keys);
+        queue->items.swap(queue->tmp_items);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef GL_SDL_RENDER_QUEUE_H
+#define GL_SDL_RENDER_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Sort key fields, most significant first. Layers keep their order, within
+ * a layer the depth does, the remaining fields only group submissions so
+ * that state changes between neighbours are rare. */
+#define SORT_LAYER_BITS 8
+#define SORT_DEPTH_BITS 24
+#define SORT_PROGRAM_BITS 8
+#define SORT_PRIMITIVE_BITS 8
+#define SORT_MATERIAL_BITS 16
+
+#define SORT_MAX_LAYER ((1u << SORT_LAYER_BITS) - 1)
+#define SORT_MAX_DEPTH ((1u << SORT_DEPTH_BITS) - 1)
+
+typedef uint64_t sort_key;
+
+sort_key make_sort_key(uint32_t layer, uint32_t depth, uint32_t program,
+                       uint32_t primitive, uint32_t material);
+
+/* Items are opaque to the queue, usually indices into the caller's data */
+struct render_queue {
+    std::vector<sort_key> keys;
+    std::vector<uint32_t> items;
+    std::vector<sort_key> tmp_keys;
+    std::vector<uint32_t> tmp_items;
+};
+
+void render_queue_clear(render_queue *queue);
+void render_queue_submit(render_queue *queue, sort_key key, uint32_t item);
+/* Stable, submissions with equal keys keep their order */
+void render_queue_sort(render_queue *queue);
+
+#endif
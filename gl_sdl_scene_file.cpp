@@ -0,0 +1,457 @@
+#include "gl_sdl_scene_file.hpp"
+#include <string.h>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char scene_magic[8] = { 'G', 'L', 'S', 'D', 'L', 'S', 'C', 'N' };
+
+#define SCENE_ALIGN 16
+#define CHECKSUM_PRIME_1 0x9e3779b185ebca87ull
+#define CHECKSUM_PRIME_2 0xc2b2ae3d27d4eb4full
+#define CHECKSUM_PRIME_3 0x165667b19e3779f9ull
+
+static const uint32_t column_strides[NUM_SCENE_COLUMNS] = {
+    sizeof(point), sizeof(vect), sizeof(point), sizeof(vect), sizeof(vect),
+    sizeof(color), sizeof(uint8_t), sizeof(uint32_t), sizeof(uint32_t),
+    sizeof(shape_instance)
+};
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+    return x << r | x >> (64 - r);
+}
+
+static uint64_t checksum_round(uint64_t lane, uint64_t word)
+{
+    return rotl64(lane + word * CHECKSUM_PRIME_2, 31) * CHECKSUM_PRIME_1;
+}
+
+/* Four independent lanes over 32 byte blocks */
+static void checksum_blocks(uint64_t *lanes, const uint8_t *data,
+                            size_t num_blocks)
+{
+    uint64_t l0 = lanes[0], l1 = lanes[1], l2 = lanes[2], l3 = lanes[3];
+    for (size_t i = 0; i < num_blocks; i++, data += 32) {
+        uint64_t w[4];
+        memcpy(w, data, sizeof(w));
+        l0 = checksum_round(l0, w[0]);
+        l1 = checksum_round(l1, w[1]);
+        l2 = checksum_round(l2, w[2]);
+        l3 = checksum_round(l3, w[3]);
+    }
+    lanes[0] = l0;
+    lanes[1] = l1;
+    lanes[2] = l2;
+    lanes[3] = l3;
+}
+
+void scene_checksum_init(scene_checksum *sum)
+{
+    sum->lanes[0] = CHECKSUM_PRIME_1 + CHECKSUM_PRIME_2;
+    sum->lanes[1] = CHECKSUM_PRIME_2;
+    sum->lanes[2] = 0;
+    sum->lanes[3] = 0 - CHECKSUM_PRIME_1;
+    sum->num_pending = 0;
+    sum->size = 0;
+}
+
+void scene_checksum_add(scene_checksum *sum, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    sum->size += size;
+    if (sum->num_pending) {
+        size_t n = std::min(size, (size_t)(32 - sum->num_pending));
+        memcpy(sum->pending + sum->num_pending, bytes, n);
+        sum->num_pending += n;
+        bytes += n;
+        size -= n;
+        if (sum->num_pending < 32)
+            return;
+        checksum_blocks(sum->lanes, sum->pending, 1);
+        sum->num_pending = 0;
+    }
+
+    checksum_blocks(sum->lanes, bytes, size / 32);
+    bytes += size / 32 * 32;
+    sum->num_pending = size % 32;
+    memcpy(sum->pending, bytes, sum->num_pending);
+}
+
+uint64_t scene_checksum_final(const scene_checksum *sum)
+{
+    uint64_t h = rotl64(sum->lanes[0], 1) + rotl64(sum->lanes[1], 7) +
+                 rotl64(sum->lanes[2], 12) + rotl64(sum->lanes[3], 18);
+    h ^= sum->size;
+    for (uint32_t i = 0; i < sum->num_pending; i++)
+        h = rotl64(h ^ (sum->pending[i] * CHECKSUM_PRIME_3), 11) *
+            CHECKSUM_PRIME_1;
+
+    h ^= h >> 33;
+    h *= CHECKSUM_PRIME_2;
+    h ^= h >> 29;
+    h *= CHECKSUM_PRIME_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void write_bytes(scene_writer *writer, const void *data, size_t size)
+{
+    if (writer->failed)
+        return;
+    if (fwrite(data, 1, size, writer->out) != size) {
+        writer->failed = true;
+        return;
+    }
+    scene_checksum_add(&writer->sum, data, size);
+    writer->size += size;
+}
+
+int scene_writer_open(scene_writer *writer, const char *path)
+{
+    *writer = scene_writer();
+    writer->out = fopen(path, "wb");
+    if (!writer->out)
+        return -1;
+
+    /* Filled in by scene_writer_close */
+    scene_file_header header = {};
+    if (fwrite(&header, sizeof(header), 1, writer->out) != 1)
+        writer->failed = true;
+    writer->size = sizeof(header);
+    scene_checksum_init(&writer->sum);
+    return 0;
+}
+
+int scene_writer_begin_section(scene_writer *writer, scene_column column,
+                               instance_mesh mesh, uint32_t count)
+{
+    if (!writer->out || writer->stride || column >= NUM_SCENE_COLUMNS ||
+        mesh >= NUM_INSTANCE_MESHES ||
+        count > UINT32_MAX / column_strides[column]) {
+        writer->failed = true;
+        return -1;
+    }
+
+    writer->stride = column_strides[column];
+    writer->remaining = count;
+    writer->bytes = count * writer->stride;
+    scene_section section = { (uint32_t)column, (uint32_t)mesh, count,
+                              writer->bytes };
+    write_bytes(writer, &section, sizeof(section));
+    return writer->failed ? -1 : 0;
+}
+
+int scene_writer_write(scene_writer *writer, const void *entries,
+                       uint32_t count)
+{
+    if (!writer->stride || count > writer->remaining) {
+        writer->failed = true;
+        return -1;
+    }
+
+    writer->remaining -= count;
+    write_bytes(writer, entries, (size_t)count * writer->stride);
+    return writer->failed ? -1 : 0;
+}
+
+int scene_writer_end_section(scene_writer *writer)
+{
+    if (!writer->stride || writer->remaining) {
+        writer->failed = true;
+        return -1;
+    }
+
+    static const uint8_t zeros[SCENE_ALIGN] = {};
+    write_bytes(writer, zeros, (SCENE_ALIGN - writer->bytes % SCENE_ALIGN) %
+                               SCENE_ALIGN);
+    writer->stride = 0;
+    writer->num_sections++;
+    return writer->failed ? -1 : 0;
+}
+
+int scene_writer_close(scene_writer *writer)
+{
+    if (!writer->out)
+        return -1;
+    if (writer->stride)
+        writer->failed = true;
+
+    scene_file_header header;
+    memcpy(header.magic, scene_magic, sizeof(scene_magic));
+    header.version = SCENE_FILE_VERSION;
+    header.byte_order = SCENE_BYTE_ORDER;
+    header.num_sections = writer->num_sections;
+    header.size = writer->size;
+    header.checksum = scene_checksum_final(&writer->sum);
+    if (!writer->failed && (fseek(writer->out, 0, SEEK_SET) ||
+        fwrite(&header, sizeof(header), 1, writer->out) != 1))
+        writer->failed = true;
+
+    if (fclose(writer->out))
+        writer->failed = true;
+    writer->out = NULL;
+    return writer->failed ? -1 : 0;
+}
+
+/* Instances go out in pieces of this many */
+#define SAVE_CHUNK 256
+
+static void save_instances(scene_writer *writer, const shape_store_columns *c,
+                           instance_mesh mesh)
+{
+    uint32_t count = c->slots.size();
+    shape_instance chunk[SAVE_CHUNK];
+    scene_writer_begin_section(writer, SCENE_INSTANCES, mesh, count);
+    for (uint32_t first = 0; first < count; first += SAVE_CHUNK) {
+        uint32_t n = std::min(count - first, (uint32_t)SAVE_CHUNK);
+        for (uint32_t k = 0; k < n; k++) {
+            uint32_t i = first + k;
+            uint8_t flags = c->flags[i];
+            color col = c->colors[i];
+            chunk[k] = {
+                { c->anchors[i].x, c->anchors[i].y },
+                { c->axes_x[i].x, c->axes_x[i].y },
+                { c->axes_y[i].x, c->axes_y[i].y },
+                { c->offsets[i].x, c->offsets[i].y },
+                { c->rotations[i].x, c->rotations[i].y },
+                { col.r, col.g, col.b, col.a },
+                (Uint32)(flags & SHAPE_STORE_ENABLED ?
+                         flags & (SHAPE_STORE_FILL | SHAPE_STORE_BORDER) : 0)
+            };
+        }
+        scene_writer_write(writer, chunk, n);
+    }
+    scene_writer_end_section(writer);
+}
+
+static void save_column(scene_writer *writer, scene_column column,
+                        instance_mesh mesh, const void *entries,
+                        uint32_t count)
+{
+    scene_writer_begin_section(writer, column, mesh, count);
+    scene_writer_write(writer, entries, count);
+    scene_writer_end_section(writer);
+}
+
+int save_scene_file(const char *path, const shape_store *store)
+{
+    scene_writer writer;
+    if (scene_writer_open(&writer, path))
+        return -1;
+
+    for (uint32_t m = 0; m < NUM_INSTANCE_MESHES; m++) {
+        const shape_store_columns *c = &store->columns[m];
+        instance_mesh mesh = (instance_mesh)m;
+        uint32_t count = c->slots.size();
+        save_column(&writer, SCENE_OFFSETS, mesh, c->offsets.data(), count);
+        save_column(&writer, SCENE_ROTATIONS, mesh, c->rotations.data(),
+                    count);
+        save_column(&writer, SCENE_ANCHORS, mesh, c->anchors.data(), count);
+        save_column(&writer, SCENE_AXES_X, mesh, c->axes_x.data(), count);
+        save_column(&writer, SCENE_AXES_Y, mesh, c->axes_y.data(), count);
+        save_column(&writer, SCENE_COLORS, mesh, c->colors.data(), count);
+        save_column(&writer, SCENE_FLAGS, mesh, c->flags.data(), count);
+        save_column(&writer, SCENE_LAYERS, mesh, c->layers.data(), count);
+        save_column(&writer, SCENE_SERIALS, mesh, c->serials.data(), count);
+        save_instances(&writer, c, mesh);
+    }
+
+    return scene_writer_close(&writer);
+}
+
+static int map_file(scene_file *file, const char *path)
+{
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (!fstat(fd, &st) && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+
+    file->data = (const uint8_t *)data;
+    file->size = st.st_size;
+    file->mapped = true;
+    return 0;
+#else
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return -1;
+
+    bool ok = !fseek(in, 0, SEEK_END);
+    long size = ok ? ftell(in) : -1;
+    ok = size > 0 && !fseek(in, 0, SEEK_SET);
+    if (ok) {
+        file->copy.resize(size);
+        ok = fread(file->copy.data(), 1, size, in) == (size_t)size;
+    }
+    fclose(in);
+    if (!ok)
+        return -1;
+
+    file->data = file->copy.data();
+    file->size = size;
+    return 0;
+#endif
+}
+
+/* Sections in bounds, one of each column per mesh at most, columns of a
+ * mesh agreeing on the count and all but the optional ones there. Serials
+ * only order shapes across meshes when every mesh has them. */
+static int index_sections(scene_file *file, const scene_file_header *header)
+{
+    bool seen[NUM_INSTANCE_MESHES][NUM_SCENE_COLUMNS] = {};
+    size_t at = sizeof(scene_file_header);
+    for (uint32_t s = 0; s < header->num_sections; s++) {
+        scene_section section;
+        if (file->size - at < sizeof(section))
+            return -1;
+        memcpy(&section, file->data + at, sizeof(section));
+        at += sizeof(section);
+
+        uint32_t mesh = section.mesh, column = section.column;
+        if (mesh >= NUM_INSTANCE_MESHES || column >= NUM_SCENE_COLUMNS ||
+            seen[mesh][column] ||
+            section.bytes != (uint64_t)section.count * column_strides[column])
+            return -1;
+        size_t padded = (section.bytes + SCENE_ALIGN - 1) / SCENE_ALIGN *
+                        SCENE_ALIGN;
+        if (file->size - at < padded)
+            return -1;
+
+        bool first = true;
+        for (uint32_t c = 0; c < NUM_SCENE_COLUMNS; c++)
+            first = first && !seen[mesh][c];
+        if (!first && section.count != file->counts[mesh])
+            return -1;
+
+        seen[mesh][column] = true;
+        file->counts[mesh] = section.count;
+        file->columns[mesh][column] = file->data + at;
+        at += padded;
+    }
+
+    uint32_t num_meshes = 0, num_serials = 0;
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        for (uint32_t c = 0; c <= SCENE_FLAGS && file->counts[mesh]; c++) {
+            if (!seen[mesh][c])
+                return -1;
+        }
+        num_meshes += file->counts[mesh] != 0;
+        num_serials += file->counts[mesh] && seen[mesh][SCENE_SERIALS];
+    }
+    if (num_serials && num_serials != num_meshes)
+        return -1;
+    return at == file->size ? 0 : -1;
+}
+
+int open_scene_file(scene_file *file, const char *path, bool verify)
+{
+    close_scene_file(file);
+    if (map_file(file, path))
+        return -1;
+
+    scene_file_header header;
+    bool ok = file->size >= sizeof(header);
+    if (ok) {
+        memcpy(&header, file->data, sizeof(header));
+        ok = !memcmp(header.magic, scene_magic, sizeof(scene_magic)) &&
+             header.byte_order == SCENE_BYTE_ORDER &&
+             header.version == SCENE_FILE_VERSION &&
+             header.size == file->size;
+    }
+    if (ok && verify) {
+        scene_checksum sum;
+        scene_checksum_init(&sum);
+        scene_checksum_add(&sum, file->data + sizeof(header),
+                           file->size - sizeof(header));
+        ok = scene_checksum_final(&sum) == header.checksum;
+    }
+    if (!ok || index_sections(file, &header)) {
+        close_scene_file(file);
+        return -1;
+    }
+
+    return 0;
+}
+
+void close_scene_file(scene_file *file)
+{
+#ifndef _WIN32
+    if (file->mapped)
+        munmap((void *)file->data, file->size);
+#endif
+    *file = scene_file();
+}
+
+const shape_instance *scene_file_instances(const scene_file *file,
+                                           instance_mesh mesh,
+                                           uint32_t *count)
+{
+    if (mesh >= NUM_INSTANCE_MESHES || !file->counts[mesh] ||
+        !file->columns[mesh][SCENE_INSTANCES]) {
+        *count = 0;
+        return NULL;
+    }
+
+    *count = file->counts[mesh];
+    return (const shape_instance *)file->columns[mesh][SCENE_INSTANCES];
+}
+
+/* Serials of the file keep the order across meshes, after every shape the
+ * store had. Serials that would not fit fail before anything is added. */
+int load_scene_file(const scene_file *file, shape_store *store)
+{
+    uint32_t base = store->next_serial;
+    uint64_t total = 0, next = base;
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const uint32_t *serials =
+            (const uint32_t *)file->columns[mesh][SCENE_SERIALS];
+        uint32_t count = file->counts[mesh];
+        total += count;
+        for (uint32_t i = 0; serials && i < count; i++)
+            next = std::max(next, (uint64_t)base + serials[i] + 1);
+    }
+    if (std::max(next, base + total) > UINT32_MAX)
+        return -1;
+
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const void *const *columns = file->columns[mesh];
+        uint32_t count = file->counts[mesh];
+        shape_store_columns *c = &store->columns[mesh];
+        uint32_t first = c->slots.size();
+        if (!count)
+            continue;
+        shape_store_arrays arrays = {
+            (const point *)columns[SCENE_OFFSETS],
+            (const vect *)columns[SCENE_ROTATIONS],
+            (const point *)columns[SCENE_ANCHORS],
+            (const vect *)columns[SCENE_AXES_X],
+            (const vect *)columns[SCENE_AXES_Y],
+            (const color *)columns[SCENE_COLORS],
+            (const uint8_t *)columns[SCENE_FLAGS],
+            (const uint32_t *)columns[SCENE_LAYERS]
+        };
+        if (shape_store_add_arrays(store, (instance_mesh)mesh, &arrays,
+                                   count))
+            return -1;
+
+        const uint32_t *serials = (const uint32_t *)columns[SCENE_SERIALS];
+        for (uint32_t i = 0; serials && i < count; i++)
+            c->serials[first + i] = base + serials[i];
+    }
+
+    /* Without serials the store numbered the shapes itself */
+    store->next_serial = std::max(next, (uint64_t)store->next_serial);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef GL_SDL_SCENE_FILE_H
+#define GL_SDL_SCENE_FILE_H
+
+#include "gl_sdl_shape_store.hpp"
+#include "gl_sdl_shape_obj.hpp"
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+/* Binary scenes: a header, then sections each holding one column of one
+ * instance mesh. Column payloads are the arrays as they sit in memory,
+ * native byte order, 16 byte aligned. The store columns load with one copy
+ * each, the instances of a mapped file can be drawn in place. Files of the
+ * other byte order are rejected. The checksum covers everything after the
+ * header. */
+
+#define SCENE_FILE_VERSION 3
+#define SCENE_BYTE_ORDER 0x0102     /* Reads 0x0201 with the other order */
+
+/* Those of shape_store_columns, and the same shapes as instances */
+enum scene_column {
+    SCENE_OFFSETS,      /* point */
+    SCENE_ROTATIONS,    /* vect, cosine and sine */
+    SCENE_ANCHORS,      /* point */
+    SCENE_AXES_X,       /* vect */
+    SCENE_AXES_Y,       /* vect */
+    SCENE_COLORS,       /* color */
+    SCENE_FLAGS,        /* uint8_t, SHAPE_STORE flags */
+    SCENE_LAYERS,       /* uint32_t, optional */
+    SCENE_SERIALS,      /* uint32_t, order of adding across meshes, optional */
+    SCENE_INSTANCES,    /* shape_instance, disabled shapes without flags,
+                         * optional */
+    NUM_SCENE_COLUMNS
+};
+
+struct scene_file_header {
+    char magic[8];
+    uint16_t version;
+    uint16_t byte_order;    /* SCENE_BYTE_ORDER as the writer stored it */
+    uint32_t num_sections;
+    uint64_t size;          /* Of the whole file */
+    uint64_t checksum;
+};
+
+struct scene_section {
+    uint32_t column;
+    uint32_t mesh;
+    uint32_t count;         /* Entries */
+    uint32_t bytes;         /* Payload, padding to 16 bytes follows */
+};
+
+/* Running checksum, the same whatever the sizes of the pieces fed */
+struct scene_checksum {
+    uint64_t lanes[4];
+    uint8_t pending[32];
+    uint32_t num_pending;
+    uint64_t size;
+};
+
+void scene_checksum_init(scene_checksum *sum);
+void scene_checksum_add(scene_checksum *sum, const void *data, size_t size);
+uint64_t scene_checksum_final(const scene_checksum *sum);
+
+/* Writes sections as they come, the header last. Any failed write makes
+ * scene_writer_close fail. */
+struct scene_writer {
+    FILE *out = NULL;
+    bool failed = false;
+    uint32_t num_sections = 0;
+    uint64_t size = 0;
+    scene_checksum sum;
+    uint32_t remaining = 0;     /* Entries the open section still needs */
+    uint32_t stride = 0;
+    uint32_t bytes = 0;
+};
+
+int scene_writer_open(scene_writer *writer, const char *path);
+int scene_writer_begin_section(scene_writer *writer, scene_column column,
+                               instance_mesh mesh, uint32_t count);
+/* Entries of the open section, in as many pieces as wanted */
+int scene_writer_write(scene_writer *writer, const void *entries,
+                       uint32_t count);
+int scene_writer_end_section(scene_writer *writer);
+int scene_writer_close(scene_writer *writer);
+
+/* A scene mapped read only, columns point into the mapping */
+struct scene_file {
+    const uint8_t *data = NULL;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<uint8_t> copy;      /* Without mmap */
+    const void *columns[NUM_INSTANCE_MESHES][NUM_SCENE_COLUMNS] = {};
+    uint32_t counts[NUM_INSTANCE_MESHES] = {};
+};
+
+/* Checks the layout, and the checksum when verify is set */
+int open_scene_file(scene_file *file, const char *path, bool verify);
+void close_scene_file(scene_file *file);
+
+/* Instances of a mesh as draw_instances takes them, NULL when there are
+ * none or the file has no instance section. Valid until the file is
+ * closed. */
+const shape_instance *scene_file_instances(const scene_file *file,
+                                           instance_mesh mesh,
+                                           uint32_t *count);
+/* Adds every shape to the store, one bulk copy per column */
+int load_scene_file(const scene_file *file, shape_store *store);
+
+/* Writes the store columns and the instances */
+int save_scene_file(const char *path, const shape_store *store);
+
+/* Shapes without an instance mesh are left out */
+template<typename S>
+int save_scene_file(const char *path, shape_manager_state<S> *state)
+{
+    shape_store store;
+    for (uint i = 0; i < state->num_shapes; i++)
+        shape_store_add_shape(&store, &*state->shapes[i]);
+    return save_scene_file(path, &store);
+}
+
+#endif
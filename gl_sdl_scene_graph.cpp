@@ -0,0 +1,204 @@
+#include "gl_sdl_scene_graph.hpp"
+#include <algorithm>
+#include <cmath>
+
+void scene_graph_clear(scene_graph *graph)
+{
+    *graph = scene_graph();
+}
+
+uint32_t scene_graph_size(const scene_graph *graph)
+{
+    return graph->parents.size();
+}
+
+static bool valid_node(const scene_graph *graph, uint32_t node)
+{
+    return node < graph->parents.size();
+}
+
+uint32_t scene_graph_add(scene_graph *graph, uint32_t parent, uint32_t user,
+                         const scene_transform *local)
+{
+    if (parent != SCENE_GRAPH_NULL && !valid_node(graph, parent))
+        return SCENE_GRAPH_NULL;
+
+    uint32_t node = graph->parents.size();
+    graph->parents.push_back(parent);
+    graph->users.push_back(user);
+    graph->locals.push_back(*local);
+    graph->local_revisions.push_back(1);
+    graph->world.push_back(affine_identity());
+    graph->world_revisions.push_back(0);
+    graph->seen_locals.push_back(0);
+    graph->seen_parents.push_back(0);
+    /* The parent came first */
+    graph->order.push_back(node);
+    return node;
+}
+
+int scene_graph_set_parent(scene_graph *graph, uint32_t node,
+                           uint32_t parent)
+{
+    if (!valid_node(graph, node) ||
+        (parent != SCENE_GRAPH_NULL && !valid_node(graph, parent)))
+        return -1;
+    for (uint32_t up = parent; up != SCENE_GRAPH_NULL; up = graph->parents[up]) {
+        if (up == node)
+            return -1;
+    }
+
+    graph->parents[node] = parent;
+    graph->local_revisions[node]++;
+    graph->order_stale = true;
+    return 0;
+}
+
+static int changed(scene_graph *graph, uint32_t node)
+{
+    graph->local_revisions[node]++;
+    return 0;
+}
+
+int scene_graph_set_local(scene_graph *graph, uint32_t node,
+                          const scene_transform *local)
+{
+    if (!valid_node(graph, node))
+        return -1;
+    graph->locals[node] = *local;
+    return changed(graph, node);
+}
+
+int scene_graph_move(scene_graph *graph, uint32_t node, vect v)
+{
+    if (!valid_node(graph, node))
+        return -1;
+    graph->locals[node].translate.x += v.x;
+    graph->locals[node].translate.y += v.y;
+    return changed(graph, node);
+}
+
+int scene_graph_rotate(scene_graph *graph, uint32_t node, float angle)
+{
+    if (!valid_node(graph, node))
+        return -1;
+    graph->locals[node].rotate += angle;
+    return changed(graph, node);
+}
+
+int scene_graph_scale(scene_graph *graph, uint32_t node, float factor)
+{
+    if (!valid_node(graph, node))
+        return -1;
+    graph->locals[node].scale *= factor;
+    return changed(graph, node);
+}
+
+static affine_2d local_affine(const scene_transform *t)
+{
+    float c = t->scale * cosf(t->rotate);
+    float s = t->scale * sinf(t->rotate);
+    return { { c, s, -s, c, t->translate.x, t->translate.y } };
+}
+
+/* Recomputes the node when it is out of date, its parent being current */
+static void refresh_node(scene_graph *graph, uint32_t node)
+{
+    uint32_t parent = graph->parents[node];
+    uint32_t parent_revision = parent == SCENE_GRAPH_NULL ? 0 :
+                               graph->world_revisions[parent];
+    if (graph->seen_locals[node] == graph->local_revisions[node] &&
+        graph->seen_parents[node] == parent_revision)
+        return;
+
+    affine_2d local = local_affine(&graph->locals[node]);
+    graph->world[node] = parent == SCENE_GRAPH_NULL ? local :
+                         affine_mul(&graph->world[parent], &local);
+    graph->world_revisions[node]++;
+    graph->seen_locals[node] = graph->local_revisions[node];
+    graph->seen_parents[node] = parent_revision;
+}
+
+const affine_2d *scene_graph_world(scene_graph *graph, uint32_t node)
+{
+    if (!valid_node(graph, node))
+        return NULL;
+
+    std::vector<uint32_t> *path = &graph->path;
+    path->clear();
+    for (uint32_t up = node; up != SCENE_GRAPH_NULL; up = graph->parents[up])
+        path->push_back(up);
+    for (size_t i = path->size(); i-- > 0;)
+        refresh_node(graph, (*path)[i]);
+
+    return &graph->world[node];
+}
+
+/* Shallower nodes first, only needed after reparenting */
+static void sort_nodes(scene_graph *graph)
+{
+    uint32_t num_nodes = graph->parents.size();
+    std::vector<uint32_t> depths(num_nodes, SCENE_GRAPH_NULL);
+    std::vector<uint32_t> *path = &graph->path;
+    for (uint32_t node = 0; node < num_nodes; node++) {
+        path->clear();
+        uint32_t up = node;
+        while (up != SCENE_GRAPH_NULL && depths[up] == SCENE_GRAPH_NULL) {
+            path->push_back(up);
+            up = graph->parents[up];
+        }
+        uint32_t depth = up == SCENE_GRAPH_NULL ? 0 : depths[up] + 1;
+        for (size_t i = path->size(); i-- > 0; depth++)
+            depths[(*path)[i]] = depth;
+    }
+
+    std::stable_sort(graph->order.begin(), graph->order.end(),
+                     [&](uint32_t a, uint32_t b) {
+        return depths[a] < depths[b];
+    });
+    graph->order_stale = false;
+}
+
+void scene_graph_update(scene_graph *graph)
+{
+    if (graph->order_stale)
+        sort_nodes(graph);
+    for (uint32_t node : graph->order)
+        refresh_node(graph, node);
+}
+
+void scene_transform_instance(const affine_2d *world, shape_instance *inst)
+{
+    /* Mesh point m lands at R(rot) * (pos + m.x * axis_x + m.y * axis_y) +
+     * offset, the world transform goes on top and the rotation into the
+     * axes */
+    float c = inst->rot[0], s = inst->rot[1];
+    affine_2d local = { { c, s, -s, c, inst->offset[0], inst->offset[1] } };
+    affine_2d shape_to_world = affine_mul(world, &local);
+
+    point pos = affine_apply(&shape_to_world, { inst->pos[0], inst->pos[1] });
+    vect ax = affine_apply_vect(&shape_to_world,
+                                { inst->axis_x[0], inst->axis_x[1] });
+    vect ay = affine_apply_vect(&shape_to_world,
+                                { inst->axis_y[0], inst->axis_y[1] });
+    inst->pos[0] = pos.x;
+    inst->pos[1] = pos.y;
+    inst->axis_x[0] = ax.x;
+    inst->axis_x[1] = ax.y;
+    inst->axis_y[0] = ay.x;
+    inst->axis_y[1] = ay.y;
+    inst->offset[0] = inst->offset[1] = 0.0f;
+    inst->rot[0] = 1.0f;
+    inst->rot[1] = 0.0f;
+}
+
+aabb scene_transform_aabb(const affine_2d *world, const aabb *box)
+{
+    point corners[4] = {
+        box->min, { box->max.x, box->min.y }, box->max,
+        { box->min.x, box->max.y }
+    };
+    for (point &p : corners)
+        p = affine_apply(world, p);
+    return bounding_box(corners, 4);
+}
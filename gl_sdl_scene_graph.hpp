@@ -0,0 +1,139 @@
+#ifndef GL_SDL_SCENE_GRAPH_H
+#define GL_SDL_SCENE_GRAPH_H
+
+#include "gl_sdl_shape_obj.hpp"
+#include <stdint.h>
+#include <vector>
+
+#define SCENE_GRAPH_NULL 0xffffffffu
+
+/* Scale, then rotate, then translate */
+struct scene_transform {
+    vect translate;
+    float rotate;
+    float scale;
+};
+
+static const scene_transform scene_transform_identity = {
+    { 0.0f, 0.0f }, 0.0f, 1.0f
+};
+
+/* Transform hierarchy, node i being entry i of every column. Changing a
+ * transform only bumps the node's revision, world matrices are recomputed
+ * when read: a node is out of date when its own revision or its parent's
+ * world moved on since its world was computed. Nodes may carry a user
+ * value, the index of a shape whose own transform then counts as local to
+ * the node. */
+struct scene_graph {
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> users;
+    std::vector<scene_transform> locals;
+    std::vector<uint32_t> local_revisions;
+    /* Contiguous, current for every node after scene_graph_update */
+    std::vector<affine_2d> world;
+    std::vector<uint32_t> world_revisions;  /* Bumped by each recompute */
+    std::vector<uint32_t> seen_locals;      /* What world was computed from */
+    std::vector<uint32_t> seen_parents;
+    std::vector<uint32_t> order;    /* Parents before children */
+    bool order_stale = false;
+    std::vector<uint32_t> path;     /* Scratch of scene_graph_world */
+    std::vector<shape_instance> instances[NUM_INSTANCE_MESHES];
+};
+
+void scene_graph_clear(scene_graph *graph);
+uint32_t scene_graph_size(const scene_graph *graph);
+
+/* parent SCENE_GRAPH_NULL for a root, user SCENE_GRAPH_NULL for a group.
+ * Returns the node. */
+uint32_t scene_graph_add(scene_graph *graph, uint32_t parent, uint32_t user,
+                         const scene_transform *local);
+/* Fails when the parent is the node or one of its descendants */
+int scene_graph_set_parent(scene_graph *graph, uint32_t node,
+                           uint32_t parent);
+
+/* Constant time whatever lies below the node */
+int scene_graph_set_local(scene_graph *graph, uint32_t node,
+                          const scene_transform *local);
+int scene_graph_move(scene_graph *graph, uint32_t node, vect v);
+int scene_graph_rotate(scene_graph *graph, uint32_t node, float angle);
+int scene_graph_scale(scene_graph *graph, uint32_t node, float factor);
+
+/* Brings the node and its ancestors up to date, nothing else. NULL for
+ * nodes out of range. */
+const affine_2d *scene_graph_world(scene_graph *graph, uint32_t node);
+/* One pass over all nodes, only out of date subtrees get recomputed */
+void scene_graph_update(scene_graph *graph);
+
+/* Instance of a shape of the node taken to world space */
+void scene_transform_instance(const affine_2d *world, shape_instance *inst);
+/* Box around the world corners of a local box */
+aabb scene_transform_aabb(const affine_2d *world, const aabb *box);
+
+/* World box of the shape of a node, for the collision code */
+template<typename S>
+aabb scene_graph_shape_aabb(scene_graph *graph,
+                            shape_manager_state<S> *state, uint32_t node)
+{
+    aabb box = state->shapes[graph->users[node]]->get_aabb();
+    return scene_transform_aabb(scene_graph_world(graph, node), &box);
+}
+
+/* One instanced draw per mesh of the shapes of all nodes, so meshes go in
+ * enum order and nodes in index order within a mesh. Shapes without an
+ * instance mesh are left out. */
+template<typename S>
+void draw_scene_graph(scene_graph *graph, shape_manager_state<S> *state)
+{
+    scene_graph_update(graph);
+    for (auto &instances : graph->instances)
+        instances.clear();
+
+    for (uint32_t node = 0; node < graph->users.size(); node++) {
+        uint32_t user = graph->users[node];
+        if (user >= state->num_shapes)
+            continue;
+
+        shape_instance inst;
+        shape *shape = &*state->shapes[user];
+        instance_mesh mesh = shape->get_instance_mesh();
+        if (mesh == INSTANCE_NONE || !shape->get_instance(&inst))
+            continue;
+        scene_transform_instance(&graph->world[node], &inst);
+        graph->instances[mesh].push_back(inst);
+    }
+
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++)
+        draw_instances((instance_mesh)mesh, graph->instances[mesh].data(),
+                       graph->instances[mesh].size());
+}
+
+/* Topmost node drawn by draw_scene_graph whose shape contains the world
+ * point p: meshes from the last, then nodes from the last within a mesh */
+template<typename S>
+bool pick_scene_graph(scene_graph *graph, shape_manager_state<S> *state,
+                      point p, uint32_t *node)
+{
+    scene_graph_update(graph);
+    for (uint32_t mesh = NUM_INSTANCE_MESHES; mesh-- > 0;) {
+        for (uint32_t i = graph->users.size(); i-- > 0;) {
+            uint32_t user = graph->users[i];
+            if (user >= state->num_shapes)
+                continue;
+
+            affine_2d to_local;
+            shape *shape = &*state->shapes[user];
+            if (shape->get_instance_mesh() != mesh ||
+                (!shape->has_fill() && !shape->has_border()) ||
+                !affine_invert(&graph->world[i], &to_local) ||
+                !shape->contains_point(affine_apply(&to_local, p)))
+                continue;
+
+            *node = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
@@ -3,22 +3,374 @@
 #include "gl_sdl_geometry.hpp"
 #include <SDL_events.h>
 #include <iostream>
+#include <vector>
 
 void shape::draw() {
     if (!enabled)
         return;
-    set_draw_color(&draw_color);
     if (fill_in)
-        draw_internal();
-    if (draw_border) {
-        /* Use complementary color for borders */
-        color border_color = { (Uint8)((Uint8)255 - draw_color.r),
-                               (Uint8)((Uint8)255 - draw_color.g),
-                               (Uint8)((Uint8)255 - draw_color.b),
-                               draw_color.a };
-        set_draw_color(&border_color);
-        draw_border_internal();
+        draw_fill();
+    if (draw_border)
+        draw_outline();
+}
+
+void shape::draw_fill()
+{
+    set_draw_color(&draw_color);
+    draw_internal();
+}
+
+void shape::draw_outline()
+{
+    /* Use complementary color for borders */
+    color border_color = { (Uint8)((Uint8)255 - draw_color.r),
+                           (Uint8)((Uint8)255 - draw_color.g),
+                           (Uint8)((Uint8)255 - draw_color.b),
+                           draw_color.a };
+    set_draw_color(&border_color);
+    draw_border_internal();
+}
+
+/* Everything goes through the 2D batch, so fills and borders only differ
+ * in the primitive type. The index is the depth, which keeps the fill and
+ * border of a shape together and shapes in their order. The color, as
+ * RGB565, only splits ties of indices past SORT_MAX_DEPTH. */
+sort_key shape_sort_key(shape *shape, uint idx, bool border)
+{
+    color c = shape->get_color();
+    uint32_t material = (uint32_t)(c.r >> 3) << 11 | (uint32_t)(c.g >> 2) << 5 |
+                        c.b >> 3;
+    uint32_t depth = std::min(idx, (uint)SORT_MAX_DEPTH);
+    return make_sort_key(shape->get_layer(), depth, 0, border ? 1 : 0,
+                         material);
+}
+
+sort_key shape_pick_order(shape *shape, uint idx)
+{
+    return shape_sort_key(shape, idx, shape->has_border());
+}
+
+/* Disabled shapes come out with no flags, drawn by neither pass */
+bool shape::get_instance(shape_instance *inst)
+{
+    inst->offset[0] = origin.x;
+    inst->offset[1] = origin.y;
+    inst->rot[0] = cosf(phi);
+    inst->rot[1] = sinf(phi);
+    inst->color[0] = draw_color.r;
+    inst->color[1] = draw_color.g;
+    inst->color[2] = draw_color.b;
+    inst->color[3] = draw_color.a;
+    inst->flags = !enabled ? 0 : (fill_in ? INSTANCE_FILL : 0) |
+                                 (draw_border ? INSTANCE_BORDER : 0);
+    fill_instance_geometry(inst);
+    return inst->flags != 0;
+}
+
+static void set_instance_axes(shape_instance *inst, point pos, vect axis_x,
+                              vect axis_y)
+{
+    inst->pos[0] = pos.x;
+    inst->pos[1] = pos.y;
+    inst->axis_x[0] = axis_x.x;
+    inst->axis_x[1] = axis_x.y;
+    inst->axis_y[0] = axis_y.x;
+    inst->axis_y[1] = axis_y.y;
+}
+
+static std::vector<shape_instance> queued_instances[NUM_INSTANCE_MESHES];
+static std::vector<shape *> queued_batch;   /* Shapes without a mesh */
+
+void queue_shape_instance(shape *shape)
+{
+    shape_instance inst;
+    if (!shape->get_instance(&inst))
+        return;
+
+    if (shape->get_instance_mesh() == INSTANCE_NONE)
+        queued_batch.push_back(shape);
+    else
+        queued_instances[shape->get_instance_mesh()].push_back(inst);
+}
+
+void draw_queued_instances()
+{
+    for (uint mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        std::vector<shape_instance> &instances = queued_instances[mesh];
+        draw_instances((instance_mesh)mesh, instances.data(), instances.size());
+        instances.clear();
+    }
+
+    /* Fills then borders, like the instanced passes */
+    if (queued_batch.empty())
+        return;
+    begin_batch_2d();
+    for (shape *shape : queued_batch) {
+        if (shape->has_fill())
+            shape->draw_fill();
+    }
+    for (shape *shape : queued_batch) {
+        if (shape->has_border())
+            shape->draw_outline();
+    }
+    flush_batch_2d();
+    queued_batch.clear();
+}
+
+void reset_retained_shapes(retained_shapes *retained)
+{
+    for (uint mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        destroy_instance_buffer(&retained->buffers[mesh]);
+        init_instance_buffer(&retained->buffers[mesh], (instance_mesh)mesh);
+    }
+
+    retained->slots.clear();
+    retained->batched.clear();
+    retained->ready = false;
+}
+
+void retain_shape(retained_shapes *retained, shape *shape)
+{
+    if (shape->get_instance_mesh() == INSTANCE_NONE) {
+        retained->batched.push_back(retained->slots.size());
+        retained->slots.push_back(0);
+        shape->clear_dirty();
+        return;
+    }
+
+    shape_instance inst;
+    shape->get_instance(&inst);
+    instance_buffer *buf = &retained->buffers[shape->get_instance_mesh()];
+    retained->slots.push_back(instance_buffer_add(buf, &inst));
+    shape->clear_dirty();
+}
+
+void update_retained_shape(retained_shapes *retained, uint idx, shape *shape)
+{
+    if (!shape->is_dirty())
+        return;
+    if (shape->get_instance_mesh() == INSTANCE_NONE) {
+        shape->clear_dirty();
+        return;
+    }
+
+    shape_instance inst;
+    shape->get_instance(&inst);
+    instance_buffer *buf = &retained->buffers[shape->get_instance_mesh()];
+    instance_buffer_update(buf, retained->slots[idx], &inst);
+    shape->clear_dirty();
+}
+
+void draw_retained_shapes(retained_shapes *retained)
+{
+    for (uint mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++)
+        draw_instance_buffer(&retained->buffers[mesh]);
+}
+
+static bool circle_circle(shape *a, shape *b)
+{
+    circle circle_a = static_cast<shape_circle *>(a)->get_world();
+    circle circle_b = static_cast<shape_circle *>(b)->get_world();
+    return intersect(&circle_a, &circle_b);
+}
+
+static bool circle_rect(shape *a, shape *b)
+{
+    circle circle = static_cast<shape_circle *>(a)->get_world();
+    quad box = static_cast<shape_rect *>(b)->get_world();
+    return intersect(&circle, &box);
+}
+
+static bool circle_tri(shape *a, shape *b)
+{
+    circle circle = static_cast<shape_circle *>(a)->get_world();
+    tri tri = static_cast<shape_tri *>(b)->get_world();
+    return intersect(&circle, &tri);
+}
+
+static bool rect_rect(shape *a, shape *b)
+{
+    quad box_a = static_cast<shape_rect *>(a)->get_world();
+    quad box_b = static_cast<shape_rect *>(b)->get_world();
+    return intersect(&box_a, &box_b);
+}
+
+static bool rect_tri(shape *a, shape *b)
+{
+    quad box = static_cast<shape_rect *>(a)->get_world();
+    tri tri = static_cast<shape_tri *>(b)->get_world();
+    return intersect(&tri, &box);
+}
+
+static bool tri_tri(shape *a, shape *b)
+{
+    tri tri_a = static_cast<shape_tri *>(a)->get_world();
+    tri tri_b = static_cast<shape_tri *>(b)->get_world();
+    return intersect(&tri_a, &tri_b);
+}
+
+/* Pieces of the polygon whose box touches box, until one passes test */
+template<typename F>
+static bool any_piece(shape_polygon *polygon, const aabb *box, F test)
+{
+    for (uint i = 0; i < polygon->get_num_pieces(); i++) {
+        if (!intersect(polygon->get_world_piece_box(i), box))
+            continue;
+
+        uint num;
+        const point *piece = polygon->get_world_piece(i, &num);
+        if (test(piece, num))
+            return true;
+    }
+
+    return false;
+}
+
+static bool circle_polygon(shape *a, shape *b)
+{
+    circle circle = static_cast<shape_circle *>(a)->get_world();
+    aabb box = a->get_aabb();
+    return any_piece(static_cast<shape_polygon *>(b), &box,
+                     [&](const point *piece, uint num) {
+                         return intersect_convex(&circle, piece, num);
+                     });
+}
+
+static bool rect_polygon(shape *a, shape *b)
+{
+    quad box = static_cast<shape_rect *>(a)->get_world();
+    aabb bounds = a->get_aabb();
+    return any_piece(static_cast<shape_polygon *>(b), &bounds,
+                     [&](const point *piece, uint num) {
+                         return intersect_convex(box.points, 4, piece, num);
+                     });
+}
+
+static bool tri_polygon(shape *a, shape *b)
+{
+    tri tri = static_cast<shape_tri *>(a)->get_world();
+    aabb bounds = a->get_aabb();
+    return any_piece(static_cast<shape_polygon *>(b), &bounds,
+                     [&](const point *piece, uint num) {
+                         return intersect_convex(tri.points, 3, piece, num);
+                     });
+}
+
+static bool polygon_polygon(shape *a, shape *b)
+{
+    shape_polygon *polygon_b = static_cast<shape_polygon *>(b);
+    aabb bounds = b->get_aabb();
+    return any_piece(static_cast<shape_polygon *>(a), &bounds,
+                     [&](const point *piece_a, uint num_a) {
+        aabb box_a = bounding_box(piece_a, num_a);
+        return any_piece(polygon_b, &box_a, [&](const point *piece_b,
+                                                uint num_b) {
+            return intersect_convex(piece_a, num_a, piece_b, num_b);
+        });
+    });
+}
+
+/* Each pair of types is written once, the other order swaps the shapes */
+template<bool (*test)(shape *, shape *)>
+static bool swapped(shape *a, shape *b)
+{
+    return test(b, a);
+}
+
+typedef bool (*narrowphase_test)(shape *a, shape *b);
+
+static const narrowphase_test narrowphase[NUM_SHAPE_TYPES][NUM_SHAPE_TYPES] = {
+    /* SHAPE_CIRCLE */
+    { circle_circle, circle_rect, circle_tri, circle_polygon },
+    /* SHAPE_RECT */
+    { swapped<circle_rect>, rect_rect, rect_tri, rect_polygon },
+    /* SHAPE_TRI */
+    { swapped<circle_tri>, swapped<rect_tri>, tri_tri, tri_polygon },
+    /* SHAPE_POLYGON */
+    { swapped<circle_polygon>, swapped<rect_polygon>, swapped<tri_polygon>,
+      polygon_polygon },
+};
+
+bool shapes_intersect(shape *a, shape *b)
+{
+    return narrowphase[a->get_type()][b->get_type()](a, b);
+}
+
+static bool cast_circle(line *segment, shape *shape, segment_hit *hit)
+{
+    circle world = static_cast<shape_circle *>(shape)->get_world();
+    return cast_segment(segment, &world, hit);
+}
+
+static bool cast_rect(line *segment, shape *shape, segment_hit *hit)
+{
+    quad world = static_cast<shape_rect *>(shape)->get_world();
+    return cast_segment(segment, &world, hit);
+}
+
+static bool cast_tri(line *segment, shape *shape, segment_hit *hit)
+{
+    tri world = static_cast<shape_tri *>(shape)->get_world();
+    return cast_segment(segment, &world, hit);
+}
+
+/* Nearest entry into any piece, pieces behind it are skipped by box */
+static bool cast_polygon(line *segment, shape *shape, segment_hit *hit)
+{
+    shape_polygon *polygon = static_cast<shape_polygon *>(shape);
+    bool any = false;
+    float max_t = 1.0f;
+    for (uint i = 0; i < polygon->get_num_pieces(); i++) {
+        float t;
+        if (!segment_enters(segment, polygon->get_world_piece_box(i), max_t,
+                            &t))
+            continue;
+
+        uint num;
+        const point *piece = polygon->get_world_piece(i, &num);
+        segment_hit piece_hit;
+        if (cast_segment_convex(segment, piece, num, &piece_hit) &&
+            (!any || piece_hit.t < hit->t)) {
+            *hit = piece_hit;
+            max_t = piece_hit.t;
+            any = true;
+        }
     }
+
+    return any;
+}
+
+typedef bool (*segment_cast)(line *segment, shape *shape, segment_hit *hit);
+
+static const segment_cast segment_casts[NUM_SHAPE_TYPES] = {
+    cast_circle, cast_rect, cast_tri, cast_polygon,
+};
+
+bool cast_segment(line *segment, shape *shape, segment_hit *hit)
+{
+    if (!shape->is_enabled())
+        return false;
+    return segment_casts[shape->get_type()](segment, shape, hit);
+}
+
+bool shape::intersects_with(shape *shape)
+{
+    return shapes_intersect(this, shape);
+}
+
+bool shape::intersects_circle(shape_circle *circle)
+{
+    return shapes_intersect(this, circle);
+}
+
+bool shape::intersects_rect(shape_rect *rect)
+{
+    return shapes_intersect(this, rect);
+}
+
+bool shape::intersects_tri(shape_tri *tri)
+{
+    return shapes_intersect(this, tri);
 }
 
 bool shape::contains_point(point p)
@@ -49,102 +401,103 @@ void shape_circle::draw_border_internal()
     draw_circle_border(&data);
 }
 
-bool shape_circle::contains_point_internal(point p)
+void shape_circle::fill_instance_geometry(shape_instance *inst)
 {
-    if (!transformed)
-        return point_in_circle(p, &data);
-
-    shape_circle pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.contains_point(p);
+    set_instance_axes(inst, data.center, { data.radius, 0.0f },
+                      { 0.0f, data.radius });
+    inst->rot[0] = 1.0f;    /* No rotation, same as draw_internal */
+    inst->rot[1] = 0.0f;
 }
 
-bool shape_circle::intersects_circle(shape_circle * circle_arg)
+void shape_circle::update_world()
 {
-    if (!transformed)
-        return circle_arg->intersects_another_circle(&data);
+    world = data;
+    move_circle(&world, origin);
+    world_box = bounding_box(&world);
+}
 
-    shape_circle pseudo = *this;
-    pseudo.apply_transform();
-    return circle_arg->intersects_another_circle(&pseudo.data);
+bool shape_circle::contains_point_internal(point p)
+{
+    refresh_world();
+    return point_in_circle(p, &world);
 }
 
 bool shape_circle::intersects_rect(rect *neighbor)
 {
-    if (!transformed)
-        return intersect(&data, neighbor);
-
-    shape_circle pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.intersects_rect(neighbor);
+    refresh_world();
+    return intersect(&world, neighbor);
 }
 
 bool shape_circle::intersects_tri(tri *neighbor)
 {
-    if (!transformed)
-        return intersect(&data, neighbor);
-
-    shape_circle pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.intersects_tri(neighbor);
+    refresh_world();
+    return intersect(&world, neighbor);
 }
 
 bool shape_circle::intersects_another_circle(circle *neighbor)
 {
-    if (!transformed)
-        return intersect(&data, neighbor);
-
-    shape_circle pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.intersects_another_circle(neighbor);
+    refresh_world();
+    return intersect(&world, neighbor);
 }
 
 void shape_rect::apply_transform_internal()
 {
-    /* TODO : rotation */
-    move_rect(&data, origin);
+    /* The corner lands on the first world corner, the sides turn along */
+    refresh_world();
+    data.x = world.points[0].x;
+    data.y = world.points[0].y;
+    angle += phi;
 }
 
+/* The box is drawn around its corner, so the corner takes the offset */
 void shape_rect::draw_internal()
 {
-    set_offset(&origin);
-    //  set_rot_angle(phi); <- Maybe worth putting this part into the base class?
-    set_rot_angle(0);
-    draw_rect(&data);
+    rect local = { 0.0f, 0.0f, data.w, data.h };
+    point corner = get_world().points[0];
+    set_offset(&corner);
+    set_rot_angle(phi + angle);
+    draw_rect(&local);
 }
 
 void shape_rect::draw_border_internal()
 {
-    set_offset(&origin);
-    set_rot_angle(0);
-    draw_rect_border(&data);
+    rect local = { 0.0f, 0.0f, data.w, data.h };
+    point corner = get_world().points[0];
+    set_offset(&corner);
+    set_rot_angle(phi + angle);
+    draw_rect_border(&local);
 }
 
-bool shape_rect::contains_point_internal(point p)
+void shape_rect::fill_instance_geometry(shape_instance *inst)
 {
-    if (!transformed)
-        return point_in_rect(p, &data);
-
-    /* TODO : move this logic into the base class */
-    shape_rect pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.contains_point(p);
+    float c = cosf(angle);
+    float s = sinf(angle);
+    set_instance_axes(inst, { data.x, data.y }, { data.w * c, data.w * s },
+                      { -data.h * s, data.h * c });
 }
 
-bool shape_rect::intersects_circle(shape_circle * circle)
+void shape_rect::update_world()
 {
-    if (!transformed)
-        return circle->intersects_rect(&data);
+    rect local = { 0.0f, 0.0f, data.w, data.h };
+    world = rect_corners(&local);
+    rotate_quad(&world, angle);
+    move_quad(&world, { data.x, data.y });
+    rotate_quad(&world, phi);
+    move_quad(&world, origin);
+    world_box = bounding_box(&world);
+}
 
-    shape_rect pseudo = *this;
-    pseudo.apply_transform();
-    return circle->intersects_rect(&pseudo.data);
+bool shape_rect::contains_point_internal(point p)
+{
+    refresh_world();
+    return point_in_quad(p, &world);
 }
 
+
 void shape_tri::apply_transform_internal()
 {
-    rotate_tri(&data, phi);
-    move_tri(&data, origin);
+    refresh_world();
+    data = world;
 }
 
 void shape_tri::draw_internal()
@@ -161,53 +514,151 @@ void shape_tri::draw_border_internal()
     draw_tri_border(&data);
 }
 
+void shape_tri::fill_instance_geometry(shape_instance *inst)
+{
+    point p0 = data.points[0];
+    point p1 = data.points[1];
+    point p2 = data.points[2];
+    set_instance_axes(inst, p0, { p1.x - p0.x, p1.y - p0.y },
+                      { p2.x - p0.x, p2.y - p0.y });
+}
+
+void shape_tri::update_world()
+{
+    world = data;
+    rotate_tri(&world, phi);
+    move_tri(&world, origin);
+    world_box = bounding_box(&world);
+}
+
 bool shape_tri::contains_point_internal(point p)
 {
-    if (!transformed)
-        return point_in_tri(p, &data);
-    
-    shape_tri pseudo = *this;
-    pseudo.apply_transform();
-    return pseudo.contains_point(p);
+    refresh_world();
+    return point_in_tri(p, &world);
+}
+
+
+void shape_polygon::set_points(const point *points, const uint32_t *ring_ends,
+                               uint num_rings)
+{
+    uint num_points = num_rings ? ring_ends[num_rings - 1] : 0;
+    this->points.assign(points, points + num_points);
+    this->ring_ends.assign(ring_ends, ring_ends + num_rings);
+    mesh_stale = true;
+    world_stale = true;
+    dirty = true;
+    bump_revision();
+    geometry_revision++;
+}
+
+static point rotate_move(point p, float c, float s, point origin)
+{
+    return { c * p.x - s * p.y + origin.x, s * p.x + c * p.y + origin.y };
+}
+
+/* Turning and moving keeps the triangles and pieces as they are */
+void shape_polygon::apply_transform_internal()
+{
+    float c = cosf(phi);
+    float s = sinf(phi);
+    for (auto &p : points)
+        p = rotate_move(p, c, s, origin);
 }
 
-bool shape_tri::intersects_circle(shape_circle * circle)
+void shape_polygon::draw_internal()
 {
-    if (!transformed)
-        return circle->intersects_tri(&data);
-    
-    shape_tri pseudo = *this;
-    pseudo.apply_transform();
-    return circle->intersects_tri(&pseudo.data);
+    refresh_mesh();
+    set_offset(&origin);
+    set_rot_angle(phi);
+    draw_tri_mesh(points.data(), mesh.triangles.data(),
+                  mesh.triangles.size());
+}
+
+void shape_polygon::draw_border_internal()
+{
+    set_offset(&origin);
+    set_rot_angle(phi);
+    draw_rings_border(points.data(), ring_ends.data(), ring_ends.size());
+}
+
+void shape_polygon::fill_instance_geometry(shape_instance *inst)
+{
+    set_instance_axes(inst, { 0.0f, 0.0f }, { 0.0f, 0.0f }, { 0.0f, 0.0f });
+}
+
+void shape_polygon::update_world()
+{
+    refresh_mesh();
+    float c = cosf(phi);
+    float s = sinf(phi);
+    world.resize(mesh.pieces.size());
+    for (uint i = 0; i < mesh.pieces.size(); i++)
+        world[i] = rotate_move(points[mesh.pieces[i]], c, s, origin);
+
+    piece_boxes.resize(mesh.piece_ends.size());
+    uint begin = 0;
+    for (uint i = 0; i < mesh.piece_ends.size(); i++) {
+        piece_boxes[i] = bounding_box(&world[begin],
+                                      mesh.piece_ends[i] - begin);
+        begin = mesh.piece_ends[i];
+    }
+
+    /* The outline holds everything */
+    uint num_outline = ring_ends.empty() ? 0 : ring_ends[0];
+    world_box = { origin, origin };
+    for (uint i = 0; i < num_outline; i++) {
+        point p = rotate_move(points[i], c, s, origin);
+        if (!i)
+            world_box = { p, p };
+        world_box.min.x = fminf(world_box.min.x, p.x);
+        world_box.min.y = fminf(world_box.min.y, p.y);
+        world_box.max.x = fmaxf(world_box.max.x, p.x);
+        world_box.max.y = fmaxf(world_box.max.y, p.y);
+    }
+}
+
+bool shape_polygon::contains_point_internal(point p)
+{
+    for (uint i = 0; i < get_num_pieces(); i++) {
+        uint num;
+        const point *piece = get_world_piece(i, &num);
+        if (point_in_aabb(p, &piece_boxes[i]) &&
+            point_in_convex(p, piece, num))
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Fills in the cached mapping if update_space_2d was never called */
+static void ensure_space_cached(SDL_Window *window, space_2d *space)
+{
+    if (space->cached)
+        return;
+
+    int view_w, view_h, window_w, window_h;
+    SDL_GL_GetDrawableSize(window, &view_w, &view_h);
+    SDL_GetWindowSize(window, &window_w, &window_h);
+    update_space_2d(space, view_w, view_h, window_w, window_h);
 }
 
 point sdl_point_to_space_2d(SDL_Window *window, space_2d *space, point sdl_point)
 {
-    /* TODO : opengl coordinates */
-    int w_int, h_int;
-    SDL_GetWindowSize(window, &w_int, &h_int);
+    ensure_space_cached(window, space);
 
-    float w = (float)w_int;
-    float h = (float)h_int;
-    float scale = space->w_int / space->w_loc;
-    sdl_point.y = h - sdl_point.y;
-    sdl_point = { (sdl_point.x / w - space->origin.x) * scale,
-                  (sdl_point.y / w - space->origin.y) * scale };
-    return sdl_point;
+    point gl_point = { 2.0f * sdl_point.x / space->window_w - 1.0f,
+                       1.0f - 2.0f * sdl_point.y / space->window_h };
+    return affine_apply(&space->from_gl, gl_point);
 }
 
 vect sdl_vec_to_space_2d(SDL_Window *window, space_2d *space, vect sdl_vect)
 {
-    /* TODO : opengl coordinates */
-    int w_int;
-    SDL_GetWindowSize(window, &w_int, NULL);
+    ensure_space_cached(window, space);
 
-    float w = (float)w_int;     /* Normalize */
-    sdl_vect.y = -sdl_vect.y;
-    float scale = space->w_int / space->w_loc;
-    sdl_vect = { sdl_vect.x / w * scale,
-                 sdl_vect.y / w * scale };
-    return sdl_vect;
+    vect gl_vect = { 2.0f * sdl_vect.x / space->window_w,
+                     -2.0f * sdl_vect.y / space->window_h };
+    return affine_apply_vect(&space->from_gl, gl_vect);
 }
 
 color colors[18] = {{230, 25, 75}, {60, 180, 75}, {255, 225, 25},
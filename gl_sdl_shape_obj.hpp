@@ -2,15 +2,41 @@
 #define GL_SDL_SHAPE_OBJ_H
 
 #include "gl_sdl_2d.hpp"
-#include <stdexcept>
+#include "gl_sdl_render_queue.hpp"
+#include "gl_sdl_broadphase.hpp"
+#include "gl_sdl_aabb_tree.hpp"
+#include "gl_sdl_sweep_prune.hpp"
+#include "gl_sdl_thread_pool.hpp"
+#include "gl_sdl_polygon.hpp"
+#include "gl_sdl_input.hpp"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 
 class shape_circle;
 class shape_rect;
 class shape_tri;
+class shape_polygon;
+
+/* Indices of shapes changed since the owner last looked, each listed once.
+ * Shared so that shapes never point at a list that went away. */
+typedef std::vector<uint32_t> shape_changes;
+
+/* Concrete class of a shape, indexes the narrowphase table */
+enum shape_type {
+    SHAPE_CIRCLE,
+    SHAPE_RECT,
+    SHAPE_TRI,
+    SHAPE_POLYGON,
+    NUM_SHAPE_TYPES
+};
 
 class shape {
 protected:
+    shape_type type;
     float phi = 0;
     point origin = { 0, 0 };
     bool transformed = false;
@@ -18,31 +44,111 @@ protected:
     bool draw_border = false;
     bool fill_in = true;
     bool enabled = true;
+    uint layer = 0;
+    bool dirty = true;  /* Changed since the last retained upload */
+    uint revision = 0;  /* Bumped by every change, for caches to compare */
+    uint geometry_revision = 0; /* Only by changes of where the shape is */
+    std::shared_ptr<shape_changes> changes; /* Told of revision bumps */
+    uint32_t change_idx = 0;    /* Index listed in changes */
+    bool change_listed = false;
+    void bump_revision() {
+        revision++;
+        if (changes && !change_listed) {
+            changes->push_back(change_idx);
+            change_listed = true;
+        }
+    }
+    bool world_stale = true;    /* Set by every change of the transform */
+    aabb world_box;
     virtual void apply_transform_internal() = 0; /* Without this, collision calls would need to compute a true position every time */
+    virtual void update_world() = 0;    /* World geometry and world_box */
+    void refresh_world() {
+        if (!world_stale)
+            return;
+        update_world();
+        world_stale = false;
+    }
     virtual void draw_internal() = 0;
     virtual void draw_border_internal() = 0;
     virtual bool contains_point_internal(point p) = 0;
+    virtual void fill_instance_geometry(shape_instance *inst) = 0;
 public:
-    shape() { phi = 0; origin = {0,0}; }
+    shape(shape_type type) : type(type) { phi = 0; origin = {0,0}; }
+    virtual ~shape() {}
     void draw();
+    void draw_fill();
+    void draw_outline();
+    virtual instance_mesh get_instance_mesh() = 0;
+    aabb get_aabb() { refresh_world(); return world_box; }
+    bool get_instance(shape_instance *inst);
     bool contains_point(point p);
-    virtual bool intersects_with(shape *shape) = 0;
-    virtual bool intersects_circle(shape_circle *circle) = 0;
-    bool intersects_rect(shape_rect *rect) { throw std::runtime_error("NOT IMPLEMENTED"); }
-    bool intersects_tri(shape_tri *tri) { throw std::runtime_error("NOT IMPLEMENTED"); }
-    void set_color(color new_color) { draw_color = new_color; }
-    void set_draw_border(bool draw_border) { this->draw_border = draw_border; }
-    void set_fill_in(bool fill_in) { this->fill_in = fill_in; }
-    void set_enabled(bool enable) { this->enabled = enable; }
+    shape_type get_type() { return type; }
+    /* All through shapes_intersect */
+    bool intersects_with(shape *shape);
+    bool intersects_circle(shape_circle *circle);
+    bool intersects_rect(shape_rect *rect);
+    bool intersects_tri(shape_tri *tri);
+    void set_color(color new_color) {
+        dirty = dirty || memcmp(&draw_color, &new_color, sizeof(color));
+        draw_color = new_color;
+        bump_revision();
+    }
+    void set_draw_border(bool draw_border) {
+        dirty = dirty || this->draw_border != draw_border;
+        this->draw_border = draw_border;
+        bump_revision();
+    }
+    void set_fill_in(bool fill_in) {
+        dirty = dirty || this->fill_in != fill_in;
+        this->fill_in = fill_in;
+        bump_revision();
+    }
+    void set_enabled(bool enable) {
+        dirty = dirty || enabled != enable;
+        this->enabled = enable;
+        bump_revision();
+        geometry_revision++;
+    }
+    bool is_dirty() { return dirty; }
+    void clear_dirty() { dirty = false; }
+    /* Later changes list idx in the given list, replacing any earlier one */
+    void track_changes(const std::shared_ptr<shape_changes> &list,
+                       uint32_t idx) {
+        changes = list;
+        change_idx = idx;
+        change_listed = false;
+    }
+    /* The owner of the list took the shape off, the next change lists it */
+    void clear_change_listed() { change_listed = false; }
+    uint get_revision() { return revision; }
+    uint get_geometry_revision() { return geometry_revision; }
+    bool is_enabled() { return enabled; }
+    bool has_fill() { return fill_in; }
+    bool has_border() { return draw_border; }
+    color get_color() { return draw_color; }
+    /* Clamped to SORT_MAX_LAYER, the most the sort keys hold */
+    void set_layer(uint layer) {
+        this->layer = std::min(layer, (uint)SORT_MAX_LAYER);
+        bump_revision();
+    }
+    uint get_layer() { return layer; }
     point get_offset() { return origin; }
     float get_rotation() { return phi; }
     void set_origin(point offset) {
         origin = offset;
         transformed = true;
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
     void set_rotation(float angle) {
         phi = angle;
         transformed = true;
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
 
     void apply_transform() {
@@ -50,76 +156,163 @@ public:
         apply_transform_internal();
         phi = 0;
         origin = {0,0};
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
 
     void reset_transform() {
         transformed = false;
         phi = 0.f;
         origin = { 0,0 };
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
 
     void rotate(float rotation_angle) {
         phi += rotation_angle;
         transformed = true;
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
 
     void move(vect vect) {
         origin.x += vect.x;
         origin.y += vect.y;
         transformed = true;
+        world_stale = true;
+        dirty = true;
+        bump_revision();
+        geometry_revision++;
     }
 };
 
 class shape_circle : public shape {
 private:
     circle data;
-    friend class shape_rect;
-    friend class shape_tri;
+    circle world;
 protected:
     virtual void apply_transform_internal() override;
+    virtual void update_world() override;
     virtual void draw_internal() override;
+    virtual void fill_instance_geometry(shape_instance *inst) override;
 public:
-    shape_circle(circle original) : shape(), data { original } {}
+    shape_circle(circle original) : shape(SHAPE_CIRCLE), data { original } {}
     shape_circle(point center, float r) : shape_circle(circle{center, r}) {}
     shape_circle(float r = 5.f) : shape_circle({0,0}, r) {}
     virtual bool contains_point_internal(point p) override;
-    virtual bool intersects_with(shape *shape) override { return shape->intersects_circle(this); }
-    virtual bool intersects_circle(shape_circle *circle) override;
     virtual void draw_border_internal() override;
+    virtual instance_mesh get_instance_mesh() override { return INSTANCE_CIRCLE; }
+    using shape::intersects_rect;
+    using shape::intersects_tri;
     bool intersects_rect(rect *neighbor);
     bool intersects_tri(tri *neighbor);
     bool intersects_another_circle(circle *neighbor);
     circle get_data() { return data; }
+    /* With the pending transform applied */
+    circle get_world() { refresh_world(); return world; }
 };
 
+/* An oriented box, its sides run along the axes turned by angle around the
+ * corner at (x, y) */
 class shape_rect : public shape {
 private:
     rect data;
+    float angle = 0.0f;
+    quad world;
 protected:
     virtual void apply_transform_internal() override;
+    virtual void update_world() override;
     virtual void draw_internal() override;
+    virtual void fill_instance_geometry(shape_instance *inst) override;
 public:
-    shape_rect(point start, float w, float h) : data{start.x, start.y, w, h} {}
+    shape_rect(point start, float w, float h) : shape(SHAPE_RECT), data{start.x, start.y, w, h} {}
     shape_rect(point start, point dest) : shape_rect(start, dest.x - start.x, dest.y - start.y) {}
     virtual bool contains_point_internal(point p) override;
-    virtual bool intersects_with(shape *shape) override { return shape->intersects_rect(this); }
-    virtual bool intersects_circle(shape_circle *circle) override;
     virtual void draw_border_internal() override;
+    virtual instance_mesh get_instance_mesh() override { return INSTANCE_RECT; }
+    /* Corners with the pending transform applied, starting at (x, y) */
+    quad get_world() { refresh_world(); return world; }
 };
 
 class shape_tri : public shape {
 private:
     tri data;
+    tri world;
+protected:
+    virtual void apply_transform_internal() override;
+    virtual void update_world() override;
+    virtual void draw_internal() override;
+    virtual void fill_instance_geometry(shape_instance *inst) override;
+public:
+    shape_tri(point p1, point p2, point p3) : shape(SHAPE_TRI), data {{p1, p2, p3}} {}
+    shape_tri(point *points) : shape(SHAPE_TRI), data {{points[0], points[1], points[2]}} {}
+    virtual bool contains_point_internal(point p) override;
+    virtual void draw_border_internal() override;
+    virtual instance_mesh get_instance_mesh() override { return INSTANCE_TRI; }
+    /* With the pending transform applied */
+    tri get_world() { refresh_world(); return world; }
+};
+
+/* Simple polygon, optionally with holes, see gl_sdl_polygon.hpp for the
+ * rings. Triangles for drawing and convex pieces for collisions are built
+ * once per set of points, moving and rotating only carries the pieces
+ * along. No instance mesh, the instanced paths draw it through the batch. */
+class shape_polygon : public shape {
+private:
+    std::vector<point> points;
+    std::vector<uint32_t> ring_ends;
+    polygon_mesh mesh;
+    bool mesh_stale = true;
+    bool mesh_valid = false;
+    std::vector<point> world;           /* Corners of piece after piece */
+    std::vector<aabb> piece_boxes;
+    void refresh_mesh() {
+        if (!mesh_stale)
+            return;
+        mesh_valid = !build_polygon_mesh(points.data(), ring_ends.data(),
+                                         ring_ends.size(), &mesh);
+        mesh_stale = false;
+    }
 protected:
     virtual void apply_transform_internal() override;
+    virtual void update_world() override;
     virtual void draw_internal() override;
+    virtual void fill_instance_geometry(shape_instance *inst) override;
 public:
-    shape_tri(point p1, point p2, point p3) : data {{p1, p2, p3}} {}
-    shape_tri(point *points) : data {{points[0], points[1], points[2]}} {}
+    shape_polygon(const point *points, uint num_points)
+        : shape_polygon(points, &num_points, 1) {}
+    shape_polygon(const point *points, const uint32_t *ring_ends,
+                  uint num_rings) : shape(SHAPE_POLYGON) {
+        set_points(points, ring_ends, num_rings);
+    }
+    /* Throws away the triangles and pieces */
+    void set_points(const point *points, const uint32_t *ring_ends,
+                    uint num_rings);
     virtual bool contains_point_internal(point p) override;
-    virtual bool intersects_with(shape *shape) override { return shape->intersects_tri(this); }
-    virtual bool intersects_circle(shape_circle *circle) override;
     virtual void draw_border_internal() override;
+    virtual instance_mesh get_instance_mesh() override { return INSTANCE_NONE; }
+    /* False if the rings could not be triangulated, what was is kept */
+    bool is_valid() { refresh_mesh(); return mesh_valid; }
+    uint get_num_triangles() { refresh_mesh(); return mesh.triangles.size() / 3; }
+    uint get_num_pieces() { refresh_mesh(); return mesh.piece_ends.size(); }
+    /* Corners of convex piece i with the pending transform applied,
+     * counterclockwise, num of them */
+    const point *get_world_piece(uint i, uint *num) {
+        refresh_world();
+        uint begin = i ? mesh.piece_ends[i - 1] : 0;
+        *num = mesh.piece_ends[i] - begin;
+        return &world[begin];
+    }
+    const aabb *get_world_piece_box(uint i) {
+        refresh_world();
+        return &piece_boxes[i];
+    }
 };
 
 /* TODO : move the below to shape_utils.h? */
@@ -150,41 +343,699 @@ bool try_drag_shape(SDL_Event *event, S  &shape, space_2d *space)
     return true;
 }
 
+/* Per mesh GPU buffers for draw_all_shapes_retained, slot of shape i in
+ * slots[i]. Released by reset_retained_shapes. */
+struct retained_shapes {
+    instance_buffer buffers[NUM_INSTANCE_MESHES];
+    std::vector<uint> slots;
+    std::vector<uint> batched;  /* Shapes without an instance mesh */
+    bool ready = false;
+};
+
+void reset_retained_shapes(retained_shapes *retained);
+void retain_shape(retained_shapes *retained, shape *shape);
+void update_retained_shape(retained_shapes *retained, uint idx, shape *shape);
+void draw_retained_shapes(retained_shapes *retained);
+
+/* Queue items are the shape index shifted left once, the low bit selects
+ * the border */
+#define SHAPE_ITEM_BORDER 1u
+
+/* Shapes a task left to the calling thread and whether it moved any, or
+ * the intersecting pairs of a range of grid buckets */
+struct collision_task {
+    std::vector<uint32_t> changed;
+    bool moved;
+    std::vector<broadphase_pair> pairs;
+};
+
 template<typename S>
 struct shape_manager_state {
     S *shapes;
     uint num_shapes = 0;
-    uint first_to_draw = 0;
+    uint top_layer = 0;
+    render_queue queue;     /* Draw order of the last draw_all_shapes */
+    retained_shapes retained;
+    spatial_hash collisions;    /* Kept up to date by update_broadphase */
+    std::vector<uint32_t> proxies;  /* Collision proxy of shape i */
+    aabb_tree pick_tree;        /* Kept up to date by update_pick_tree */
+    std::vector<uint32_t> pick_leaves;  /* Pick tree leaf of shape i */
+    std::vector<uint> pick_revisions;   /* Shape revision the leaf is from */
+    /* Shapes changed since the last update_pick_tree */
+    std::shared_ptr<shape_changes> pick_changes;
+    std::vector<uint32_t> pick_hits;    /* Scratch of select_shapes_in_rect */
+    sweep_prune contacts;       /* Kept up to date by update_contacts */
+    std::vector<uint32_t> contact_proxies;
+    std::vector<uint> contact_revisions;    /* Geometry revisions */
+    /* Scratch of find_colliding_shapes_parallel, per task */
+    std::vector<collision_task> collision_tasks;
 };
 
+/* Layer, then the shape's index, then fill before border */
+sort_key shape_sort_key(shape *shape, uint idx, bool border);
+/* Key of the last item a shape puts in the draw_all_shapes queue, equal
+ * keys are drawn by increasing index */
+sort_key shape_pick_order(shape *shape, uint idx);
+
+/* Narrowphase for a broadphase pair, looked up in a table by the types of
+ * both shapes. Touching polygons intersect, touching circles do not. */
+bool shapes_intersect(shape *a, shape *b);
+
+/* Narrowphase over pairs of shape indices, moves the intersecting ones to
+ * the front in order and returns how many there are */
+template<typename S>
+uint filter_intersecting_pairs(S *shapes, broadphase_pair *pairs,
+                               uint num_pairs)
+{
+    uint kept = 0;
+    for (uint i = 0; i < num_pairs; i++) {
+        broadphase_pair pair = pairs[i];
+        pairs[kept] = pair;
+        kept += shapes_intersect(&*shapes[pair.a], &*shapes[pair.b]);
+    }
+
+    return kept;
+}
+
+/* Where the segment enters the enabled shape, in world space */
+bool cast_segment(line *segment, shape *shape, segment_hit *hit);
+
+#define SHAPE_CAST_MISS 0xffffffffu
+
+struct shape_cast_hit {
+    uint idx;           /* SHAPE_CAST_MISS when nothing was hit */
+    float dist;         /* From the start of the segment */
+    point p;
+    vect normal;        /* Unit length, facing the segment */
+};
+
+/* Renumbers layers to 0..n-1 keeping their order, frees room on top */
+template<typename S>
+void compact_layers(shape_manager_state<S> *state)
+{
+    std::vector<uint> layers(state->num_shapes);
+    for (uint i = 0; i < state->num_shapes; i++)
+        layers[i] = state->shapes[i]->get_layer();
+
+    std::sort(layers.begin(), layers.end());
+    layers.erase(std::unique(layers.begin(), layers.end()), layers.end());
+
+    for (uint i = 0; i < state->num_shapes; i++) {
+        uint layer = state->shapes[i]->get_layer();
+        auto it = std::lower_bound(layers.begin(), layers.end(), layer);
+        state->shapes[i]->set_layer(it - layers.begin());
+    }
+
+    state->top_layer = layers.empty() ? 0 : layers.size() - 1;
+}
+
+template<typename S>
+void bring_to_front(shape_manager_state<S> *state, uint idx)
+{
+    if (state->shapes[idx]->get_layer() == state->top_layer &&
+        state->top_layer > 0)
+        return;
+
+    if (state->top_layer >= SORT_MAX_LAYER)
+        compact_layers(state);
+    /* Every layer is in use, the bottom two merge to free one */
+    if (state->top_layer >= SORT_MAX_LAYER) {
+        for (uint i = 0; i < state->num_shapes; i++) {
+            uint layer = state->shapes[i]->get_layer();
+            if (layer > 0)
+                state->shapes[i]->set_layer(layer - 1);
+        }
+        state->top_layer--;
+    }
+
+    state->shapes[idx]->set_layer(++state->top_layer);
+}
+
+/* Shape indices from the top down, in the order of the last draw */
+template<typename S>
+void get_pick_order(shape_manager_state<S> *state, std::vector<uint> *order)
+{
+    order->clear();
+    const std::vector<uint32_t> &items = state->queue.items;
+    if (items.empty()) {
+        for (uint i = 1; i <= state->num_shapes; i++)
+            order->push_back(state->num_shapes - i);
+        return;
+    }
+
+    /* A shape shows up once for its fill and once for its border */
+    std::vector<bool> seen(state->num_shapes, false);
+    for (auto it = items.rbegin(); it != items.rend(); ++it) {
+        uint idx = *it >> 1;
+        if (idx >= state->num_shapes || seen[idx])
+            continue;
+        seen[idx] = true;
+        order->push_back(idx);
+    }
+}
+
+template<typename S>
+float average_shape_size(shape_manager_state<S> *state)
+{
+    float total = 0.0f;
+    for (uint i = 0; i < state->num_shapes; i++) {
+        aabb box = state->shapes[i]->get_aabb();
+        total += std::max(box.max.x - box.min.x, box.max.y - box.min.y);
+    }
+
+    float size = state->num_shapes ? total / state->num_shapes : 0.0f;
+    return size > 0.0f ? size : 1.0f;
+}
+
+/* Leaf of shape i, unless its revision did not change */
+template<typename S>
+void update_pick_leaf(shape_manager_state<S> *state, uint i)
+{
+    aabb_tree *tree = &state->pick_tree;
+    shape *shape = &*state->shapes[i];
+    uint32_t *leaf = &state->pick_leaves[i];
+    if (*leaf != AABB_TREE_NULL &&
+        state->pick_revisions[i] == shape->get_revision())
+        return;
+
+    state->pick_revisions[i] = shape->get_revision();
+    if (!shape->is_enabled()) {
+        if (*leaf != AABB_TREE_NULL)
+            aabb_tree_remove(tree, *leaf);
+        *leaf = AABB_TREE_NULL;
+        return;
+    }
+
+    aabb box = shape->get_aabb();
+    if (*leaf == AABB_TREE_NULL) {
+        *leaf = aabb_tree_insert(tree, &box, i, shape_pick_order(shape, i));
+    } else {
+        aabb_tree_move(tree, *leaf, &box);
+        aabb_tree_set_order(tree, *leaf, shape_pick_order(shape, i));
+    }
+}
+
+/* Brings the pick tree in line with the shapes. The first call, or one
+ * after num_shapes changed or the tree got cleared, looks at every shape
+ * and has them list their changes in pick_changes, later ones only visit
+ * those. A shape lists changes for one state at a time, the last to take
+ * it in. A different shape object put at an index needs
+ * aabb_tree_clear(&state->pick_tree) first. */
+template<typename S>
+void update_pick_tree(shape_manager_state<S> *state)
+{
+    aabb_tree *tree = &state->pick_tree;
+    bool all = state->pick_leaves.size() != state->num_shapes ||
+               !state->pick_changes;
+    if (!(tree->margin > 0.0f)) {
+        aabb_tree_init(tree, 0.1f * average_shape_size(state));
+        state->pick_leaves.clear();
+        all = true;
+    } else if (tree->root == AABB_TREE_NULL) {
+        state->pick_leaves.clear();
+        all = true;
+    }
+
+    if (!state->pick_changes)
+        state->pick_changes = std::make_shared<shape_changes>();
+    shape_changes *changes = &*state->pick_changes;
+
+    if (!all) {
+        for (uint32_t i : *changes) {
+            if (i >= state->num_shapes)
+                continue;
+            state->shapes[i]->clear_change_listed();
+            update_pick_leaf(state, i);
+        }
+        changes->clear();
+        return;
+    }
+
+    for (uint i = state->num_shapes; i < state->pick_leaves.size(); i++) {
+        if (state->pick_leaves[i] != AABB_TREE_NULL)
+            aabb_tree_remove(tree, state->pick_leaves[i]);
+    }
+    state->pick_leaves.resize(state->num_shapes, AABB_TREE_NULL);
+    state->pick_revisions.resize(state->num_shapes);
+    changes->clear();
+
+    for (uint i = 0; i < state->num_shapes; i++) {
+        state->shapes[i]->track_changes(state->pick_changes, i);
+        update_pick_leaf(state, i);
+    }
+}
+
+/* Topmost shape containing p, in draw_all_shapes order */
+template<typename S>
+bool pick_shape(shape_manager_state<S> *state, point p, uint *idx)
+{
+    update_pick_tree(state);
+
+    struct pick_data {
+        shape_manager_state<S> *state;
+        point p;
+    } data = { state, p };
+    auto accept = [](uint32_t user, void *data) {
+        pick_data *pick = (pick_data *)data;
+        return pick->state->shapes[user]->contains_point(pick->p);
+    };
+
+    uint32_t user = aabb_tree_pick(&state->pick_tree, p, accept, &data);
+    if (user == AABB_TREE_NULL)
+        return false;
+
+    *idx = user;
+    return true;
+}
+
+/* Shapes whose bounding box touches the rectangle, topmost first */
+template<typename S>
+void select_shapes_in_rect(shape_manager_state<S> *state, rect *area,
+                           std::vector<uint> *selected)
+{
+    update_pick_tree(state);
+
+    aabb box = bounding_box(area);
+    aabb_tree_query(&state->pick_tree, &box, &state->pick_hits);
+
+    selected->clear();
+    for (uint32_t idx : state->pick_hits) {
+        aabb shape_box = state->shapes[idx]->get_aabb();
+        if (intersect(&shape_box, &box))
+            selected->push_back(idx);
+    }
+}
+
+static inline shape_cast_hit make_cast_hit(const line *segment, uint idx,
+                                           const segment_hit *hit)
+{
+    float dx = segment->end.x - segment->start.x;
+    float dy = segment->end.y - segment->start.y;
+    return { idx, hit->t * sqrtf(dx * dx + dy * dy), hit->p, hit->normal };
+}
+
+/* Nearest shape along each segment into hits[i], rays go through
+ * ray_segment first. Runs over the pick tree. */
+template<typename S>
+void cast_segments(shape_manager_state<S> *state, const line *segments,
+                   uint num_segments, shape_cast_hit *hits)
+{
+    update_pick_tree(state);
+
+    struct cast_data {
+        S *shapes;
+        line segment;
+        uint idx;
+        segment_hit hit;
+    } data;
+    data.shapes = state->shapes;
+    auto cast = [](uint32_t user, void *data) {
+        cast_data *c = (cast_data *)data;
+        segment_hit hit;
+        if (!cast_segment(&c->segment, &*c->shapes[user], &hit))
+            return -1.0f;
+        if (c->idx == SHAPE_CAST_MISS || hit.t < c->hit.t ||
+            (hit.t == c->hit.t && user < c->idx)) {
+            c->idx = user;
+            c->hit = hit;
+        }
+        return hit.t;
+    };
+
+    for (uint i = 0; i < num_segments; i++) {
+        data.segment = segments[i];
+        data.idx = SHAPE_CAST_MISS;
+        aabb_tree_cast(&state->pick_tree, &segments[i], cast, &data);
+        if (data.idx == SHAPE_CAST_MISS)
+            hits[i] = { SHAPE_CAST_MISS, 0.0f, segments[i].end, { 0.0f, 0.0f } };
+        else
+            hits[i] = make_cast_hit(&segments[i], data.idx, &data.hit);
+    }
+}
+
+/* All shapes along each segment, nearest first. Those of segment i are
+ * hits[first[i]] up to hits[first[i + 1]]. */
+template<typename S>
+void cast_segments_all(shape_manager_state<S> *state, const line *segments,
+                       uint num_segments, std::vector<shape_cast_hit> *hits,
+                       std::vector<uint> *first)
+{
+    update_pick_tree(state);
+    hits->clear();
+    first->resize(num_segments + 1);
+
+    struct cast_data {
+        S *shapes;
+        const line *segment;
+        std::vector<shape_cast_hit> *hits;
+    } data = { state->shapes, nullptr, hits };
+    auto cast = [](uint32_t user, void *data) {
+        cast_data *c = (cast_data *)data;
+        segment_hit hit;
+        line segment = *c->segment;
+        if (cast_segment(&segment, &*c->shapes[user], &hit))
+            c->hits->push_back(make_cast_hit(c->segment, user, &hit));
+        return -1.0f;   /* Every box along the way */
+    };
+
+    auto nearer = [](const shape_cast_hit &a, const shape_cast_hit &b) {
+        return a.dist < b.dist || (a.dist == b.dist && a.idx < b.idx);
+    };
+    for (uint i = 0; i < num_segments; i++) {
+        (*first)[i] = hits->size();
+        data.segment = &segments[i];
+        aabb_tree_cast(&state->pick_tree, &segments[i], cast, &data);
+        std::sort(hits->begin() + (*first)[i], hits->end(), nearer);
+    }
+    (*first)[num_segments] = hits->size();
+}
+
+/* Moves the shape under the start of the frame's drag by the whole drag,
+ * one pick and one window lookup however many events it took */
+template<typename S>
+bool try_drag_all_shapes(const input_frame *input,
+                         shape_manager_state<S> *state, space_2d *space)
+{
+    if (!input->dragging)
+        return false;
+
+    SDL_Window *window = SDL_GetWindowFromID(input->window_id);
+
+    uint idx;
+    point mp = sdl_point_to_space_2d(window, space, input->drag_start);
+    if (!pick_shape(state, mp, &idx))
+        return false;
+
+    vect dp = sdl_vec_to_space_2d(window, space, input->drag);
+    state->shapes[idx]->move(dp);
+    state->shapes[idx]->set_color(red);
+    bring_to_front(state, idx);
+    return true;
+}
+
 template<typename S>
 bool try_drag_all_shapes(SDL_Event *event, shape_manager_state<S> *state,
                          space_2d *space)
-{    
-    for (uint i = 1; i <= state->num_shapes; i++) {
-        uint idx = state->first_to_draw + state->num_shapes - i;
-        idx %= state->num_shapes;
+{
+    if (event->type != SDL_MOUSEMOTION || !(event->motion.state & SDL_BUTTON_LMASK))
+        return false;
+
+    input_frame input = {};
+    input_frame_add(&input, event);
+    return try_drag_all_shapes(&input, state, space);
+}
 
-        if (!try_drag_shape(event, state->shapes[idx], space))
+/* Sorted by layer, then by index, each fill right before its border */
+template<typename S>
+void draw_all_shapes(shape_manager_state<S> *state)
+{
+    render_queue *queue = &state->queue;
+    render_queue_clear(queue);
+
+    for (uint i = 0; i < state->num_shapes; i++) {
+        shape *shape = &*state->shapes[i];
+        if (!shape->is_enabled())
             continue;
 
-        state->shapes[idx]->set_color(red);
-        state->first_to_draw = (idx + 1) % state->num_shapes;
-        return true;
+        if (shape->has_fill())
+            render_queue_submit(queue, shape_sort_key(shape, i, false),
+                                i << 1);
+        if (shape->has_border())
+            render_queue_submit(queue, shape_sort_key(shape, i, true),
+                                i << 1 | SHAPE_ITEM_BORDER);
     }
 
-    return false;
+    render_queue_sort(queue);
+
+    begin_batch_2d();
+    for (uint32_t item : queue->items) {
+        shape *shape = &*state->shapes[item >> 1];
+        if (item & SHAPE_ITEM_BORDER)
+            shape->draw_outline();
+        else
+            shape->draw_fill();
+    }
+    flush_batch_2d();
 }
 
+/* Instances are gathered per mesh and drawn with one call per mesh type,
+ * so shapes of different types no longer keep their relative order.
+ * Shapes without an instance mesh follow through the batch. */
+void queue_shape_instance(shape *shape);
+void draw_queued_instances();
+
 template<typename S>
-void draw_all_shapes(shape_manager_state<S> *state)
+void draw_all_shapes_instanced(shape_manager_state<S> *state)
 {
-    for (uint i = 0; i < state->num_shapes; i++){
-        uint idx = (state->first_to_draw + i) % state->num_shapes;
-        state->shapes[idx]->draw();
+    for (uint i = 0; i < state->num_shapes; i++)
+        queue_shape_instance(&*state->shapes[i]);
+
+    draw_queued_instances();
+}
+
+/* Like draw_all_shapes_instanced, but only shapes changed since the last
+ * call get uploaded. Adding shapes re-uploads everything. Shapes without
+ * an instance mesh go through the batch every frame. */
+template<typename S>
+void draw_all_shapes_retained(shape_manager_state<S> *state)
+{
+    retained_shapes *retained = &state->retained;
+    if (!retained->ready || retained->slots.size() != state->num_shapes) {
+        reset_retained_shapes(retained);
+        for (uint i = 0; i < state->num_shapes; i++)
+            retain_shape(retained, &*state->shapes[i]);
+        retained->ready = true;
+    } else {
+        for (uint i = 0; i < state->num_shapes; i++)
+            update_retained_shape(retained, i, &*state->shapes[i]);
+    }
+
+    draw_retained_shapes(retained);
+    if (retained->batched.empty())
+        return;
+    begin_batch_2d();
+    for (uint i : retained->batched) {
+        shape *shape = &*state->shapes[i];
+        if (shape->is_enabled() && shape->has_fill())
+            shape->draw_fill();
+    }
+    for (uint i : retained->batched) {
+        shape *shape = &*state->shapes[i];
+        if (shape->is_enabled() && shape->has_border())
+            shape->draw_outline();
+    }
+    flush_batch_2d();
+}
+
+/* Brings the collision grid in line with the shapes, shapes that did not
+ * move leave it as it is. Shape indices are the users in pairs. */
+template<typename S>
+void update_broadphase(shape_manager_state<S> *state)
+{
+    spatial_hash *hash = &state->collisions;
+    /* Twice the average size, shapes then overlap few cells */
+    if (!(hash->cell_size > 0.0f))
+        spatial_hash_init(hash, 2.0f * average_shape_size(state));
+
+    for (uint i = state->num_shapes; i < state->proxies.size(); i++) {
+        if (state->proxies[i] != SPATIAL_HASH_NULL)
+            spatial_hash_remove(hash, state->proxies[i]);
+    }
+    state->proxies.resize(state->num_shapes, SPATIAL_HASH_NULL);
+
+    for (uint i = 0; i < state->num_shapes; i++) {
+        shape *shape = &*state->shapes[i];
+        uint32_t *proxy = &state->proxies[i];
+        if (!shape->is_enabled()) {
+            if (*proxy != SPATIAL_HASH_NULL)
+                spatial_hash_remove(hash, *proxy);
+            *proxy = SPATIAL_HASH_NULL;
+            continue;
+        }
+
+        aabb box = shape->get_aabb();
+        if (*proxy == SPATIAL_HASH_NULL)
+            *proxy = spatial_hash_insert(hash, &box, i);
+        else
+            spatial_hash_move(hash, *proxy, &box);
+    }
+}
+
+/* Pairs of enabled shapes that intersect, by index, lower index first */
+template<typename S>
+void find_colliding_shapes(shape_manager_state<S> *state,
+                           std::vector<broadphase_pair> *pairs)
+{
+    update_broadphase(state);
+    spatial_hash_find_pairs(&state->collisions, pairs);
+    pairs->resize(filter_intersecting_pairs(state->shapes, pairs->data(),
+                                            pairs->size()));
+}
+
+/* Shapes brought up to date by one task, and grid buckets searched and
+ * their pairs tested by one */
+#define PARALLEL_SHAPES_PER_TASK 1024
+#define PARALLEL_BUCKETS_PER_TASK 1024
+
+/* update_broadphase over the pool, with the world geometry of every shape
+ * brought up to date on the way. Boxes move in parallel, proxies are
+ * inserted and removed on the calling thread in index order, so the grid
+ * ends up as update_broadphase leaves it. */
+template<typename S>
+void update_broadphase_parallel(shape_manager_state<S> *state,
+                                thread_pool *pool)
+{
+    spatial_hash *hash = &state->collisions;
+    if (!(hash->cell_size > 0.0f))
+        spatial_hash_init(hash, 2.0f * average_shape_size(state));
+
+    for (uint i = state->num_shapes; i < state->proxies.size(); i++) {
+        if (state->proxies[i] != SPATIAL_HASH_NULL)
+            spatial_hash_remove(hash, state->proxies[i]);
+    }
+    state->proxies.resize(state->num_shapes, SPATIAL_HASH_NULL);
+
+    uint num_tasks = (state->num_shapes + PARALLEL_SHAPES_PER_TASK - 1) /
+                     PARALLEL_SHAPES_PER_TASK;
+    if (state->collision_tasks.size() < num_tasks)
+        state->collision_tasks.resize(num_tasks);
+
+    thread_pool_parallel_for(pool, num_tasks, 1,
+        [](uint32_t begin, uint32_t end, void *data) {
+            shape_manager_state<S> *state = (shape_manager_state<S> *)data;
+            for (uint32_t t = begin; t < end; t++) {
+                collision_task *task = &state->collision_tasks[t];
+                task->changed.clear();
+                task->moved = false;
+                uint last = std::min((t + 1) * PARALLEL_SHAPES_PER_TASK,
+                                     state->num_shapes);
+                for (uint i = t * PARALLEL_SHAPES_PER_TASK; i < last; i++) {
+                    shape *shape = &*state->shapes[i];
+                    aabb box = shape->get_aabb();
+                    uint32_t proxy = state->proxies[i];
+                    if (shape->is_enabled() && proxy != SPATIAL_HASH_NULL)
+                        task->moved |= spatial_hash_move_unsynced(
+                            &state->collisions, proxy, &box);
+                    else if (shape->is_enabled() || proxy != SPATIAL_HASH_NULL)
+                        task->changed.push_back(i);
+                }
+            }
+        }, state);
+
+    for (uint t = 0; t < num_tasks; t++) {
+        collision_task *task = &state->collision_tasks[t];
+        if (task->moved)
+            spatial_hash_invalidate(hash);
+        for (uint32_t i : task->changed) {
+            shape *shape = &*state->shapes[i];
+            uint32_t *proxy = &state->proxies[i];
+            if (shape->is_enabled()) {
+                aabb box = shape->get_aabb();
+                *proxy = spatial_hash_insert(hash, &box, i);
+            } else {
+                spatial_hash_remove(hash, *proxy);
+                *proxy = SPATIAL_HASH_NULL;
+            }
+        }
+    }
+}
+
+/* find_colliding_shapes with the work spread over the pool, the same pairs
+ * in the same order whatever the number of threads. Fixed bucket ranges
+ * are searched and their pairs tested in parallel, then joined in bucket
+ * order. */
+template<typename S>
+void find_colliding_shapes_parallel(shape_manager_state<S> *state,
+                                    thread_pool *pool,
+                                    std::vector<broadphase_pair> *pairs)
+{
+    update_broadphase_parallel(state, pool);
+    uint32_t num_buckets = spatial_hash_prepare(&state->collisions, pool);
+    uint32_t num_ranges = (num_buckets + PARALLEL_BUCKETS_PER_TASK - 1) /
+                          PARALLEL_BUCKETS_PER_TASK;
+    /* The large boxes get a task of their own, the last */
+    if (state->collision_tasks.size() < num_ranges + 1)
+        state->collision_tasks.resize(num_ranges + 1);
+
+    struct pair_job {
+        shape_manager_state<S> *state;
+        uint32_t num_ranges;
+        uint32_t num_buckets;
+    } job = { state, num_ranges, num_buckets };
+
+    thread_pool_parallel_for(pool, num_ranges + 1, 1,
+        [](uint32_t begin, uint32_t end, void *data) {
+            pair_job *job = (pair_job *)data;
+            shape_manager_state<S> *state = job->state;
+            for (uint32_t r = begin; r < end; r++) {
+                std::vector<broadphase_pair> *chunk =
+                    &state->collision_tasks[r].pairs;
+                chunk->clear();
+                if (r == job->num_ranges) {
+                    spatial_hash_find_large_pairs(&state->collisions, chunk);
+                } else {
+                    uint32_t first = r * PARALLEL_BUCKETS_PER_TASK;
+                    spatial_hash_find_pairs_in(&state->collisions, first,
+                        std::min(first + PARALLEL_BUCKETS_PER_TASK,
+                                 job->num_buckets), chunk);
+                }
+                chunk->resize(filter_intersecting_pairs(state->shapes,
+                                                        chunk->data(),
+                                                        chunk->size()));
+            }
+        }, &job);
+
+    pairs->clear();
+    for (uint32_t r = 0; r <= num_ranges; r++) {
+        std::vector<broadphase_pair> *chunk = &state->collision_tasks[r].pairs;
+        pairs->insert(pairs->end(), chunk->begin(), chunk->end());
     }
 }
 
+/* Contacts between enabled shapes that began or ended since the last call,
+ * by shape index. Only shapes that moved or changed shape since are looked
+ * at, pairs are tested with shapes_intersect. */
+template<typename S>
+void update_contacts(shape_manager_state<S> *state,
+                     std::vector<contact_event> *events)
+{
+    sweep_prune *sap = &state->contacts;
+    for (uint i = state->num_shapes; i < state->contact_proxies.size(); i++) {
+        if (state->contact_proxies[i] != SWEEP_PRUNE_NULL)
+            sweep_prune_remove(sap, state->contact_proxies[i]);
+    }
+    state->contact_proxies.resize(state->num_shapes, SWEEP_PRUNE_NULL);
+    state->contact_revisions.resize(state->num_shapes);
+
+    for (uint i = 0; i < state->num_shapes; i++) {
+        shape *shape = &*state->shapes[i];
+        uint32_t *proxy = &state->contact_proxies[i];
+        if (*proxy != SWEEP_PRUNE_NULL &&
+            state->contact_revisions[i] == shape->get_geometry_revision())
+            continue;
+
+        state->contact_revisions[i] = shape->get_geometry_revision();
+        if (!shape->is_enabled()) {
+            if (*proxy != SWEEP_PRUNE_NULL)
+                sweep_prune_remove(sap, *proxy);
+            *proxy = SWEEP_PRUNE_NULL;
+            continue;
+        }
+
+        aabb box = shape->get_aabb();
+        if (*proxy == SWEEP_PRUNE_NULL)
+            *proxy = sweep_prune_insert(sap, &box, i);
+        else
+            sweep_prune_move(sap, *proxy, &box);
+    }
+
+    auto test = [](uint32_t a, uint32_t b, void *data) {
+        shape_manager_state<S> *state = (shape_manager_state<S> *)data;
+        return shapes_intersect(&*state->shapes[a], &*state->shapes[b]);
+    };
+    sweep_prune_update(sap, events, test, state);
+}
+
 template<typename S>
 void assign_random_colors(shape_manager_state<S> *state)
 {
@@ -0,0 +1,723 @@
+#include "gl_sdl_shape_store.hpp"
+#include "gl_sdl_shape_obj.hpp"
+#include <algorithm>
+#include <cmath>
+
+/* Boxes in the collision grid are known by mesh and entry */
+#define STORE_MESH_SHIFT 30
+#define STORE_INDEX_MASK ((1u << STORE_MESH_SHIFT) - 1)
+
+static uint32_t store_user(uint32_t mesh, uint32_t index)
+{
+    return mesh << STORE_MESH_SHIFT | index;
+}
+
+/* Draw order: layer, then mesh, then order of adding */
+#define STORE_SERIAL_BITS 32
+#define STORE_KEY_MESH_BITS 8
+
+static sort_key draw_key(const shape_store_columns *c, uint32_t mesh,
+                         uint32_t i)
+{
+    sort_key key = c->layers[i];
+    key = key << STORE_KEY_MESH_BITS | mesh;
+    return key << STORE_SERIAL_BITS | c->serials[i];
+}
+
+template<typename T>
+static void swap_remove(std::vector<T> *column, uint32_t i)
+{
+    (*column)[i] = column->back();
+    column->pop_back();
+}
+
+static void clear_columns(shape_store_columns *c)
+{
+    *c = shape_store_columns();
+}
+
+void shape_store_clear(shape_store *store)
+{
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++)
+        clear_columns(&store->columns[mesh]);
+    store->slots.clear();
+    store->free_slots = SHAPE_STORE_NULL;
+    store->next_serial = 0;
+    store->stale = false;
+    store->dirty.clear();
+    render_queue_clear(&store->order);
+    store->order_stale = false;
+    /* The next update sizes the cells for the new shapes */
+    store->collisions = spatial_hash();
+}
+
+uint32_t shape_store_size(const shape_store *store)
+{
+    uint32_t size = 0;
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++)
+        size += store->columns[mesh].slots.size();
+    return size;
+}
+
+/* Only the box and proxy of the shape get redone by the next update */
+static void mark_dirty(shape_store *store, uint32_t slot)
+{
+    shape_store_slot *s = &store->slots[slot];
+    if (s->dirty)
+        return;
+    s->dirty = true;
+    store->dirty.push_back(slot);
+}
+
+static uint32_t clamp_layer(uint32_t layer)
+{
+    return std::min(layer, (uint32_t)SORT_MAX_LAYER);
+}
+
+static shape_handle add_entry(shape_store *store, instance_mesh mesh,
+                              const shape_instance *inst, uint8_t flags,
+                              uint32_t layer)
+{
+    shape_store_columns *c = &store->columns[mesh];
+    if (c->slots.size() > STORE_INDEX_MASK)
+        return null_shape_handle;
+
+    uint32_t slot = store->free_slots;
+    if (slot != SHAPE_STORE_NULL) {
+        store->free_slots = store->slots[slot].index;
+    } else {
+        slot = store->slots.size();
+        store->slots.push_back({ 1, NUM_INSTANCE_MESHES, 0, false });
+    }
+
+    shape_store_slot *s = &store->slots[slot];
+    s->mesh = mesh;
+    s->index = c->slots.size();
+
+    c->slots.push_back(slot);
+    c->offsets.push_back({ inst->offset[0], inst->offset[1] });
+    c->rotations.push_back({ inst->rot[0], inst->rot[1] });
+    c->anchors.push_back({ inst->pos[0], inst->pos[1] });
+    c->axes_x.push_back({ inst->axis_x[0], inst->axis_x[1] });
+    c->axes_y.push_back({ inst->axis_y[0], inst->axis_y[1] });
+    c->colors.push_back({ inst->color[0], inst->color[1], inst->color[2],
+                          inst->color[3] });
+    c->flags.push_back(flags);
+    c->layers.push_back(clamp_layer(layer));
+    c->serials.push_back(store->next_serial++);
+    c->world.push_back(quad());
+    c->boxes.push_back(aabb());
+    c->proxies.push_back(SPATIAL_HASH_NULL);
+
+    mark_dirty(store, slot);
+    store->order_stale = true;
+    return { slot, s->generation };
+}
+
+static shape_instance plain_instance(point pos, vect axis_x, vect axis_y,
+                                     color c)
+{
+    shape_instance inst = {
+        { pos.x, pos.y }, { axis_x.x, axis_x.y }, { axis_y.x, axis_y.y },
+        { 0.0f, 0.0f }, { 1.0f, 0.0f }, { c.r, c.g, c.b, c.a }, 0
+    };
+    return inst;
+}
+
+shape_handle shape_store_add_circle(shape_store *store, const circle *circle,
+                                    color c)
+{
+    float r = circle->radius;
+    shape_instance inst = plain_instance(circle->center, { r, 0.0f },
+                                         { 0.0f, r }, c);
+    return add_entry(store, INSTANCE_CIRCLE, &inst,
+                     SHAPE_STORE_ENABLED | SHAPE_STORE_FILL, 0);
+}
+
+shape_handle shape_store_add_rect(shape_store *store, const rect *rect,
+                                  color c)
+{
+    shape_instance inst = plain_instance({ rect->x, rect->y },
+                                         { rect->w, 0.0f },
+                                         { 0.0f, rect->h }, c);
+    return add_entry(store, INSTANCE_RECT, &inst,
+                     SHAPE_STORE_ENABLED | SHAPE_STORE_FILL, 0);
+}
+
+shape_handle shape_store_add_tri(shape_store *store, const tri *tri, color c)
+{
+    point p0 = tri->points[0];
+    point p1 = tri->points[1];
+    point p2 = tri->points[2];
+    shape_instance inst = plain_instance(p0, { p1.x - p0.x, p1.y - p0.y },
+                                         { p2.x - p0.x, p2.y - p0.y }, c);
+    return add_entry(store, INSTANCE_TRI, &inst,
+                     SHAPE_STORE_ENABLED | SHAPE_STORE_FILL, 0);
+}
+
+shape_handle shape_store_add_shape(shape_store *store, shape *shape)
+{
+    instance_mesh mesh = shape->get_instance_mesh();
+    if (mesh == INSTANCE_NONE)
+        return null_shape_handle;
+
+    shape_instance inst;
+    shape->get_instance(&inst);
+    uint8_t flags = (shape->is_enabled() ? SHAPE_STORE_ENABLED : 0) |
+                    (shape->has_fill() ? SHAPE_STORE_FILL : 0) |
+                    (shape->has_border() ? SHAPE_STORE_BORDER : 0);
+    return add_entry(store, mesh, &inst, flags, shape->get_layer());
+}
+
+int shape_store_add_instances(shape_store *store, instance_mesh mesh,
+                              const shape_instance *instances,
+                              const uint8_t *flags, const uint32_t *layers,
+                              uint32_t count)
+{
+    if (mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+    shape_store_columns *c = &store->columns[mesh];
+    uint32_t first = c->slots.size();
+    if (count > STORE_INDEX_MASK + 1 - first)
+        return -1;
+
+    /* Free slots get reused one by one, fresh ones column by column */
+    uint32_t i = 0;
+    for (; i < count && store->free_slots != SHAPE_STORE_NULL; i++)
+        add_entry(store, mesh, &instances[i], flags[i], layers ? layers[i] : 0);
+    if (i == count)
+        return 0;
+
+    uint32_t at = c->slots.size();
+    uint32_t n = count - i;
+    uint32_t slot = store->slots.size();
+    store->slots.resize(slot + n);
+    c->slots.resize(at + n);
+    for (uint32_t k = 0; k < n; k++) {
+        store->slots[slot + k] = { 1, (uint32_t)mesh, at + k, false };
+        c->slots[at + k] = slot + k;
+    }
+
+    instances += i;
+    c->offsets.resize(at + n);
+    c->rotations.resize(at + n);
+    c->anchors.resize(at + n);
+    c->axes_x.resize(at + n);
+    c->axes_y.resize(at + n);
+    c->colors.resize(at + n);
+    for (uint32_t k = 0; k < n; k++) {
+        const shape_instance *inst = &instances[k];
+        c->offsets[at + k] = { inst->offset[0], inst->offset[1] };
+        c->rotations[at + k] = { inst->rot[0], inst->rot[1] };
+        c->anchors[at + k] = { inst->pos[0], inst->pos[1] };
+        c->axes_x[at + k] = { inst->axis_x[0], inst->axis_x[1] };
+        c->axes_y[at + k] = { inst->axis_y[0], inst->axis_y[1] };
+        c->colors[at + k] = { inst->color[0], inst->color[1],
+                              inst->color[2], inst->color[3] };
+    }
+
+    c->flags.insert(c->flags.end(), flags + i, flags + count);
+    c->layers.resize(at + n, 0);
+    for (uint32_t k = 0; layers && k < n; k++)
+        c->layers[at + k] = clamp_layer(layers[i + k]);
+    c->serials.resize(at + n);
+    for (uint32_t k = 0; k < n; k++)
+        c->serials[at + k] = store->next_serial++;
+    c->world.resize(at + n);
+    c->boxes.resize(at + n);
+    c->proxies.resize(at + n, SPATIAL_HASH_NULL);
+
+    store->stale = true;
+    store->order_stale = true;
+    return 0;
+}
+
+template<typename T>
+static void append(std::vector<T> *column, const T *entries, uint32_t count)
+{
+    column->insert(column->end(), entries, entries + count);
+}
+
+int shape_store_add_arrays(shape_store *store, instance_mesh mesh,
+                           const shape_store_arrays *arrays, uint32_t count)
+{
+    if (mesh >= NUM_INSTANCE_MESHES)
+        return -1;
+    shape_store_columns *c = &store->columns[mesh];
+    uint32_t at = c->slots.size();
+    if (count > STORE_INDEX_MASK + 1 - at)
+        return -1;
+
+    uint32_t slot = store->slots.size();
+    store->slots.resize(slot + count);
+    c->slots.resize(at + count);
+    for (uint32_t k = 0; k < count; k++) {
+        store->slots[slot + k] = { 1, (uint32_t)mesh, at + k, false };
+        c->slots[at + k] = slot + k;
+    }
+
+    append(&c->offsets, arrays->offsets, count);
+    append(&c->rotations, arrays->rotations, count);
+    append(&c->anchors, arrays->anchors, count);
+    append(&c->axes_x, arrays->axes_x, count);
+    append(&c->axes_y, arrays->axes_y, count);
+    append(&c->colors, arrays->colors, count);
+    append(&c->flags, arrays->flags, count);
+    if (arrays->layers) {
+        append(&c->layers, arrays->layers, count);
+        for (uint32_t k = at; k < at + count; k++)
+            c->layers[k] = clamp_layer(c->layers[k]);
+    } else {
+        c->layers.resize(at + count, 0);
+    }
+    c->serials.resize(at + count);
+    for (uint32_t k = 0; k < count; k++)
+        c->serials[at + k] = store->next_serial++;
+    c->world.resize(at + count);
+    c->boxes.resize(at + count);
+    c->proxies.resize(at + count, SPATIAL_HASH_NULL);
+
+    store->stale = true;
+    store->order_stale = true;
+    return 0;
+}
+
+bool shape_store_valid(const shape_store *store, shape_handle handle)
+{
+    return handle.slot < store->slots.size() &&
+           store->slots[handle.slot].generation == handle.generation &&
+           store->slots[handle.slot].mesh != NUM_INSTANCE_MESHES;
+}
+
+shape_store_columns *shape_store_locate(shape_store *store,
+                                        shape_handle handle, uint32_t *index)
+{
+    if (!shape_store_valid(store, handle))
+        return NULL;
+
+    const shape_store_slot *s = &store->slots[handle.slot];
+    *index = s->index;
+    return &store->columns[s->mesh];
+}
+
+int shape_store_remove(shape_store *store, shape_handle handle)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+
+    if (c->proxies[i] != SPATIAL_HASH_NULL)
+        spatial_hash_remove(&store->collisions, c->proxies[i]);
+
+    /* The last shape of the mesh fills the gap */
+    uint32_t last = c->slots.size() - 1;
+    store->slots[c->slots[last]].index = i;
+    if (c->proxies[last] != SPATIAL_HASH_NULL)
+        spatial_hash_set_user(&store->collisions, c->proxies[last],
+                              store_user(store->slots[handle.slot].mesh, i));
+    swap_remove(&c->slots, i);
+    swap_remove(&c->offsets, i);
+    swap_remove(&c->rotations, i);
+    swap_remove(&c->anchors, i);
+    swap_remove(&c->axes_x, i);
+    swap_remove(&c->axes_y, i);
+    swap_remove(&c->colors, i);
+    swap_remove(&c->flags, i);
+    swap_remove(&c->layers, i);
+    swap_remove(&c->serials, i);
+    swap_remove(&c->world, i);
+    swap_remove(&c->boxes, i);
+    swap_remove(&c->proxies, i);
+
+    shape_store_slot *s = &store->slots[handle.slot];
+    if (++s->generation == 0)
+        s->generation = 1;
+    s->mesh = NUM_INSTANCE_MESHES;
+    s->index = store->free_slots;
+    store->free_slots = handle.slot;
+    store->order_stale = true;
+    return 0;
+}
+
+int shape_store_move(shape_store *store, shape_handle handle, vect v)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+
+    c->offsets[i].x += v.x;
+    c->offsets[i].y += v.y;
+    mark_dirty(store, handle.slot);
+    return 0;
+}
+
+/* Around the offset like shape::rotate, circles do not turn */
+int shape_store_rotate(shape_store *store, shape_handle handle, float angle)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+    if (c == &store->columns[INSTANCE_CIRCLE])
+        return 0;
+
+    float cs = cosf(angle);
+    float sn = sinf(angle);
+    vect r = c->rotations[i];
+    r = { cs * r.x - sn * r.y, sn * r.x + cs * r.y };
+    float len = sqrtf(r.x * r.x + r.y * r.y);     /* Against drift */
+    c->rotations[i] = { r.x / len, r.y / len };
+    mark_dirty(store, handle.slot);
+    return 0;
+}
+
+int shape_store_set_color(shape_store *store, shape_handle handle, color col)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+
+    c->colors[i] = col;
+    return 0;
+}
+
+int shape_store_set_flags(shape_store *store, shape_handle handle,
+                          uint8_t flags)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+
+    c->flags[i] = flags;
+    mark_dirty(store, handle.slot);
+    return 0;
+}
+
+int shape_store_set_layer(shape_store *store, shape_handle handle,
+                          uint32_t layer)
+{
+    uint32_t i;
+    shape_store_columns *c = shape_store_locate(store, handle, &i);
+    if (!c)
+        return -1;
+
+    c->layers[i] = clamp_layer(layer);
+    store->order_stale = true;
+    return 0;
+}
+
+/* Where mesh point (mx, my) of shape i lands */
+static point place(const shape_store_columns *c, uint32_t i, float mx,
+                   float my)
+{
+    point a = c->anchors[i];
+    vect ax = c->axes_x[i];
+    vect ay = c->axes_y[i];
+    vect r = c->rotations[i];
+    point o = c->offsets[i];
+    float x = a.x + mx * ax.x + my * ay.x;
+    float y = a.y + mx * ax.y + my * ay.y;
+    return { r.x * x - r.y * y + o.x, r.y * x + r.x * y + o.y };
+}
+
+static circle world_circle(const quad *w)
+{
+    return { w->points[0], w->points[1].x };
+}
+
+static tri world_tri(const quad *w)
+{
+    return { { w->points[0], w->points[1], w->points[2] } };
+}
+
+static void update_circle(shape_store_columns *c, uint32_t i)
+{
+    point a = c->anchors[i];
+    point o = c->offsets[i];
+    vect ax = c->axes_x[i];
+    circle w = { { a.x + o.x, a.y + o.y }, sqrtf(ax.x * ax.x + ax.y * ax.y) };
+    c->world[i] = { { w.center, { w.radius, 0.0f } } };
+    c->boxes[i] = bounding_box(&w);
+}
+
+static void update_rect(shape_store_columns *c, uint32_t i)
+{
+    c->world[i] = { { place(c, i, 0.0f, 0.0f), place(c, i, 1.0f, 0.0f),
+                      place(c, i, 1.0f, 1.0f), place(c, i, 0.0f, 1.0f) } };
+    c->boxes[i] = bounding_box(c->world[i].points, 4);
+}
+
+static void update_tri(shape_store_columns *c, uint32_t i)
+{
+    c->world[i] = { { place(c, i, 0.0f, 0.0f), place(c, i, 1.0f, 0.0f),
+                      place(c, i, 0.0f, 1.0f) } };
+    c->boxes[i] = bounding_box(c->world[i].points, 3);
+}
+
+/* One pass per mesh, so the loops stay free of branches on the mesh */
+static void update_world(shape_store *store)
+{
+    shape_store_columns *c = &store->columns[INSTANCE_CIRCLE];
+    for (uint32_t i = 0; i < c->slots.size(); i++)
+        update_circle(c, i);
+
+    c = &store->columns[INSTANCE_RECT];
+    for (uint32_t i = 0; i < c->slots.size(); i++)
+        update_rect(c, i);
+
+    c = &store->columns[INSTANCE_TRI];
+    for (uint32_t i = 0; i < c->slots.size(); i++)
+        update_tri(c, i);
+}
+
+static void update_proxy(shape_store *store, uint32_t mesh, uint32_t i)
+{
+    shape_store_columns *c = &store->columns[mesh];
+    spatial_hash *hash = &store->collisions;
+    uint32_t *proxy = &c->proxies[i];
+    if (!(c->flags[i] & SHAPE_STORE_ENABLED)) {
+        if (*proxy != SPATIAL_HASH_NULL)
+            spatial_hash_remove(hash, *proxy);
+        *proxy = SPATIAL_HASH_NULL;
+    } else if (*proxy == SPATIAL_HASH_NULL) {
+        *proxy = spatial_hash_insert(hash, &c->boxes[i], store_user(mesh, i));
+    } else {
+        spatial_hash_move(hash, *proxy, &c->boxes[i]);
+    }
+}
+
+static float average_box_size(const shape_store *store)
+{
+    float total = 0.0f;
+    uint32_t num = 0;
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const shape_store_columns *c = &store->columns[mesh];
+        for (const aabb &box : c->boxes)
+            total += std::max(box.max.x - box.min.x, box.max.y - box.min.y);
+        num += c->boxes.size();
+    }
+
+    float size = num ? total / num : 0.0f;
+    return size > 0.0f ? size : 1.0f;
+}
+
+void shape_store_touch(shape_store *store)
+{
+    store->stale = true;
+    store->order_stale = true;
+}
+
+void shape_store_update(shape_store *store)
+{
+    spatial_hash *hash = &store->collisions;
+    if (store->stale || !(hash->cell_size > 0.0f)) {
+        update_world(store);
+        if (!(hash->cell_size > 0.0f))
+            spatial_hash_init(hash, 2.0f * average_box_size(store));
+        for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+            for (uint32_t i = 0; i < store->columns[mesh].slots.size(); i++)
+                update_proxy(store, mesh, i);
+        }
+    } else {
+        for (uint32_t slot : store->dirty) {
+            const shape_store_slot *s = &store->slots[slot];
+            shape_store_columns *c = &store->columns[s->mesh];
+            if (s->mesh == INSTANCE_CIRCLE)
+                update_circle(c, s->index);
+            else if (s->mesh == INSTANCE_RECT)
+                update_rect(c, s->index);
+            else if (s->mesh == INSTANCE_TRI)
+                update_tri(c, s->index);
+            else
+                continue;   /* Removed since */
+            update_proxy(store, s->mesh, s->index);
+        }
+    }
+
+    for (uint32_t slot : store->dirty)
+        store->slots[slot].dirty = false;
+    store->dirty.clear();
+    store->stale = false;
+}
+
+static bool contains(uint32_t mesh, const quad *w, point p)
+{
+    if (mesh == INSTANCE_CIRCLE) {
+        circle wc = world_circle(w);
+        return point_in_circle(p, &wc);
+    }
+    if (mesh == INSTANCE_RECT)
+        return point_in_convex(p, w->points, 4);
+    tri wt = world_tri(w);
+    return point_in_tri(p, &wt);
+}
+
+static shape_handle handle_of(const shape_store *store, uint32_t slot)
+{
+    return { slot, store->slots[slot].generation };
+}
+
+shape_handle shape_store_pick(shape_store *store, point p)
+{
+    shape_store_update(store);
+
+    /* Fills only, as containment goes by them */
+    shape_handle best = null_shape_handle;
+    sort_key best_key = 0;
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const shape_store_columns *c = &store->columns[mesh];
+        for (uint32_t i = 0; i < c->slots.size(); i++) {
+            if (!(c->flags[i] & SHAPE_STORE_ENABLED) ||
+                !point_in_aabb(p, &c->boxes[i]))
+                continue;
+            sort_key key = draw_key(c, mesh, i);
+            bool above = best.slot == SHAPE_STORE_NULL || key > best_key;
+            if (!above || !contains(mesh, &c->world[i], p))
+                continue;
+
+            best = handle_of(store, c->slots[i]);
+            best_key = key;
+        }
+    }
+
+    return best;
+}
+
+typedef bool (*store_test)(const quad *a, const quad *b);
+
+static bool circle_circle(const quad *a, const quad *b)
+{
+    circle wa = world_circle(a);
+    circle wb = world_circle(b);
+    return intersect(&wa, &wb);
+}
+
+static bool circle_rect(const quad *a, const quad *b)
+{
+    circle wa = world_circle(a);
+    quad wb = *b;
+    return intersect(&wa, &wb);
+}
+
+static bool circle_tri(const quad *a, const quad *b)
+{
+    circle wa = world_circle(a);
+    tri wb = world_tri(b);
+    return intersect(&wa, &wb);
+}
+
+static bool rect_rect(const quad *a, const quad *b)
+{
+    quad wa = *a;
+    quad wb = *b;
+    return intersect(&wa, &wb);
+}
+
+static bool rect_tri(const quad *a, const quad *b)
+{
+    quad wa = *a;
+    tri wb = world_tri(b);
+    return intersect(&wb, &wa);
+}
+
+static bool tri_tri(const quad *a, const quad *b)
+{
+    tri wa = world_tri(a);
+    tri wb = world_tri(b);
+    return intersect(&wa, &wb);
+}
+
+/* By mesh, the first no later than the second */
+static const store_test store_tests[NUM_INSTANCE_MESHES][NUM_INSTANCE_MESHES] = {
+    { circle_circle, circle_rect, circle_tri },
+    { NULL, rect_rect, rect_tri },
+    { NULL, NULL, tri_tri },
+};
+
+void shape_store_find_pairs(shape_store *store,
+                            std::vector<shape_handle_pair> *pairs)
+{
+    pairs->clear();
+    shape_store_update(store);
+    spatial_hash_find_pairs(&store->collisions, &store->candidates);
+
+    /* Users sort by mesh, so the first mesh is never the later one */
+    for (const broadphase_pair &pair : store->candidates) {
+        const shape_store_columns *ca = &store->columns[pair.a >> STORE_MESH_SHIFT];
+        const shape_store_columns *cb = &store->columns[pair.b >> STORE_MESH_SHIFT];
+        uint32_t i = pair.a & STORE_INDEX_MASK;
+        uint32_t j = pair.b & STORE_INDEX_MASK;
+        store_test test = store_tests[pair.a >> STORE_MESH_SHIFT]
+                                     [pair.b >> STORE_MESH_SHIFT];
+        if (!test(&ca->world[i], &cb->world[j]))
+            continue;
+
+        uint32_t a = ca->slots[i];
+        uint32_t b = cb->slots[j];
+        pairs->push_back({ handle_of(store, std::min(a, b)),
+                           handle_of(store, std::max(a, b)) });
+    }
+}
+
+static void sort_draw_order(shape_store *store)
+{
+    render_queue *order = &store->order;
+    render_queue_clear(order);
+    for (uint32_t mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const shape_store_columns *c = &store->columns[mesh];
+        for (uint32_t i = 0; i < c->slots.size(); i++)
+            render_queue_submit(order, draw_key(c, mesh, i),
+                                store_user(mesh, i));
+    }
+
+    render_queue_sort(order);
+    store->order_stale = false;
+}
+
+void shape_store_draw(shape_store *store)
+{
+    if (store->order_stale)
+        sort_draw_order(store);
+
+    /* A run of one mesh goes out as one draw */
+    std::vector<shape_instance> &instances = store->instances;
+    instances.clear();
+    uint32_t run_mesh = NUM_INSTANCE_MESHES;
+    for (uint32_t user : store->order.items) {
+        uint32_t mesh = user >> STORE_MESH_SHIFT;
+        uint32_t i = user & STORE_INDEX_MASK;
+        if (mesh != run_mesh) {
+            if (!instances.empty())
+                draw_instances((instance_mesh)run_mesh, instances.data(),
+                               instances.size());
+            instances.clear();
+            run_mesh = mesh;
+        }
+
+        const shape_store_columns *c = &store->columns[mesh];
+        uint8_t flags = c->flags[i];
+        if (!(flags & SHAPE_STORE_ENABLED) ||
+            !(flags & (SHAPE_STORE_FILL | SHAPE_STORE_BORDER)))
+            continue;
+
+        color col = c->colors[i];
+        shape_instance inst = {
+            { c->anchors[i].x, c->anchors[i].y },
+            { c->axes_x[i].x, c->axes_x[i].y },
+            { c->axes_y[i].x, c->axes_y[i].y },
+            { c->offsets[i].x, c->offsets[i].y },
+            { c->rotations[i].x, c->rotations[i].y },
+            { col.r, col.g, col.b, col.a },
+            (Uint32)(flags & (SHAPE_STORE_FILL | SHAPE_STORE_BORDER))
+        };
+        instances.push_back(inst);
+    }
+
+    if (!instances.empty())
+        draw_instances((instance_mesh)run_mesh, instances.data(),
+                       instances.size());
+}
@@ -0,0 +1,156 @@
+#ifndef GL_SDL_SHAPE_STORE_H
+#define GL_SDL_SHAPE_STORE_H
+
+#include "gl_sdl_2d.hpp"
+#include "gl_sdl_broadphase.hpp"
+#include "gl_sdl_render_queue.hpp"
+#include <stdint.h>
+#include <vector>
+
+class shape;
+
+#define SHAPE_STORE_NULL 0xffffffffu
+
+/* Fill and border as for instances, disabled shapes are skipped by every
+ * pass */
+#define SHAPE_STORE_FILL INSTANCE_FILL
+#define SHAPE_STORE_BORDER INSTANCE_BORDER
+#define SHAPE_STORE_ENABLED 4u
+
+/* Stays valid until the shape is removed, a handle of a removed shape
+ * never matches the shape reusing its slot */
+struct shape_handle {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+static const shape_handle null_shape_handle = { SHAPE_STORE_NULL, 0 };
+
+struct shape_handle_pair {
+    shape_handle a;     /* Lower slot */
+    shape_handle b;
+};
+
+/* One entry per shape of an instance mesh, shape i being entry i of every
+ * column. Geometry is kept the way instances are drawn: mesh point m lands
+ * at R(rotation) * (anchor + m.x * axis_x + m.y * axis_y) + offset, circles
+ * do not turn. */
+struct shape_store_columns {
+    std::vector<uint32_t> slots;        /* Handle slot of each shape */
+    std::vector<point> offsets;
+    std::vector<vect> rotations;        /* Cosine and sine */
+    std::vector<point> anchors;
+    std::vector<vect> axes_x;
+    std::vector<vect> axes_y;
+    std::vector<color> colors;
+    std::vector<uint8_t> flags;
+    std::vector<uint32_t> layers;
+    std::vector<uint32_t> serials;      /* Order of adding */
+    /* By shape_store_update: corners of rects and tris, tris leaving the
+     * last one out, for circles the center then the radius in x */
+    std::vector<quad> world;
+    std::vector<aabb> boxes;
+    std::vector<uint32_t> proxies;      /* In the store's spatial hash */
+};
+
+struct shape_store_slot {
+    uint32_t generation;
+    uint32_t mesh;
+    uint32_t index;         /* Into the columns, next free slot when free */
+    bool dirty;             /* In the store's dirty list */
+};
+
+/* Circles, rects and tris in contiguous columns per mesh, so that drawing,
+ * picking and collisions are linear passes without virtual calls. Removing
+ * moves the last shape of the mesh into the gap. Up to 2^30 shapes of each
+ * mesh.
+ *
+ * An API of its own next to the shape classes: shape_manager_state and the
+ * shape objects never go through a store, shape_store_add_shape copies an
+ * object in and the copy is not kept in step with it. */
+struct shape_store {
+    shape_store_columns columns[NUM_INSTANCE_MESHES];
+    std::vector<shape_store_slot> slots;
+    uint32_t free_slots = SHAPE_STORE_NULL;
+    uint32_t next_serial = 0;
+    bool stale = false;     /* Every box behind the shapes */
+    std::vector<uint32_t> dirty;    /* Slots of shapes whose box is behind */
+    spatial_hash collisions;
+    std::vector<broadphase_pair> candidates;
+    /* Draw order of all shapes, items are mesh and entry as in the grid */
+    render_queue order;
+    bool order_stale = false;
+    std::vector<shape_instance> instances;
+};
+
+void shape_store_clear(shape_store *store);
+uint32_t shape_store_size(const shape_store *store);
+
+/* Enabled and filled, without a transform */
+shape_handle shape_store_add_circle(shape_store *store, const circle *circle,
+                                    color c);
+shape_handle shape_store_add_rect(shape_store *store, const rect *rect,
+                                  color c);
+shape_handle shape_store_add_tri(shape_store *store, const tri *tri, color c);
+/* Copies a circle, rect or tri object with its transform, style and layer.
+ * Polygons have no instance mesh and give null_shape_handle. Later changes
+ * of the object do not reach the store. */
+shape_handle shape_store_add_shape(shape_store *store, shape *shape);
+/* Appends count shapes of one mesh in array order, as many adds would.
+ * flags are the SHAPE_STORE ones, layers NULL puts them all on layer 0.
+ * Returns -1 when the mesh would be full. The next update redoes every
+ * box. */
+int shape_store_add_instances(shape_store *store, instance_mesh mesh,
+                              const shape_instance *instances,
+                              const uint8_t *flags, const uint32_t *layers,
+                              uint32_t count);
+/* count entries of each column, laid out as in shape_store_columns */
+struct shape_store_arrays {
+    const point *offsets;
+    const vect *rotations;
+    const point *anchors;
+    const vect *axes_x;
+    const vect *axes_y;
+    const color *colors;
+    const uint8_t *flags;
+    const uint32_t *layers;     /* NULL for layer 0 */
+};
+
+/* shape_store_add_instances for arrays already in column form, each one
+ * copied over in bulk. Takes fresh slots even when some are free. */
+int shape_store_add_arrays(shape_store *store, instance_mesh mesh,
+                           const shape_store_arrays *arrays, uint32_t count);
+int shape_store_remove(shape_store *store, shape_handle handle);
+
+bool shape_store_valid(const shape_store *store, shape_handle handle);
+/* Columns and entry of a shape, for loops of their own. NULL for stale
+ * handles. */
+shape_store_columns *shape_store_locate(shape_store *store,
+                                        shape_handle handle, uint32_t *index);
+
+int shape_store_move(shape_store *store, shape_handle handle, vect v);
+int shape_store_rotate(shape_store *store, shape_handle handle, float angle);
+int shape_store_set_color(shape_store *store, shape_handle handle, color c);
+int shape_store_set_flags(shape_store *store, shape_handle handle,
+                          uint8_t flags);
+/* Clamped to SORT_MAX_LAYER like the layers of shape objects */
+int shape_store_set_layer(shape_store *store, shape_handle handle,
+                          uint32_t layer);
+
+/* World boxes and the collision grid of the shapes changed since, queries
+ * call it when needed. Columns changed through shape_store_locate need
+ * shape_store_touch first, the update then redoes every box. */
+void shape_store_update(shape_store *store);
+void shape_store_touch(shape_store *store);
+
+/* Enabled shape containing p drawn last by shape_store_draw.
+ * null_shape_handle if there is none. */
+shape_handle shape_store_pick(shape_store *store, point p);
+/* Intersecting enabled shapes, each pair once, pairs is cleared first */
+void shape_store_find_pairs(shape_store *store,
+                            std::vector<shape_handle_pair> *pairs);
+/* By layer, within a layer one instanced draw per mesh with fills then
+ * borders, shapes of a mesh in the order they were added */
+void shape_store_draw(shape_store *store);
+
+#endif
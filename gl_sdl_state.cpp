@@ -0,0 +1,217 @@
+#include "gl_sdl_state.hpp"
+
+#define MAX_TEX_UNITS 16
+#define ARRAY_SIZE(x) ((sizeof(x)) / (sizeof(*x)))
+
+static const GLenum tracked_caps[] = { GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST,
+                                       GL_SCISSOR_TEST, GL_STENCIL_TEST,
+                                       GL_POLYGON_OFFSET_FILL,
+                                       GL_RASTERIZER_DISCARD };
+
+static const GLenum tracked_buffers[] = { GL_ARRAY_BUFFER,
+                                          GL_ELEMENT_ARRAY_BUFFER,
+                                          GL_UNIFORM_BUFFER,
+                                          GL_PIXEL_UNPACK_BUFFER,
+                                          GL_COPY_READ_BUFFER,
+                                          GL_COPY_WRITE_BUFFER };
+
+static const GLenum tracked_tex_targets[] = { GL_TEXTURE_2D,
+                                              GL_TEXTURE_CUBE_MAP,
+                                              GL_TEXTURE_3D,
+                                              GL_TEXTURE_2D_ARRAY };
+
+template<typename T>
+struct cached {
+    T value;
+    bool known = false;
+};
+
+static struct {
+    cached<GLuint> program;
+    cached<GLuint> vao;
+    cached<GLuint> buffers[ARRAY_SIZE(tracked_buffers)];
+    cached<GLenum> active_unit;
+    cached<GLuint> textures[MAX_TEX_UNITS][ARRAY_SIZE(tracked_tex_targets)];
+    cached<bool> caps[ARRAY_SIZE(tracked_caps)];
+    cached<GLfloat> line_width;
+    cached<GLint[4]> viewport;
+    gl_state_stats stats;
+} state;
+
+static int index_of(const GLenum *list, uint len, GLenum value)
+{
+    for (uint i = 0; i < len; i++) {
+        if (list[i] == value)
+            return i;
+    }
+
+    return -1;
+}
+
+/* Returns true when the call has to be issued and records the new value */
+template<typename T>
+static bool update(cached<T> *entry, T value)
+{
+    if (entry->known && entry->value == value) {
+        state.stats.elided++;
+        return false;
+    }
+
+    entry->value = value;
+    entry->known = true;
+    state.stats.issued++;
+    return true;
+}
+
+void gl_state_invalidate()
+{
+    gl_state_stats stats = state.stats;
+    state = {};
+    state.stats = stats;
+}
+
+gl_state_stats get_gl_state_stats()
+{
+    return state.stats;
+}
+
+void reset_gl_state_stats()
+{
+    state.stats = {};
+}
+
+void gl_state_use_program(GLuint program)
+{
+    if (update(&state.program, program))
+        glUseProgram(program);
+}
+
+void gl_state_bind_vertex_array(GLuint vao)
+{
+    if (!update(&state.vao, vao))
+        return;
+
+    glBindVertexArray(vao);
+    /* The element buffer binding belongs to the VAO */
+    int idx = index_of(tracked_buffers, ARRAY_SIZE(tracked_buffers),
+                       GL_ELEMENT_ARRAY_BUFFER);
+    state.buffers[idx].known = false;
+}
+
+void gl_state_bind_buffer(GLenum target, GLuint buffer)
+{
+    int idx = index_of(tracked_buffers, ARRAY_SIZE(tracked_buffers), target);
+    if (idx < 0) {
+        state.stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (update(&state.buffers[idx], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void gl_state_active_texture(GLenum unit)
+{
+    if (update(&state.active_unit, unit))
+        glActiveTexture(unit);
+}
+
+void gl_state_bind_texture(GLenum target, GLuint texture)
+{
+    int idx = index_of(tracked_tex_targets, ARRAY_SIZE(tracked_tex_targets),
+                       target);
+    if (!state.active_unit.known) {
+        GLint unit;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+        state.active_unit.value = unit;
+        state.active_unit.known = true;
+    }
+
+    GLuint unit = state.active_unit.value - GL_TEXTURE0;
+    if (idx < 0 || unit >= MAX_TEX_UNITS) {
+        state.stats.issued++;
+        glBindTexture(target, texture);
+        return;
+    }
+
+    if (update(&state.textures[unit][idx], texture))
+        glBindTexture(target, texture);
+}
+
+void gl_state_set(GLenum cap, bool enabled)
+{
+    int idx = index_of(tracked_caps, ARRAY_SIZE(tracked_caps), cap);
+    if (idx >= 0 && !update(&state.caps[idx], enabled))
+        return;
+    if (idx < 0)
+        state.stats.issued++;
+
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void gl_state_enable(GLenum cap)
+{
+    gl_state_set(cap, true);
+}
+
+void gl_state_disable(GLenum cap)
+{
+    gl_state_set(cap, false);
+}
+
+void gl_state_line_width(GLfloat width)
+{
+    if (update(&state.line_width, width))
+        glLineWidth(width);
+}
+
+GLfloat gl_state_get_line_width()
+{
+    if (!state.line_width.known) {
+        glGetFloatv(GL_LINE_WIDTH, &state.line_width.value);
+        state.line_width.known = true;
+    }
+
+    return state.line_width.value;
+}
+
+void gl_state_viewport(GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    GLint *vp = state.viewport.value;
+    if (state.viewport.known && vp[0] == x && vp[1] == y &&
+        vp[2] == w && vp[3] == h) {
+        state.stats.elided++;
+        return;
+    }
+
+    vp[0] = x;
+    vp[1] = y;
+    vp[2] = w;
+    vp[3] = h;
+    state.viewport.known = true;
+    state.stats.issued++;
+    glViewport(x, y, w, h);
+}
+
+void gl_state_get_viewport(GLint *viewport)
+{
+    if (!state.viewport.known) {
+        glGetIntegerv(GL_VIEWPORT, state.viewport.value);
+        state.viewport.known = true;
+    }
+
+    for (uint i = 0; i < 4; i++)
+        viewport[i] = state.viewport.value[i];
+}
+
+void gl_state_clear(GLbitfield mask)
+{
+    /* Always issued: whether a clear can be skipped depends on the depth and
+     * color masks and on draws made behind the cache's back */
+    state.stats.issued++;
+    glClear(mask);
+}
@@ -0,0 +1,38 @@
+#ifndef GL_SDL_STATE_H
+#define GL_SDL_STATE_H
+
+#include "gl_sdl_utils.hpp"
+
+/* Cache of GL state set through the functions below, calls that would not
+ * change anything are dropped. Code that changes the same state with plain
+ * GL calls has to call gl_state_invalidate() afterwards. */
+
+struct gl_state_stats
+{
+    unsigned long issued = 0;
+    unsigned long elided = 0;
+};
+
+void gl_state_invalidate();
+gl_state_stats get_gl_state_stats();
+void reset_gl_state_stats();
+
+void gl_state_use_program(GLuint program);
+void gl_state_bind_vertex_array(GLuint vao);
+void gl_state_bind_buffer(GLenum target, GLuint buffer);
+void gl_state_active_texture(GLenum unit);
+void gl_state_bind_texture(GLenum target, GLuint texture);
+
+void gl_state_enable(GLenum cap);
+void gl_state_disable(GLenum cap);
+void gl_state_set(GLenum cap, bool enabled);
+
+void gl_state_line_width(GLfloat width);
+GLfloat gl_state_get_line_width();
+
+void gl_state_viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+void gl_state_get_viewport(GLint *viewport);
+
+void gl_state_clear(GLbitfield mask);
+
+#endif
@@ -0,0 +1,451 @@
+#include "gl_sdl_sweep_prune.hpp"
+#include <algorithm>
+
+#define EMPTY_KEY 0xffffffffffffffffull
+#define MIN_PAIR_SLOTS 64
+
+static uint64_t pair_key(uint32_t a, uint32_t b)
+{
+    return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+
+static uint32_t pair_slot(const sweep_prune *sap, uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key & (sap->pairs.size() - 1);
+}
+
+/* Linear probing, returns the slot holding key or the empty one ending
+ * its run */
+static uint32_t find_pair(const sweep_prune *sap, uint64_t key)
+{
+    uint32_t mask = sap->pairs.size() - 1;
+    uint32_t slot = pair_slot(sap, key);
+    while (sap->pairs[slot].key != key && sap->pairs[slot].key != EMPTY_KEY)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void insert_pair(sweep_prune *sap, uint64_t key, bool touching);
+
+/* At most half full */
+static void grow_pairs(sweep_prune *sap)
+{
+    if (2 * (sap->num_pairs + 1) <= sap->pairs.size())
+        return;
+
+    std::vector<sweep_prune_pair> old;
+    old.swap(sap->pairs);
+    sap->pairs.assign(std::max<size_t>(MIN_PAIR_SLOTS, 2 * old.size()),
+                      { EMPTY_KEY, false });
+    sap->num_pairs = 0;
+    for (auto &pair : old) {
+        if (pair.key != EMPTY_KEY)
+            insert_pair(sap, pair.key, pair.touching);
+    }
+}
+
+static void insert_pair(sweep_prune *sap, uint64_t key, bool touching)
+{
+    grow_pairs(sap);
+    uint32_t slot = find_pair(sap, key);
+    sap->pairs[slot] = { key, touching };
+    sap->num_pairs++;
+}
+
+/* Pulls later members of the probe run back into the hole */
+static void erase_pair(sweep_prune *sap, uint32_t hole)
+{
+    uint32_t mask = sap->pairs.size() - 1;
+    uint32_t slot = hole;
+    for (;;) {
+        slot = (slot + 1) & mask;
+        if (sap->pairs[slot].key == EMPTY_KEY)
+            break;
+
+        uint32_t home = pair_slot(sap, sap->pairs[slot].key);
+        /* Stays when its home lies cyclically within (hole, slot] */
+        if (((slot - home) & mask) < ((slot - hole) & mask))
+            continue;
+        sap->pairs[hole] = sap->pairs[slot];
+        hole = slot;
+    }
+
+    sap->pairs[hole].key = EMPTY_KEY;
+    sap->num_pairs--;
+}
+
+/* Pair set and the lists of both proxies together */
+static void add_pair(sweep_prune *sap, uint64_t key, bool touching)
+{
+    insert_pair(sap, key, touching);
+    sap->proxies[key >> 32].others.push_back(key & 0xffffffffu);
+    sap->proxies[key & 0xffffffffu].others.push_back(key >> 32);
+}
+
+static void drop_other(sweep_prune_proxy *p, uint32_t other)
+{
+    auto it = std::find(p->others.begin(), p->others.end(), other);
+    *it = p->others.back();
+    p->others.pop_back();
+}
+
+static void drop_pair(sweep_prune *sap, uint32_t slot)
+{
+    uint64_t key = sap->pairs[slot].key;
+    drop_other(&sap->proxies[key >> 32], key & 0xffffffffu);
+    drop_other(&sap->proxies[key & 0xffffffffu], key >> 32);
+    erase_pair(sap, slot);
+}
+
+/* Ties put min before max, so touching boxes count as overlapping */
+static bool endpoint_less(const sweep_prune_endpoint *a,
+                          const sweep_prune_endpoint *b)
+{
+    return a->value < b->value ||
+           (a->value == b->value && (a->data & 1) < (b->data & 1));
+}
+
+static bool overlap_on(const aabb *a, const aabb *b, int axis)
+{
+    if (axis == 0)
+        return a->min.x <= b->max.x && b->min.x <= a->max.x;
+    return a->min.y <= b->max.y && b->min.y <= a->max.y;
+}
+
+static void swap_endpoints(sweep_prune *sap, int axis, uint32_t i, uint32_t j)
+{
+    std::vector<sweep_prune_endpoint> &ends = sap->axes[axis];
+    sweep_prune_endpoint a = ends[i];
+    sweep_prune_endpoint b = ends[j];
+
+    /* Overlap on this axis only changes when a min passes a max, that of
+     * the boxes only while they overlap on the other one */
+    if ((a.data ^ b.data) & 1 &&
+        overlap_on(&sap->proxies[a.data >> 1].box,
+                   &sap->proxies[b.data >> 1].box, 1 - axis))
+        sap->candidates.push_back(pair_key(a.data >> 1, b.data >> 1));
+
+    ends[i] = b;
+    ends[j] = a;
+    sap->proxies[b.data >> 1].endpoints[axis][b.data & 1] = i;
+    sap->proxies[a.data >> 1].endpoints[axis][a.data & 1] = j;
+}
+
+static void sift(sweep_prune *sap, int axis, uint32_t idx)
+{
+    std::vector<sweep_prune_endpoint> &ends = sap->axes[axis];
+    while (idx > 0 && endpoint_less(&ends[idx], &ends[idx - 1])) {
+        swap_endpoints(sap, axis, idx - 1, idx);
+        idx--;
+    }
+    while (idx + 1 < ends.size() && endpoint_less(&ends[idx + 1], &ends[idx])) {
+        swap_endpoints(sap, axis, idx, idx + 1);
+        idx++;
+    }
+}
+
+/* The array is sorted but for this proxy. An end moving right has to go
+ * first, the other one then stops at it at the latest. The box moves along
+ * x first and then along y, so swaps see the other axis as it is. */
+static void set_box(sweep_prune *sap, uint32_t proxy, const aabb *box)
+{
+    sweep_prune_proxy *p = &sap->proxies[proxy];
+    float *mins[2] = { &p->box.min.x, &p->box.min.y };
+    float *maxs[2] = { &p->box.max.x, &p->box.max.y };
+    const float new_mins[2] = { box->min.x, box->min.y };
+    const float new_maxs[2] = { box->max.x, box->max.y };
+
+    for (int axis = 0; axis < 2; axis++) {
+        int first = new_maxs[axis] >= *maxs[axis] ? 1 : 0;
+        *mins[axis] = new_mins[axis];
+        *maxs[axis] = new_maxs[axis];
+
+        std::vector<sweep_prune_endpoint> &ends = sap->axes[axis];
+        ends[p->endpoints[axis][0]].value = new_mins[axis];
+        ends[p->endpoints[axis][1]].value = new_maxs[axis];
+        sift(sap, axis, p->endpoints[axis][first]);
+        sift(sap, axis, p->endpoints[axis][1 - first]);
+    }
+}
+
+int sweep_prune_init(sweep_prune *sap)
+{
+    sap->proxies.clear();
+    sap->free_proxies.clear();
+    sap->axes[0].clear();
+    sap->axes[1].clear();
+    sap->pairs.assign(MIN_PAIR_SLOTS, { EMPTY_KEY, false });
+    sap->num_pairs = 0;
+    sap->candidates.clear();
+    sap->moved.clear();
+    sap->pending.clear();
+    sap->any_removed = false;
+    return 0;
+}
+
+uint32_t sweep_prune_insert(sweep_prune *sap, const aabb *box, uint32_t user)
+{
+    if (sap->pairs.empty())
+        sweep_prune_init(sap);
+
+    uint32_t proxy;
+    if (!sap->free_proxies.empty()) {
+        proxy = sap->free_proxies.back();
+        sap->free_proxies.pop_back();
+    } else {
+        proxy = sap->proxies.size();
+        sap->proxies.emplace_back();
+    }
+
+    /* Sorting in one at a time would flag everything it passes */
+    sweep_prune_proxy *p = &sap->proxies[proxy];
+    p->box = *box;
+    p->user = user;
+    p->in_use = true;
+    p->pending = true;
+    p->removed = false;
+    p->moved = true;
+    p->others.clear();
+    sap->moved.push_back(proxy);
+    sap->pending.push_back(proxy);
+    return proxy;
+}
+
+static bool valid_proxy(const sweep_prune *sap, uint32_t proxy)
+{
+    return proxy < sap->proxies.size() && sap->proxies[proxy].in_use &&
+           !sap->proxies[proxy].removed;
+}
+
+int sweep_prune_move(sweep_prune *sap, uint32_t proxy, const aabb *box)
+{
+    if (!valid_proxy(sap, proxy))
+        return -1;
+
+    /* The shape may have changed even with the same box, its pairs get
+     * tested again either way */
+    sweep_prune_proxy *p = &sap->proxies[proxy];
+    if (!p->moved) {
+        p->moved = true;
+        sap->moved.push_back(proxy);
+    }
+
+    if (p->pending)
+        p->box = *box;
+    else if (p->box.min.x != box->min.x || p->box.min.y != box->min.y ||
+             p->box.max.x != box->max.x || p->box.max.y != box->max.y)
+        set_box(sap, proxy, box);
+    return 0;
+}
+
+int sweep_prune_remove(sweep_prune *sap, uint32_t proxy)
+{
+    if (!valid_proxy(sap, proxy))
+        return -1;
+
+    /* Its endpoints stay until the update dropped its pairs */
+    sap->proxies[proxy].removed = true;
+    sap->any_removed = true;
+    return 0;
+}
+
+/* Drops the endpoints of removed proxies, frees the proxies. Pending ones
+ * never got any. */
+static void compact(sweep_prune *sap)
+{
+    for (int axis = 0; axis < 2; axis++) {
+        std::vector<sweep_prune_endpoint> &ends = sap->axes[axis];
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < ends.size(); i++) {
+            sweep_prune_proxy *p = &sap->proxies[ends[i].data >> 1];
+            if (p->removed)
+                continue;
+            p->endpoints[axis][ends[i].data & 1] = kept;
+            ends[kept++] = ends[i];
+        }
+        ends.resize(kept);
+    }
+
+    for (uint32_t i = 0; i < sap->proxies.size(); i++) {
+        sweep_prune_proxy *p = &sap->proxies[i];
+        if (!p->removed)
+            continue;
+        p->removed = false;
+        p->in_use = false;
+        sap->free_proxies.push_back(i);
+    }
+
+    sap->any_removed = false;
+}
+
+static void add_event(std::vector<contact_event> *events,
+                      const sweep_prune_proxy *a, const sweep_prune_proxy *b,
+                      bool begin)
+{
+    if (a->user < b->user)
+        events->push_back({ a->user, b->user, begin });
+    else
+        events->push_back({ b->user, a->user, begin });
+}
+
+/* Sorts the endpoints of pending proxies and merges them in */
+static void merge_pending(sweep_prune *sap)
+{
+    for (int axis = 0; axis < 2; axis++) {
+        std::vector<sweep_prune_endpoint> &ends = sap->axes[axis];
+        size_t old_size = ends.size();
+        for (uint32_t proxy : sap->pending) {
+            const sweep_prune_proxy *p = &sap->proxies[proxy];
+            if (p->removed)
+                continue;
+            const float mins[2] = { p->box.min.x, p->box.min.y };
+            const float maxs[2] = { p->box.max.x, p->box.max.y };
+            ends.push_back({ mins[axis], proxy << 1 });
+            ends.push_back({ maxs[axis], proxy << 1 | 1 });
+        }
+
+        auto less = [](const sweep_prune_endpoint &a,
+                       const sweep_prune_endpoint &b) {
+            return endpoint_less(&a, &b);
+        };
+        std::sort(ends.begin() + old_size, ends.end(), less);
+        std::inplace_merge(ends.begin(), ends.begin() + old_size, ends.end(),
+                           less);
+        for (uint32_t i = 0; i < ends.size(); i++)
+            sap->proxies[ends[i].data >> 1].endpoints[axis][ends[i].data & 1] = i;
+    }
+}
+
+/* Sweeps along x flagging the pairs with a pending proxy. Old proxies only
+ * look at the pending ones open at their min. */
+static void sweep_pending(sweep_prune *sap)
+{
+    std::vector<uint32_t> *active = sap->active;
+    active[0].clear();
+    active[1].clear();
+
+    for (const sweep_prune_endpoint &end : sap->axes[0]) {
+        uint32_t proxy = end.data >> 1;
+        const sweep_prune_proxy *p = &sap->proxies[proxy];
+        if (p->removed)
+            continue;
+
+        std::vector<uint32_t> &own = active[p->pending ? 1 : 0];
+        if (end.data & 1) {
+            own.erase(std::find(own.begin(), own.end(), proxy));
+            continue;
+        }
+
+        for (int list = p->pending ? 0 : 1; list < 2; list++) {
+            for (uint32_t other : active[list]) {
+                const aabb *b = &sap->proxies[other].box;
+                if (p->box.min.y <= b->max.y && b->min.y <= p->box.max.y)
+                    sap->candidates.push_back(pair_key(proxy, other));
+            }
+        }
+        own.push_back(proxy);
+    }
+}
+
+void sweep_prune_update(sweep_prune *sap, std::vector<contact_event> *events,
+                        contact_test test, void *data)
+{
+    events->clear();
+    if (sap->pairs.empty())
+        return;
+
+    if (!sap->pending.empty()) {
+        merge_pending(sap);
+        sweep_pending(sap);
+        for (uint32_t proxy : sap->pending)
+            sap->proxies[proxy].pending = false;
+        sap->pending.clear();
+    }
+
+    /* Flagged pairs against the pair set */
+    std::vector<uint64_t> &candidates = sap->candidates;
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                     candidates.end());
+    for (uint64_t key : candidates) {
+        const sweep_prune_proxy *a = &sap->proxies[key >> 32];
+        const sweep_prune_proxy *b = &sap->proxies[key & 0xffffffffu];
+        bool overlap = !a->removed && !b->removed &&
+                       intersect(&a->box, &b->box);
+        uint32_t slot = find_pair(sap, key);
+        bool known = sap->pairs[slot].key == key;
+
+        if (overlap && !known) {
+            bool touching = !test || test(a->user, b->user, data);
+            add_pair(sap, key, touching);
+            if (touching)
+                add_event(events, a, b, true);
+        } else if (!overlap && known) {
+            if (sap->pairs[slot].touching)
+                add_event(events, a, b, false);
+            drop_pair(sap, slot);
+        }
+    }
+    candidates.clear();
+    if (sap->any_removed) {
+        /* Erasing shifts later slots back, so a slot is looked at again */
+        for (uint32_t slot = 0; slot < sap->pairs.size(); slot++) {
+            uint64_t key = sap->pairs[slot].key;
+            if (key == EMPTY_KEY)
+                continue;
+
+            const sweep_prune_proxy *a = &sap->proxies[key >> 32];
+            const sweep_prune_proxy *b = &sap->proxies[key & 0xffffffffu];
+            if (!a->removed && !b->removed)
+                continue;
+            if (sap->pairs[slot].touching)
+                add_event(events, a, b, false);
+            drop_pair(sap, slot);
+            slot--;
+        }
+    }
+
+    /* Overlapping pairs where either side moved may have changed, found
+     * through the lists of the moved proxies and tested once each */
+    if (test) {
+        for (uint32_t proxy : sap->moved) {
+            const sweep_prune_proxy *a = &sap->proxies[proxy];
+            for (uint32_t other : a->others) {
+                const sweep_prune_proxy *b = &sap->proxies[other];
+                if (b->moved && other < proxy)
+                    continue;
+
+                sweep_prune_pair *pair =
+                    &sap->pairs[find_pair(sap, pair_key(proxy, other))];
+                bool touching = test(a->user, b->user, data);
+                if (touching != pair->touching)
+                    add_event(events, a, b, touching);
+                pair->touching = touching;
+            }
+        }
+    }
+
+    for (uint32_t proxy : sap->moved)
+        sap->proxies[proxy].moved = false;
+    sap->moved.clear();
+
+    if (sap->any_removed)
+        compact(sap);
+}
+
+void sweep_prune_contacts(const sweep_prune *sap,
+                          std::vector<broadphase_pair> *pairs)
+{
+    pairs->clear();
+    for (auto &pair : sap->pairs) {
+        if (pair.key == EMPTY_KEY || !pair.touching)
+            continue;
+
+        uint32_t a = sap->proxies[pair.key >> 32].user;
+        uint32_t b = sap->proxies[pair.key & 0xffffffffu].user;
+        pairs->push_back({ std::min(a, b), std::max(a, b) });
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef GL_SDL_SWEEP_PRUNE_H
+#define GL_SDL_SWEEP_PRUNE_H
+
+#include "gl_sdl_broadphase.hpp"
+#include <stdint.h>
+#include <vector>
+
+#define SWEEP_PRUNE_NULL 0xffffffffu
+
+/* Two users started or stopped touching, a lower than b */
+struct contact_event {
+    uint32_t a;
+    uint32_t b;
+    bool begin;
+};
+
+/* Exact test run on pairs whose boxes overlap, by user */
+typedef bool (*contact_test)(uint32_t a, uint32_t b, void *data);
+
+struct sweep_prune_endpoint {
+    float value;
+    uint32_t data;          /* Proxy shifted left once, low bit set for max */
+};
+
+struct sweep_prune_proxy {
+    aabb box;
+    uint32_t endpoints[2][2];   /* Per axis, index of the min and max */
+    uint32_t user;
+    bool in_use;
+    bool pending;           /* Inserted, endpoints not sorted in yet */
+    bool removed;           /* Until the next update reports its ends */
+    bool moved;             /* Since the last update */
+    std::vector<uint32_t> others;   /* The other proxy of each of its pairs */
+};
+
+struct sweep_prune_pair {
+    uint64_t key;           /* Lower proxy in the high half */
+    bool touching;
+};
+
+/* Sweep and prune over endpoints kept sorted on both axes. Moving a box
+ * insertion sorts its endpoints right away, so small moves cost a few
+ * swaps. Every swap of a min past a max flags the pair, the next update
+ * settles flagged pairs against the persistent pair set and reports what
+ * changed. Inserted boxes are merged in and swept for their pairs by the
+ * update, all at once. Nothing is allocated once the buffers reached their
+ * size. */
+struct sweep_prune {
+    std::vector<sweep_prune_proxy> proxies;
+    std::vector<uint32_t> free_proxies;
+    std::vector<sweep_prune_endpoint> axes[2];
+    std::vector<sweep_prune_pair> pairs;    /* Open addressing */
+    uint32_t num_pairs = 0;
+    std::vector<uint64_t> candidates;
+    std::vector<uint32_t> moved;
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> active[2];        /* Sweep scratch, old and new */
+    bool any_removed = false;
+};
+
+int sweep_prune_init(sweep_prune *sap);
+uint32_t sweep_prune_insert(sweep_prune *sap, const aabb *box, uint32_t user);
+/* Also for a changed shape with the same box, its pairs get tested again */
+int sweep_prune_move(sweep_prune *sap, uint32_t proxy, const aabb *box);
+/* The proxy stays valid for the ends reported by the next update */
+int sweep_prune_remove(sweep_prune *sap, uint32_t proxy);
+/* Appends to events, after clearing it, the contacts that began or ended
+ * since the last update. Without a test overlapping boxes are contacts,
+ * with one pairs are tested when they start overlapping and whenever one
+ * of them moved. */
+void sweep_prune_update(sweep_prune *sap, std::vector<contact_event> *events,
+                        contact_test test, void *data);
+/* Current contacts by user, pairs is cleared first */
+void sweep_prune_contacts(const sweep_prune *sap,
+                          std::vector<broadphase_pair> *pairs);
+
+#endif
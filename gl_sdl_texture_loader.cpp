@@ -0,0 +1,266 @@
+#include "gl_sdl_texture_loader.hpp"
+#include "gl_sdl_state.hpp"
+#include <algorithm>
+#include <chrono>
+
+static GLuint make_placeholder(GLenum target)
+{
+    static const GLubyte grey[4] = { 128, 128, 128, 255 };
+    uint32_t num_faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    GLenum face_target = target == GL_TEXTURE_CUBE_MAP ?
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+
+    GLuint texture;
+    glGenTextures(1, &texture);
+    gl_state_bind_texture(target, texture);
+    for (uint32_t i = 0; i < num_faces; i++)
+        glTexImage2D(face_target + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return texture;
+}
+
+int texture_loader_init(texture_loader *loader, uint32_t num_threads)
+{
+    thread_pool_init(&loader->pool, num_threads);
+    loader->placeholder_2d = make_placeholder(GL_TEXTURE_2D);
+    loader->placeholder_cube = make_placeholder(GL_TEXTURE_CUBE_MAP);
+    return checkOpenGLError() ? -1 : 0;
+}
+
+static void free_surfaces(texture_request *req)
+{
+    for (SDL_Surface *&surf : req->surfaces) {
+        if (surf)
+            SDL_FreeSurface(surf);
+        surf = NULL;
+    }
+}
+
+void texture_loader_destroy(texture_loader *loader)
+{
+    thread_pool_destroy(&loader->pool);
+    for (auto &req : loader->requests) {
+        free_surfaces(&*req);
+        if (req->texture && req->state != TEXTURE_READY)
+            glDeleteTextures(1, &req->texture);
+    }
+
+    glDeleteTextures(1, &loader->placeholder_2d);
+    glDeleteTextures(1, &loader->placeholder_cube);
+    loader->placeholder_2d = loader->placeholder_cube = 0;
+    loader->requests.clear();
+    loader->decoded.clear();
+    loader->next_upload = 0;
+}
+
+void texture_loader_set_budget(texture_loader *loader, size_t max_bytes,
+                               float max_ms)
+{
+    loader->max_bytes = max_bytes;
+    loader->max_ms = max_ms;
+}
+
+/* Worker side, RGBA so that rows upload the same whatever the file held */
+static void decode_face(uint32_t, uint32_t, void *data)
+{
+    decode_task *task = (decode_task *)data;
+    texture_request *req = task->request;
+
+    SDL_Surface *rgba = NULL;
+    SDL_Surface *surf = IMG_Load(req->paths[task->face].c_str());
+    if (surf) {
+        rgba = SDL_ConvertSurfaceFormat(surf, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(surf);
+    }
+    if (!rgba) {
+        std::cout << "SDL could not load the image for a tex " << SDL_GetError() << "\n";
+        req->failed = true;
+    }
+    req->surfaces[task->face] = rgba;
+
+    if (--req->pending == 0) {
+        texture_loader *loader = req->loader;
+        std::lock_guard<std::mutex> lock(loader->lock);
+        loader->decoded.push_back(req->handle);
+    }
+}
+
+static uint32_t queue_request(texture_loader *loader, GLenum target,
+                              std::vector<std::string> paths)
+{
+    texture_request *req = new texture_request;
+    uint32_t num_faces = paths.size();
+    req->loader = loader;
+    req->handle = loader->requests.size();
+    req->target = target;
+    req->paths = std::move(paths);
+    req->surfaces.assign(num_faces, NULL);
+    req->pending = num_faces;
+    req->failed = false;
+    for (uint32_t i = 0; i < num_faces; i++)
+        req->tasks.push_back({ req, i });
+    loader->requests.emplace_back(req);
+
+    for (decode_task &task : req->tasks)
+        thread_pool_submit(&loader->pool, decode_face, &task);
+    return req->handle;
+}
+
+uint32_t load_tex_async(texture_loader *loader, std::string path)
+{
+    return queue_request(loader, GL_TEXTURE_2D, { path });
+}
+
+uint32_t load_cubemap_async(texture_loader *loader,
+                            std::vector<std::string> file_paths)
+{
+    if (file_paths.size() != 6) {
+        std::cout << "6 textures must be provided for a cubemap, got " <<
+                     file_paths.size() << "\n";
+        return TEXTURE_LOADER_NULL;
+    }
+
+    return queue_request(loader, GL_TEXTURE_CUBE_MAP, std::move(file_paths));
+}
+
+static GLenum face_target(const texture_request *req, uint32_t face)
+{
+    return req->target == GL_TEXTURE_CUBE_MAP ?
+           GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : req->target;
+}
+
+/* Storage for every face, cube faces have to be square and alike */
+static bool allocate_texture(texture_request *req)
+{
+    const SDL_Surface *first = req->surfaces[0];
+    for (const SDL_Surface *surf : req->surfaces) {
+        if (req->target == GL_TEXTURE_CUBE_MAP &&
+            (surf->w != first->w || surf->h != first->h || surf->w != surf->h)) {
+            std::cout << "Cubemap faces must be square and of one size\n";
+            return false;
+        }
+    }
+
+    glGenTextures(1, &req->texture);
+    gl_state_bind_texture(req->target, req->texture);
+    for (uint32_t face = 0; face < req->surfaces.size(); face++) {
+        const SDL_Surface *surf = req->surfaces[face];
+        glTexImage2D(face_target(req, face), 0, GL_RGBA, surf->w, surf->h, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    return true;
+}
+
+static void finish_request(texture_request *req, bool ok)
+{
+    free_surfaces(req);
+    if (!ok) {
+        if (req->texture)
+            glDeleteTextures(1, &req->texture);
+        req->texture = 0;
+        req->state = TEXTURE_FAILED;
+        return;
+    }
+
+    /* As load_tex and load_cubemap leave them */
+    GLenum target = req->target;
+    gl_state_bind_texture(target, req->texture);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    if (target == GL_TEXTURE_CUBE_MAP) {
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    req->state = TEXTURE_READY;
+}
+
+uint32_t texture_loader_update(texture_loader *loader)
+{
+    typedef std::chrono::steady_clock clock;
+    auto start = clock::now();
+    std::vector<uint32_t> *decoded = &loader->decoded;
+    std::unique_lock<std::mutex> lock(loader->lock);
+
+    size_t bytes = 0;
+    uint32_t num_ready = 0;
+    while (loader->next_upload < decoded->size()) {
+        texture_request *req = &*loader->requests[(*decoded)[loader->next_upload]];
+        /* Workers only append, uploads run without holding them up */
+        lock.unlock();
+
+        bool ok = !req->failed;
+        if (ok && !req->texture)
+            ok = allocate_texture(req);
+        req->state = TEXTURE_UPLOADING;
+
+        bool spent = false;
+        while (ok && req->face < req->surfaces.size() && !spent) {
+            const SDL_Surface *surf = req->surfaces[req->face];
+            size_t row_bytes = (size_t)surf->w * 4;
+            size_t left = loader->max_bytes > bytes ?
+                          loader->max_bytes - bytes : 0;
+            uint32_t rows = std::min((size_t)(surf->h - req->row),
+                                     std::max(left / row_bytes, (size_t)1));
+            if (bytes && left < row_bytes)
+                break;
+
+            gl_state_bind_texture(req->target, req->texture);
+            glTexSubImage2D(face_target(req, req->face), 0, 0, req->row,
+                            surf->w, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                            (const uint8_t *)surf->pixels +
+                            (size_t)req->row * surf->pitch);
+            bytes += rows * row_bytes;
+            req->row += rows;
+            if (req->row == (uint32_t)surf->h) {
+                req->row = 0;
+                req->face++;
+            }
+
+            std::chrono::duration<float, std::milli> elapsed =
+                clock::now() - start;
+            spent = bytes >= loader->max_bytes ||
+                    elapsed.count() >= loader->max_ms;
+        }
+
+        bool done = !ok || req->face == req->surfaces.size();
+        if (done) {
+            finish_request(req, ok);
+            num_ready += ok;
+        }
+
+        lock.lock();
+        if (!done)
+            break;
+        loader->next_upload++;
+        if (spent)
+            break;
+    }
+
+    if (loader->next_upload == decoded->size()) {
+        decoded->clear();
+        loader->next_upload = 0;
+    }
+    return num_ready;
+}
+
+texture_load_state texture_loader_state(texture_loader *loader,
+                                        uint32_t handle)
+{
+    if (handle >= loader->requests.size())
+        return TEXTURE_FAILED;
+    return loader->requests[handle]->state;
+}
+
+GLuint texture_loader_texture(texture_loader *loader, uint32_t handle)
+{
+    if (handle < loader->requests.size() &&
+        loader->requests[handle]->state == TEXTURE_READY)
+        return loader->requests[handle]->texture;
+
+    bool cube = handle < loader->requests.size() &&
+                loader->requests[handle]->target == GL_TEXTURE_CUBE_MAP;
+    return cube ? loader->placeholder_cube : loader->placeholder_2d;
+}
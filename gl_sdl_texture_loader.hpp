@@ -0,0 +1,87 @@
+#ifndef GL_SDL_TEXTURE_LOADER_H
+#define GL_SDL_TEXTURE_LOADER_H
+
+#include "gl_sdl_utils.hpp"
+#include "gl_sdl_thread_pool.hpp"
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Loading textures without stalling the frame: images are decoded on a
+ * pool of its own and uploaded by texture_loader_update on the GL thread,
+ * a few rows at a time within a budget. Until all of a texture is up, its
+ * handle gives a placeholder of the same target. */
+
+#define TEXTURE_LOADER_NULL 0xffffffffu
+
+enum texture_load_state {
+    TEXTURE_DECODING,
+    TEXTURE_UPLOADING,
+    TEXTURE_READY,
+    TEXTURE_FAILED      /* Keeps the placeholder */
+};
+
+struct texture_loader;
+struct texture_request;
+
+struct decode_task {
+    texture_request *request;
+    uint32_t face;
+};
+
+/* Paths and tasks are fixed once queued, surfaces belong to the worker of
+ * the face until pending drops. The rest is the GL thread's. */
+struct texture_request {
+    texture_loader *loader;
+    uint32_t handle;
+    GLenum target;
+    std::vector<std::string> paths;
+    std::vector<decode_task> tasks;
+    std::vector<SDL_Surface *> surfaces;
+    std::atomic<uint32_t> pending;      /* Faces still decoding */
+    std::atomic<bool> failed;
+    texture_load_state state = TEXTURE_DECODING;
+    GLuint texture = 0;
+    uint32_t face = 0;                  /* Upload cursor */
+    uint32_t row = 0;
+};
+
+struct texture_loader {
+    thread_pool pool;
+    GLuint placeholder_2d = 0;
+    GLuint placeholder_cube = 0;
+    std::vector<std::unique_ptr<texture_request>> requests;  /* By handle */
+    std::mutex lock;
+    std::vector<uint32_t> decoded;  /* Handles to upload, oldest first */
+    size_t next_upload = 0;         /* Into decoded */
+    size_t max_bytes = 4u << 20;    /* Per texture_loader_update */
+    float max_ms = 2.0f;
+};
+
+/* On the GL thread, num_threads decode workers as for thread_pool_init */
+int texture_loader_init(texture_loader *loader, uint32_t num_threads);
+/* Waits for the decodes under way. Textures that finished stay alive,
+ * the others are deleted. */
+void texture_loader_destroy(texture_loader *loader);
+/* At least one row goes up per update whatever the budget */
+void texture_loader_set_budget(texture_loader *loader, size_t max_bytes,
+                               float max_ms);
+
+/* Return at once, the image is loaded as by load_tex and load_cubemap */
+uint32_t load_tex_async(texture_loader *loader, std::string path);
+/* order: X+,X-,Y+,Y-,Z+,Z- */
+uint32_t load_cubemap_async(texture_loader *loader,
+                            std::vector<std::string> file_paths);
+
+/* Once per frame on the GL thread, returns the textures that got ready */
+uint32_t texture_loader_update(texture_loader *loader);
+
+texture_load_state texture_loader_state(texture_loader *loader,
+                                        uint32_t handle);
+/* The texture once ready, the placeholder before */
+GLuint texture_loader_texture(texture_loader *loader, uint32_t handle);
+
+#endif
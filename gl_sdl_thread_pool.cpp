@@ -0,0 +1,190 @@
+#include "gl_sdl_thread_pool.hpp"
+
+/* Queue of the worker running on this thread, for nested jobs */
+static thread_local thread_pool *current_pool = nullptr;
+static thread_local uint32_t current_queue = 0;
+
+static void push_task(thread_pool *pool, uint32_t queue,
+                      const thread_pool_task *task)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->queues[queue].lock);
+        pool->queues[queue].tasks.push_back(*task);
+    }
+    pool->queued++;
+
+    /* A worker between checking queued and sleeping would miss this */
+    { std::lock_guard<std::mutex> lock(pool->sleep_lock); }
+    pool->wake.notify_one();
+}
+
+/* Without detached, submitted tasks are passed over */
+static bool take_task(thread_pool *pool, uint32_t queue, bool newest,
+                      bool detached, thread_pool_task *task)
+{
+    std::lock_guard<std::mutex> lock(pool->queues[queue].lock);
+    std::deque<thread_pool_task> &tasks = pool->queues[queue].tasks;
+    uint32_t num = tasks.size();
+    for (uint32_t i = 0; i < num; i++) {
+        uint32_t at = newest ? num - 1 - i : i;
+        if (!detached && tasks[at].job->detached)
+            continue;
+
+        *task = tasks[at];
+        tasks.erase(tasks.begin() + at);
+        pool->queued--;
+        return true;
+    }
+
+    return false;
+}
+
+static bool find_task(thread_pool *pool, uint32_t queue, bool detached,
+                      thread_pool_task *task)
+{
+    if (take_task(pool, queue, true, detached, task))
+        return true;
+
+    for (uint32_t i = 1; i < pool->num_queues; i++) {
+        if (take_task(pool, (queue + i) % pool->num_queues, false, detached,
+                      task))
+            return true;
+    }
+
+    return false;
+}
+
+/* A task of a parallel_for, the job lives on the waiting caller's stack */
+static void run_task(thread_pool *pool, uint32_t queue, thread_pool_task task)
+{
+    thread_pool_job *job = task.job;
+    while (task.end - task.begin > job->grain) {
+        uint32_t mid = task.begin + (task.end - task.begin) / 2;
+        thread_pool_task upper = { job, mid, task.end };
+        push_task(pool, queue, &upper);
+        task.end = mid;
+    }
+
+    job->fn(task.begin, task.end, job->data);
+    job->remaining -= task.end - task.begin;
+}
+
+/* A submitted task, its job was allocated for it alone */
+static void run_detached(thread_pool_task task)
+{
+    task.job->fn(task.begin, task.end, task.job->data);
+    delete task.job;
+}
+
+static void worker_main(thread_pool *pool, uint32_t queue)
+{
+    current_pool = pool;
+    current_queue = queue;
+
+    for (;;) {
+        thread_pool_task task;
+        if (find_task(pool, queue, true, &task)) {
+            if (task.job->detached)
+                run_detached(task);
+            else
+                run_task(pool, queue, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(pool->sleep_lock);
+        pool->wake.wait(lock, [pool] {
+            return pool->stop || pool->queued > 0;
+        });
+        /* Submitted tasks still run on the way out */
+        if (pool->stop && !pool->queued)
+            return;
+    }
+}
+
+int thread_pool_init(thread_pool *pool, uint32_t num_threads)
+{
+    if (!num_threads)
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    num_threads = 1;
+#endif
+
+    pool->num_queues = num_threads;
+    pool->queues.reset(new thread_pool_queue[num_threads]);
+    pool->queued = 0;
+    pool->stop = false;
+    for (uint32_t i = 1; i < num_threads; i++)
+        pool->threads.emplace_back(worker_main, pool, i);
+    return 0;
+}
+
+void thread_pool_destroy(thread_pool *pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool->sleep_lock);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+    for (auto &thread : pool->threads)
+        thread.join();
+
+    pool->threads.clear();
+    pool->queues.reset();
+    pool->num_queues = 0;
+}
+
+uint32_t thread_pool_size(const thread_pool *pool)
+{
+    return pool->num_queues;
+}
+
+void thread_pool_parallel_for(thread_pool *pool, uint32_t count,
+                              uint32_t grain, thread_pool_fn fn, void *data)
+{
+    if (!count)
+        return;
+    if (!grain)
+        grain = 1;
+    if (pool->threads.empty() || count <= grain) {
+        fn(0, count, data);
+        return;
+    }
+
+    thread_pool_job job;
+    job.fn = fn;
+    job.data = data;
+    job.grain = grain;
+    job.remaining = count;
+    job.detached = false;
+
+    uint32_t queue = current_pool == pool ? current_queue : 0;
+    run_task(pool, queue, { &job, 0, count });
+
+    /* Helping out with queued jobs, this one or others. Submitted tasks
+     * are left to the workers, a frame should not wait on a decode. */
+    while (job.remaining > 0) {
+        thread_pool_task task;
+        if (find_task(pool, queue, false, &task))
+            run_task(pool, queue, task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void thread_pool_submit(thread_pool *pool, thread_pool_fn fn, void *data)
+{
+    if (pool->threads.empty()) {
+        fn(0, 1, data);
+        return;
+    }
+
+    thread_pool_job *job = new thread_pool_job;
+    job->fn = fn;
+    job->data = data;
+    job->grain = 1;
+    job->remaining = 1;
+    job->detached = true;
+
+    thread_pool_task task = { job, 0, 1 };
+    push_task(pool, current_pool == pool ? current_queue : 0, &task);
+}
@@ -0,0 +1,64 @@
+#ifndef GL_SDL_THREAD_POOL_H
+#define GL_SDL_THREAD_POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*thread_pool_fn)(uint32_t begin, uint32_t end, void *data);
+
+struct thread_pool_job {
+    thread_pool_fn fn;
+    void *data;
+    uint32_t grain;
+    std::atomic<uint32_t> remaining;    /* Indices not run yet */
+    bool detached;      /* From thread_pool_submit, freed once it ran */
+};
+
+struct thread_pool_task {
+    thread_pool_job *job;
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct thread_pool_queue {
+    std::mutex lock;
+    std::deque<thread_pool_task> tasks;
+};
+
+/* Work stealing: a thread halves its range until it fits the grain,
+ * queueing the upper halves and running the rest. It takes the newest task
+ * of its own queue next, idle threads steal the oldest, largest ones of
+ * the others. The thread calling thread_pool_parallel_for works along on
+ * parallel_for tasks while it waits, never on submitted ones. Workers never
+ * touch GL. */
+struct thread_pool {
+    std::vector<std::thread> threads;
+    std::unique_ptr<thread_pool_queue[]> queues;    /* 0 for the caller */
+    uint32_t num_queues = 0;
+    std::atomic<uint32_t> queued { 0 };
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stop = false;
+};
+
+/* num_threads counts the caller, 0 for one per core. Without threads in
+ * the build (Emscripten without -pthread) everything runs on the caller. */
+int thread_pool_init(thread_pool *pool, uint32_t num_threads);
+void thread_pool_destroy(thread_pool *pool);
+uint32_t thread_pool_size(const thread_pool *pool);
+/* Runs fn over [0, count) in pieces of at most grain indices, returns once
+ * all of them ran. fn may call it again for nested work. */
+void thread_pool_parallel_for(thread_pool *pool, uint32_t count,
+                              uint32_t grain, thread_pool_fn fn, void *data);
+/* Queues fn(0, 1, data) and returns at once, a worker runs it. Without
+ * worker threads it runs right away. Tasks still queued when the pool is
+ * destroyed get run by the workers on their way out. */
+void thread_pool_submit(thread_pool *pool, thread_pool_fn fn, void *data);
+
+#endif
@@ -1,5 +1,8 @@
 #include "gl_sdl_utils.hpp"
+#include "gl_sdl_state.hpp"
 #include <fstream>
+#include <cstring>
+#include <unordered_map>
 
 void printShaderLog(GLuint shader) {
     int len = 0;
@@ -83,7 +86,7 @@ GLuint load_tex(std::string path)
     GLuint texture;
     
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state_bind_texture(GL_TEXTURE_2D, texture);
     fill_tex_with_image(path, texture, GL_TEXTURE_2D);
     glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
 
@@ -102,7 +105,7 @@ GLuint load_cubemap(std::vector<std::string> file_paths)
     }
 
     glGenTextures(1, &cubemap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    gl_state_bind_texture(GL_TEXTURE_CUBE_MAP, cubemap);
 
     for (unsigned int i = 0; i < 6; i++) {
         fill_tex_with_image(file_paths[i], cubemap, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
@@ -137,15 +140,48 @@ GLuint read_shader(std::string shader_path, unsigned int flags)
     return read_shader(c_str, flags);
 }
 
-GLuint create_program(std::vector<GLuint> shaders)
+/* Node based, so program_info pointers stay valid while programs come and go */
+static std::unordered_map<GLuint, program_info> programs;
+
+static void reflect_program(GLuint program)
 {
-    GLuint program = glCreateProgram();
-    for (auto shader : shaders) {
-        glAttachShader(program, shader);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+        return;
+
+    GLint num_uniforms = 0;
+    GLint max_len = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+
+    program_info &info = programs[program];
+    info.id = program;
+    info.uniforms.clear();
+
+    std::vector<GLchar> name(max_len + 1);
+    for (GLint i = 0; i < num_uniforms; i++) {
+        uniform_info uniform = {};
+        GLsizei len = 0;
+        glGetActiveUniform(program, i, name.size(), &len, &uniform.size,
+                           &uniform.type, name.data());
+        uniform.name = std::string(name.data(), len);
+        uniform.location = glGetUniformLocation(program, uniform.name.c_str());
+
+        /* Arrays are reported as "name[0]", look them up by the base name */
+        size_t bracket = uniform.name.find('[');
+        if (bracket != std::string::npos)
+            uniform.name.resize(bracket);
+
+        /* Uniforms in blocks have no location */
+        if (uniform.location >= 0)
+            info.uniforms.push_back(uniform);
     }
-    glLinkProgram(program);
-    printProgramLog(program);
-    return program;
+}
+
+GLuint create_program(std::vector<GLuint> shaders)
+{
+    return create_program(shaders.data(), shaders.size());
 }
 
 GLuint create_program(const GLuint *shaders, uint num_shaders)
@@ -156,9 +192,125 @@ GLuint create_program(const GLuint *shaders, uint num_shaders)
     }
     glLinkProgram(program);
     printProgramLog(program);
+    reflect_program(program);
     return program;
 }
 
+void delete_program(GLuint program)
+{
+    programs.erase(program);
+    glDeleteProgram(program);
+}
+
+program_info *get_program_info(GLuint program)
+{
+    auto it = programs.find(program);
+    return it == programs.end() ? nullptr : &it->second;
+}
+
+int find_uniform(program_info *prog, const char *name, GLenum type)
+{
+    for (uint i = 0; i < prog->uniforms.size(); i++) {
+        uniform_info &uniform = prog->uniforms[i];
+        if (uniform.name != name)
+            continue;
+
+        if (uniform.type != type) {
+            std::cout << "Uniform " << name << " has type " << uniform.type <<
+                         ", requested " << type << "\n";
+            return -1;
+        }
+
+        return i;
+    }
+
+    return -1;
+}
+
+void invalidate_uniform_shadow(GLuint program)
+{
+    program_info *prog = get_program_info(program);
+    if (!prog)
+        return;
+
+    for (auto &uniform : prog->uniforms)
+        uniform.shadow_valid = false;
+}
+
+/* Returns the uniform when its shadow differs from value and updates it */
+template<GLenum T>
+static uniform_info *shadow_update(uniform_handle<T> handle, const void *value,
+                                   size_t size)
+{
+    if (!handle.valid())
+        return nullptr;
+
+    uniform_info *uniform = &handle.prog->uniforms[handle.idx];
+    if (uniform->shadow_valid && !memcmp(&uniform->shadow, value, size))
+        return nullptr;
+
+    memcpy(&uniform->shadow, value, size);
+    uniform->shadow_valid = true;
+    return uniform;
+}
+
+int set_uniform(uniform_1f handle, GLfloat x)
+{
+    uniform_info *uniform = shadow_update(handle, &x, sizeof(x));
+    if (uniform)
+        glUniform1f(uniform->location, x);
+    return 0;
+}
+
+int set_uniform(uniform_2f handle, GLfloat x, GLfloat y)
+{
+    GLfloat value[] = { x, y };
+    uniform_info *uniform = shadow_update(handle, value, sizeof(value));
+    if (uniform)
+        glUniform2fv(uniform->location, 1, value);
+    return 0;
+}
+
+int set_uniform(uniform_4f handle, const GLfloat *xyzw)
+{
+    uniform_info *uniform = shadow_update(handle, xyzw, 4 * sizeof(GLfloat));
+    if (uniform)
+        glUniform4fv(uniform->location, 1, xyzw);
+    return 0;
+}
+
+int set_uniform(uniform_1i handle, GLint x)
+{
+    uniform_info *uniform = shadow_update(handle, &x, sizeof(x));
+    if (uniform)
+        glUniform1i(uniform->location, x);
+    return 0;
+}
+
+int set_uniform(uniform_1ui handle, GLuint x)
+{
+    uniform_info *uniform = shadow_update(handle, &x, sizeof(x));
+    if (uniform)
+        glUniform1ui(uniform->location, x);
+    return 0;
+}
+
+int set_uniform(uniform_mat3x2 handle, const GLfloat *columns)
+{
+    uniform_info *uniform = shadow_update(handle, columns, 6 * sizeof(GLfloat));
+    if (uniform)
+        glUniformMatrix3x2fv(uniform->location, 1, GL_FALSE, columns);
+    return 0;
+}
+
+int set_uniform(uniform_sampler_2d handle, GLint unit)
+{
+    uniform_info *uniform = shadow_update(handle, &unit, sizeof(unit));
+    if (uniform)
+        glUniform1i(uniform->location, unit);
+    return 0;
+}
+
 SDL_GLContext create_context(SDL_Window *window, minimal_context_cfg *cfg)
 {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
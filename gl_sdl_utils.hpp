@@ -38,6 +38,72 @@ GLuint read_shader(std::string shader_path, unsigned int flags);
 GLuint read_shader(const char *shader_src, unsigned int flags);
 GLuint create_program(std::vector<GLuint> shaders);
 GLuint create_program(const GLuint *shaders, uint num_shaders);
+void delete_program(GLuint program);
+
+/* Active uniforms are reflected once when create_program links, setters
+ * keep a shadow copy and skip uploads of unchanged values */
+struct uniform_info
+{
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+    bool shadow_valid;
+    union {
+        GLfloat f[16];
+        GLint i[16];
+    } shadow;
+};
+
+struct program_info
+{
+    GLuint id;
+    std::vector<uniform_info> uniforms;
+};
+
+/* Typed so that a vec2 cannot be fed to a float uniform by mistake */
+template<GLenum T>
+struct uniform_handle
+{
+    program_info *prog = nullptr;
+    int idx = -1;
+    bool valid() const { return prog && idx >= 0; }
+};
+
+typedef uniform_handle<GL_FLOAT> uniform_1f;
+typedef uniform_handle<GL_FLOAT_VEC2> uniform_2f;
+typedef uniform_handle<GL_FLOAT_VEC4> uniform_4f;
+typedef uniform_handle<GL_INT> uniform_1i;
+typedef uniform_handle<GL_UNSIGNED_INT> uniform_1ui;
+typedef uniform_handle<GL_FLOAT_MAT3x2> uniform_mat3x2;
+typedef uniform_handle<GL_SAMPLER_2D> uniform_sampler_2d;
+
+program_info *get_program_info(GLuint program);
+int find_uniform(program_info *prog, const char *name, GLenum type);
+void invalidate_uniform_shadow(GLuint program);
+
+template<GLenum T>
+uniform_handle<T> get_uniform(GLuint program, const char *name)
+{
+    uniform_handle<T> handle;
+    program_info *prog = get_program_info(program);
+    if (!prog)
+        return handle;
+
+    handle.idx = find_uniform(prog, name, T);
+    if (handle.idx >= 0)
+        handle.prog = prog;
+    return handle;
+}
+
+/* The program owning the uniform has to be in use, as with glUniform* */
+int set_uniform(uniform_1f handle, GLfloat x);
+int set_uniform(uniform_2f handle, GLfloat x, GLfloat y);
+int set_uniform(uniform_4f handle, const GLfloat *xyzw);
+int set_uniform(uniform_1i handle, GLint x);
+int set_uniform(uniform_1ui handle, GLuint x);
+int set_uniform(uniform_mat3x2 handle, const GLfloat *columns);
+int set_uniform(uniform_sampler_2d handle, GLint unit);
 
 /* Those are in bits */
 struct channel_sizes
@@ -0,0 +1,1975 @@
+/* Headless throughput benchmark for gl_sdl_2d. Renders scripted scenes into
+ * an offscreen framebuffer through EGL, so it runs without a window or GPU
+ * (Mesa llvmpipe does fine). Results go to stdout as JSON, diagnostics to
+ * stderr.
+ *
+ * ./bench [-c] [-n shapes] [-f frames] [-s scene] [-m mode] [-W width]
+ *         [-H height]
+ *
+ * The "geometry" scene times the batch containment kernels against the
+ * scalar tests and checks that both agree. The "collision" scene moves
+ * circles each frame and times the spatial hash against sweep and prune
+ * keeping the contacts, then the narrowphase alone on mixed shapes. The
+ * "picking" scene times point picks and rubber band selections, the
+ * "raycast" scene batches of ray casts against a loop over all shapes. The
+ * "parallel" scene runs the collision pipeline of mixed shapes on thread
+ * pools of growing size and checks the pairs against the serial pipeline.
+ * The "store" scene runs the same shapes through the shape store and the
+ * shape objects, moving them, finding the pairs and drawing them. The
+ * "compact" scene draws static shapes from compact tiles and from retained
+ * instance buffers. The "file" scene saves a store to a binary scene file
+ * and times mapping and loading it back. The "graph" scene drags one group
+ * of a scene graph against moving its shapes one by one.
+ *
+ * Scenes check what they can cheaply, the tree picks against the draw order,
+ * parallel pairs against the serial ones and so on. With -c they also
+ * compare against brute force: pairs over all shapes, the narrowphase
+ * against plain edge tests, polygon areas, the scene file columns, the
+ * scene graph against moving shapes directly. Failed checks are reported on
+ * stderr and make the exit status nonzero.
+ */
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "../gl_sdl_utils.hpp"
+#include "../gl_sdl_2d.hpp"
+#include "../gl_sdl_state.hpp"
+#include "../gl_sdl_shape_obj.hpp"
+#include "../gl_sdl_shape_store.hpp"
+#include "../gl_sdl_compact.hpp"
+#include "../gl_sdl_scene_file.hpp"
+#include "../gl_sdl_scene_graph.hpp"
+#include "../gl_sdl_geometry_batch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define ARRAY_SIZE(_x) (sizeof(_x) / sizeof(*_x))
+
+/* Frames rendered before measuring, lets buffers reach their final size */
+#define WARMUP_FRAMES 5
+/* Every n-th shape moves each frame */
+#define MOVING_STRIDE 10
+
+enum scene_kind {
+    SCENE_RECTS,
+    SCENE_TRIS,
+    SCENE_POLYGONS,
+    SCENE_CIRCLES_FIXED,
+    SCENE_CIRCLES_ADAPTIVE,
+    SCENE_CIRCLES_SDF,
+    SCENE_LINES,
+    SCENE_THICK_LINES,
+    NUM_SCENES
+};
+
+static const char *scene_names[NUM_SCENES] = {
+    "rects", "tris", "polygons", "circles_fixed", "circles_adaptive", "circles_sdf",
+    "lines", "thick_lines"
+};
+
+enum draw_mode {
+    MODE_IMMEDIATE,     /* Every shape submits on its own */
+    MODE_BATCH,         /* draw_all_shapes */
+    MODE_INSTANCED,     /* draw_all_shapes_instanced */
+    MODE_RETAINED,      /* draw_all_shapes_retained */
+    NUM_MODES
+};
+
+static const char *mode_names[NUM_MODES] = {
+    "immediate", "batch", "instanced", "retained"
+};
+
+struct bench_options {
+    bool check = false;     /* Brute force checks too */
+    uint num_shapes = 2000;
+    uint num_frames = 60;
+    int width = 1280;
+    int height = 720;
+    const char *scene = NULL;   /* All when NULL */
+    const char *mode = NULL;
+};
+
+struct bench_result {
+    double fps;
+    double cpu_ms;          /* Issuing the frame */
+    double frame_ms;        /* Issuing and waiting for the GPU */
+    double draw_calls;      /* Per frame */
+    double bytes_uploaded;  /* Per frame */
+};
+
+static space_2d space;
+
+typedef std::vector<std::unique_ptr<shape>> shape_list;
+
+/* Deterministic, so runs stay comparable across machines */
+static uint32_t rng_state;
+
+static float rand_float(float min, float max)
+{
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(rng_state >> 8) / (float)(1u << 24);
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Time summed over the measured frames */
+struct bench_timer {
+    bench_clock::time_point start;
+    std::chrono::duration<double, std::milli> total { 0 };
+};
+
+static void timer_start(bench_timer *timer)
+{
+    timer->start = bench_clock::now();
+}
+
+/* Warmup frames are timed all the same, but not counted */
+static void timer_stop(bench_timer *timer, uint frame = WARMUP_FRAMES)
+{
+    if (frame >= WARMUP_FRAMES)
+        timer->total += bench_clock::now() - timer->start;
+}
+
+static double timer_ms(const bench_timer *timer, double per = 1.0)
+{
+    return timer->total.count() / per;
+}
+
+static uint num_failures;
+
+static bool check(bool ok, const char *scene, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "check failed: %s: %s\n", scene, what);
+        num_failures++;
+    }
+    return ok;
+}
+
+/* The JSON on stdout: sections at the top level holding a list of entries
+ * or a single object, each a line of fields */
+static const char *entry_sep = "";
+static const char *field_sep = "";
+
+static void report_section_string(const char *name, const char *value)
+{
+    printf(",\n  \"%s\": \"%s\"", name, value);
+}
+
+static void report_list(const char *name)
+{
+    printf(",\n  \"%s\": [", name);
+    entry_sep = "";
+}
+
+static void report_end_list()
+{
+    printf("\n  ]");
+    fflush(stdout);
+}
+
+static void report_entry()
+{
+    printf("%s\n    {", entry_sep);
+    entry_sep = ",";
+    field_sep = "";
+}
+
+static void report_object(const char *name)
+{
+    printf(",\n  \"%s\": {", name);
+    field_sep = "";
+}
+
+/* Ends entries and objects */
+static void report_end()
+{
+    printf(" }");
+    fflush(stdout);
+}
+
+static void report_string(const char *key, const char *value)
+{
+    printf("%s \"%s\": \"%s\"", field_sep, key, value);
+    field_sep = ",";
+}
+
+static void report_uint(const char *key, uint value)
+{
+    printf("%s \"%s\": %u", field_sep, key, value);
+    field_sep = ",";
+}
+
+static void report_number(const char *key, double value, int decimals)
+{
+    printf("%s \"%s\": %.*f", field_sep, key, decimals, value);
+    field_sep = ",";
+}
+
+static void report_bool(const char *key, bool value)
+{
+    printf("%s \"%s\": %s", field_sep, key, value ? "true" : "false");
+    field_sep = ",";
+}
+
+static bool create_offscreen_context(int w, int h)
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                       EGL_DEFAULT_DISPLAY, NULL);
+#endif
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        std::cerr << "EGL could not start, error: " << eglGetError() << "\n";
+        return false;
+    }
+
+    /* Desktop GL runs the ES 3.0 shaders through ARB_ES3_compatibility, ES
+     * is the fallback */
+    const EGLint gl_attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 4,
+                                  EGL_CONTEXT_MINOR_VERSION, 5,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                  EGL_NONE };
+    const EGLint es_attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE };
+    const struct {
+        EGLenum api;
+        EGLint renderable;
+        const EGLint *attribs;
+    } apis[] = { { EGL_OPENGL_API, EGL_OPENGL_BIT, gl_attribs },
+                 { EGL_OPENGL_ES_API, EGL_OPENGL_ES3_BIT, es_attribs } };
+
+    EGLContext context = EGL_NO_CONTEXT;
+    for (uint i = 0; i < ARRAY_SIZE(apis) && context == EGL_NO_CONTEXT; i++) {
+        /* The default surface type is window, which surfaceless lacks */
+        const EGLint config_attribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                          EGL_RENDERABLE_TYPE,
+                                          apis[i].renderable, EGL_NONE };
+        EGLConfig config;
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1,
+                             &num_configs) || !num_configs)
+            continue;
+        if (!eglBindAPI(apis[i].api))
+            continue;
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                   apis[i].attribs);
+    }
+
+    /* Everything draws into a framebuffer object, no surface needed */
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cerr << "EGL could not create a context, error: "
+                  << eglGetError() << "\n";
+        return false;
+    }
+
+    glewExperimental = GL_TRUE;
+    GLenum glew_ret = glewInit();
+    /* Without an X display GLEW fails on GLX after loading the core entry
+     * points, which is all this needs */
+    if (glew_ret != GLEW_OK && glew_ret != GLEW_ERROR_NO_GLX_DISPLAY) {
+        std::cerr << "glew could not start, error: " << (unsigned long) glew_ret << "\n";
+        return false;
+    }
+
+    GLuint fbo, color_rb;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, color_rb);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Offscreen framebuffer is incomplete\n";
+        return false;
+    }
+
+    /* Desktop core profiles draw nothing without a bound VAO */
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    gl_state_bind_vertex_array(vao);
+    gl_state_viewport(0, 0, w, h);
+    return true;
+}
+
+static bool scene_uses_shapes(scene_kind scene)
+{
+    return scene != SCENE_LINES && scene != SCENE_THICK_LINES;
+}
+
+/* Five pointed star, eight triangles in five convex pieces */
+static shape *make_star(point center, float size)
+{
+    point points[10];
+    for (uint i = 0; i < ARRAY_SIZE(points); i++) {
+        float angle = 0.6283185f * i;
+        float r = i % 2 ? 0.4f * size : size;
+        points[i] = { center.x + r * cosf(angle), center.y + r * sinf(angle) };
+    }
+
+    return new shape_polygon(points, ARRAY_SIZE(points));
+}
+
+/* The drawing space is 100 units wide, shapes stay within it */
+static shape *make_shape(scene_kind scene)
+{
+    float height = 100.0f * get_h_to_w_aspect();
+    point p = { rand_float(5.0f, 95.0f), rand_float(5.0f, height - 5.0f) };
+    float size = rand_float(0.5f, 3.0f);
+
+    shape *shape;
+    switch (scene) {
+    case SCENE_RECTS:
+        shape = new shape_rect(p, size, size * rand_float(0.5f, 2.0f));
+        break;
+    case SCENE_TRIS:
+        shape = new shape_tri(p, { p.x + size, p.y },
+                              { p.x + rand_float(0.0f, size), p.y + size });
+        break;
+    case SCENE_POLYGONS:
+        shape = make_star(p, size);
+        break;
+    default:
+        shape = new shape_circle(p, size);
+        break;
+    }
+
+    shape->set_color(colors[rng_state % num_colors]);
+    shape->set_draw_border(rng_state % 4 == 0);
+    return shape;
+}
+
+static void animate_shapes(shape_list &shapes, uint frame)
+{
+    float step = (frame & 1) ? 0.1f : -0.1f;
+    for (uint i = frame % MOVING_STRIDE; i < shapes.size(); i += MOVING_STRIDE)
+        shapes[i]->move({ step, step });
+}
+
+static void draw_lines(const std::vector<line> &lines, draw_mode mode)
+{
+    if (mode == MODE_BATCH)
+        begin_batch_2d();
+    for (auto l : lines)
+        draw_line(&l);
+    if (mode == MODE_BATCH)
+        flush_batch_2d();
+}
+
+static void draw_shapes(shape_manager_state<std::unique_ptr<shape>> *state,
+                        draw_mode mode)
+{
+    switch (mode) {
+    case MODE_IMMEDIATE:
+        for (uint i = 0; i < state->num_shapes; i++)
+            state->shapes[i]->draw();
+        break;
+    case MODE_BATCH:
+        draw_all_shapes(state);
+        break;
+    case MODE_INSTANCED:
+        draw_all_shapes_instanced(state);
+        break;
+    case MODE_RETAINED:
+        draw_all_shapes_retained(state);
+        break;
+    default:
+        break;
+    }
+}
+
+static bench_result run_scene(scene_kind scene, draw_mode mode,
+                              const bench_options *options)
+{
+    rng_state = 1;
+    shape_list shapes;
+    std::vector<line> lines;
+    if (scene_uses_shapes(scene)) {
+        for (uint i = 0; i < options->num_shapes; i++)
+            shapes.emplace_back(make_shape(scene));
+    } else {
+        float height = 100.0f * get_h_to_w_aspect();
+        for (uint i = 0; i < options->num_shapes; i++) {
+            point start = { rand_float(0.0f, 100.0f), rand_float(0.0f, height) };
+            lines.push_back({ start, { start.x + rand_float(-5.0f, 5.0f),
+                                       start.y + rand_float(-5.0f, 5.0f) } });
+        }
+    }
+
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+
+    if (scene == SCENE_CIRCLES_FIXED)
+        set_circle_mode(CIRCLE_FIXED);
+    else if (scene == SCENE_CIRCLES_SDF)
+        set_circle_mode(CIRCLE_SDF);
+    else
+        set_circle_mode(CIRCLE_ADAPTIVE);
+    set_line_width(scene == SCENE_THICK_LINES ? 3.0f : 1.0f);
+
+    bench_timer cpu_time, frame_time;
+    stats_2d totals = {};
+
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        reset_stats_2d();
+        timer_start(&cpu_time);
+        timer_start(&frame_time);
+
+        animate_shapes(shapes, frame);
+        glClear(GL_COLOR_BUFFER_BIT);
+        start_2d(&space);
+        if (scene_uses_shapes(scene))
+            draw_shapes(&state, mode);
+        else
+            draw_lines(lines, mode);
+
+        timer_stop(&cpu_time, frame);
+        glFinish();
+        timer_stop(&frame_time, frame);
+
+        if (frame < WARMUP_FRAMES)
+            continue;
+
+        stats_2d stats = get_stats_2d();
+        totals.draw_calls += stats.draw_calls;
+        totals.bytes_uploaded += stats.bytes_uploaded;
+    }
+
+    reset_retained_shapes(&state.retained);
+
+    double frames = options->num_frames;
+    bench_result result;
+    result.cpu_ms = timer_ms(&cpu_time, frames);
+    result.frame_ms = timer_ms(&frame_time, frames);
+    result.fps = result.frame_ms > 0.0 ? 1000.0 / result.frame_ms : 0.0;
+    result.draw_calls = totals.draw_calls / frames;
+    result.bytes_uploaded = totals.bytes_uploaded / frames;
+    return result;
+}
+
+/* Containment tests don't touch GL, they compare the batch kernels with a
+ * loop over the scalar functions */
+#define GEOMETRY_SCENE "geometry"
+/* Elements per test, per shape of the -n option */
+#define GEOMETRY_SCALE 32
+
+enum geometry_test {
+    TEST_POINTS_IN_CIRCLE,
+    TEST_POINTS_IN_RECT,
+    TEST_POINTS_IN_TRI,
+    TEST_POINT_IN_CIRCLES,
+    TEST_POINT_IN_RECTS,
+    TEST_POINT_IN_TRIS,
+    NUM_GEOMETRY_TESTS
+};
+
+static const char *geometry_test_names[NUM_GEOMETRY_TESTS] = {
+    "points_in_circle", "points_in_rect", "points_in_tri",
+    "point_in_circles", "point_in_rects", "point_in_tris"
+};
+
+/* Points use the first two columns, shapes as many as they need: x, y, r
+ * for circles, x, y, w, h for rects and the corners for triangles */
+struct geometry_scene {
+    std::vector<float> columns[6];
+    unsigned int count;
+    ::circle circle;
+    ::rect rect;
+    ::tri tri;
+    ::point point;
+};
+
+struct scalar_points_in_circle {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        return point_in_circle({ g->columns[0][i], g->columns[1][i] }, &g->circle);
+    }
+};
+
+struct scalar_points_in_rect {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        return point_in_rect({ g->columns[0][i], g->columns[1][i] }, &g->rect);
+    }
+};
+
+struct scalar_points_in_tri {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        return point_in_tri({ g->columns[0][i], g->columns[1][i] }, &g->tri);
+    }
+};
+
+struct scalar_point_in_circles {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        circle c = { { g->columns[0][i], g->columns[1][i] }, g->columns[2][i] };
+        return point_in_circle(g->point, &c);
+    }
+};
+
+struct scalar_point_in_rects {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        rect r = { g->columns[0][i], g->columns[1][i],
+                   g->columns[2][i], g->columns[3][i] };
+        return point_in_rect(g->point, &r);
+    }
+};
+
+struct scalar_point_in_tris {
+    static bool hit(geometry_scene *g, unsigned int i) {
+        tri t = { { { g->columns[0][i], g->columns[1][i] },
+                    { g->columns[2][i], g->columns[3][i] },
+                    { g->columns[4][i], g->columns[5][i] } } };
+        return point_in_tri(g->point, &t);
+    }
+};
+
+template<typename T>
+static unsigned int run_scalar(geometry_scene *g, uint64_t *mask)
+{
+    memset(mask, 0, BATCH_MASK_WORDS(g->count) * sizeof(*mask));
+
+    unsigned int hits = 0;
+    for (unsigned int i = 0; i < g->count; i++) {
+        if (T::hit(g, i)) {
+            mask[i / 64] |= (uint64_t)1 << (i % 64);
+            hits++;
+        }
+    }
+
+    return hits;
+}
+
+static unsigned int run_geometry_test(geometry_test test, geometry_scene *g,
+                                      bool batch, uint64_t *mask)
+{
+    const float *c[6];
+    for (uint i = 0; i < ARRAY_SIZE(c); i++)
+        c[i] = g->columns[i].data();
+
+    points_soa points = { c[0], c[1], g->count };
+    circles_soa circles = { c[0], c[1], c[2], g->count };
+    rects_soa rects = { c[0], c[1], c[2], c[3], g->count };
+    tris_soa tris = { { c[0], c[2], c[4] }, { c[1], c[3], c[5] }, g->count };
+
+    switch (test) {
+    case TEST_POINTS_IN_CIRCLE:
+        return batch ? points_in_circle(&points, &g->circle, mask)
+                     : run_scalar<scalar_points_in_circle>(g, mask);
+    case TEST_POINTS_IN_RECT:
+        return batch ? points_in_rect(&points, &g->rect, mask)
+                     : run_scalar<scalar_points_in_rect>(g, mask);
+    case TEST_POINTS_IN_TRI:
+        return batch ? points_in_tri(&points, &g->tri, mask)
+                     : run_scalar<scalar_points_in_tri>(g, mask);
+    case TEST_POINT_IN_CIRCLES:
+        return batch ? point_in_circles(g->point, &circles, mask)
+                     : run_scalar<scalar_point_in_circles>(g, mask);
+    case TEST_POINT_IN_RECTS:
+        return batch ? point_in_rects(g->point, &rects, mask)
+                     : run_scalar<scalar_point_in_rects>(g, mask);
+    case TEST_POINT_IN_TRIS:
+        return batch ? point_in_tris(g->point, &tris, mask)
+                     : run_scalar<scalar_point_in_tris>(g, mask);
+    default:
+        return 0;
+    }
+}
+
+static float signed_area(const point *points, const uint32_t *indices,
+                         uint num)
+{
+    float area = 0.0f;
+    for (uint i = 0; i < num; i++) {
+        point a = points[indices[i]];
+        point b = points[indices[(i + 1) % num]];
+        area += a.x * b.y - b.x * a.y;
+    }
+    return 0.5f * area;
+}
+
+static bool is_convex(const point *points, const uint32_t *indices, uint num)
+{
+    for (uint i = 0; i < num; i++) {
+        point a = points[indices[i]];
+        point b = points[indices[(i + 1) % num]];
+        point c = points[indices[(i + 2) % num]];
+        if ((b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x) < -1e-4f)
+            return false;
+    }
+    return true;
+}
+
+/* Random stars around a square hole: triangles and convex pieces have to
+ * be counterclockwise and cover the area of the outline less the hole */
+static void check_polygons(const bench_options *options)
+{
+    rng_state = 1;
+    uint bad_area = 0, bad_pieces = 0, failed = 0;
+    std::vector<point> points;
+    std::vector<uint32_t> indices;
+    polygon_mesh mesh;
+    for (uint n = 0; n < options->num_shapes; n++) {
+        uint num_outline = 5 + rng_state % 40;
+        float size = rand_float(1.0f, 50.0f);
+        points.clear();
+        for (uint i = 0; i < num_outline; i++) {
+            float angle = 6.2831853f * (i + rand_float(0.0f, 0.5f)) /
+                          num_outline;
+            float r = size * rand_float(0.4f, 1.0f);
+            points.push_back({ r * cosf(angle), r * sinf(angle) });
+        }
+        /* Clockwise, the other way round works as well */
+        float h = 0.1f * size;
+        points.push_back({ -h, -h });
+        points.push_back({ -h, h });
+        points.push_back({ h, h });
+        points.push_back({ h, -h });
+        uint32_t ring_ends[] = { num_outline, num_outline + 4 };
+
+        indices.resize(num_outline);
+        for (uint i = 0; i < num_outline; i++)
+            indices[i] = i;
+        float expected = signed_area(points.data(), indices.data(),
+                                     num_outline) - 4.0f * h * h;
+
+        if (build_polygon_mesh(points.data(), ring_ends, 2, &mesh)) {
+            failed++;
+            continue;
+        }
+        float area = 0.0f;
+        for (uint i = 0; i < mesh.triangles.size(); i += 3) {
+            float a = signed_area(points.data(), &mesh.triangles[i], 3);
+            bad_area += a < 0.0f;
+            area += a;
+        }
+        bad_area += fabsf(area - expected) > 1e-4f * expected;
+
+        area = 0.0f;
+        for (uint i = 0, begin = 0; i < mesh.piece_ends.size(); i++) {
+            uint num = mesh.piece_ends[i] - begin;
+            bad_pieces += !is_convex(points.data(), &mesh.pieces[begin], num);
+            area += signed_area(points.data(), &mesh.pieces[begin], num);
+            begin = mesh.piece_ends[i];
+        }
+        bad_pieces += fabsf(area - expected) > 1e-4f * expected;
+    }
+
+    /* No area, no triangles */
+    point line[] = { { 0.0f, 0.0f }, { 1.0f, 1.0f }, { 2.0f, 2.0f } };
+    uint32_t line_end = ARRAY_SIZE(line);
+    std::vector<uint32_t> triangles;
+    check(triangulate_polygon(line, &line_end, 1, &triangles) == -1,
+          GEOMETRY_SCENE, "collinear outline triangulated");
+
+    check(!failed, GEOMETRY_SCENE, "polygon not triangulated");
+    check(!bad_area, GEOMETRY_SCENE, "triangle areas");
+    check(!bad_pieces, GEOMETRY_SCENE, "convex pieces");
+}
+
+static void run_geometry(const bench_options *options)
+{
+    rng_state = 1;
+    geometry_scene g;
+    g.count = options->num_shapes * GEOMETRY_SCALE;
+    for (auto &column : g.columns) {
+        column.resize(g.count);
+        for (auto &value : column)
+            value = rand_float(0.0f, 100.0f);
+    }
+    /* Keep circles and rects from covering everything */
+    for (uint i = 0; i < g.count; i++) {
+        g.columns[2][i] = g.columns[2][i] * 0.1f - 5.0f;
+        g.columns[3][i] = g.columns[3][i] * 0.1f - 5.0f;
+    }
+    g.circle = { { 50.0f, 50.0f }, 20.0f };
+    g.rect = { 70.0f, 20.0f, -40.0f, 50.0f };
+    g.tri = { { { 10.0f, 10.0f }, { 90.0f, 30.0f }, { 40.0f, 95.0f } } };
+    g.point = { 50.0f, 50.0f };
+
+    std::vector<uint64_t> scalar_mask(BATCH_MASK_WORDS(g.count));
+    std::vector<uint64_t> batch_mask(BATCH_MASK_WORDS(g.count));
+
+    report_section_string("geometry_isa", geometry_batch_isa());
+    report_list("geometry");
+    for (uint test = 0; test < NUM_GEOMETRY_TESTS; test++) {
+        double ns[2];
+        unsigned int hits[2];
+        for (int batch = 0; batch < 2; batch++) {
+            uint64_t *mask = batch ? batch_mask.data() : scalar_mask.data();
+            bench_timer time;
+            timer_start(&time);
+            for (uint rep = 0; rep < options->num_frames; rep++)
+                hits[batch] = run_geometry_test((geometry_test)test, &g,
+                                                batch, mask);
+            timer_stop(&time);
+            ns[batch] = 1e6 * timer_ms(&time, (double)options->num_frames *
+                                              g.count);
+        }
+
+        bool identical = hits[0] == hits[1] && scalar_mask == batch_mask;
+        check(identical, GEOMETRY_SCENE, geometry_test_names[test]);
+        report_entry();
+        report_string("test", geometry_test_names[test]);
+        report_uint("count", g.count);
+        report_uint("hits", hits[1]);
+        report_number("scalar_ns", ns[0], 3);
+        report_number("batch_ns", ns[1], 3);
+        report_number("speedup", ns[1] > 0.0 ? ns[0] / ns[1] : 0.0, 2);
+        report_bool("identical", identical);
+        report_end();
+    }
+    report_end_list();
+
+    if (options->check)
+        check_polygons(options);
+}
+
+/* Intersecting pairs the plain way, boxes sorted on x and scanned, to check
+ * the grid and sweep and prune against */
+static void reference_pairs(shape_list &shapes,
+                            std::vector<broadphase_pair> *pairs)
+{
+    std::vector<aabb> boxes;
+    std::vector<uint32_t> order;
+    for (uint i = 0; i < shapes.size(); i++) {
+        boxes.push_back(shapes[i]->get_aabb());
+        if (shapes[i]->is_enabled())
+            order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return boxes[a].min.x < boxes[b].min.x;
+    });
+
+    pairs->clear();
+    for (uint i = 0; i < order.size(); i++) {
+        uint32_t a = order[i];
+        for (uint j = i + 1; j < order.size(); j++) {
+            uint32_t b = order[j];
+            if (boxes[b].min.x > boxes[a].max.x)
+                break;
+            if (intersect(&boxes[a], &boxes[b]) &&
+                shapes_intersect(&*shapes[a], &*shapes[b]))
+                pairs->push_back({ std::min(a, b), std::max(a, b) });
+        }
+    }
+}
+
+/* Equal as sets, whichever way round each pair is */
+static bool same_pairs(std::vector<broadphase_pair> a,
+                       std::vector<broadphase_pair> b)
+{
+    auto sort_pairs = [](std::vector<broadphase_pair> *pairs) {
+        for (auto &pair : *pairs)
+            pair = { std::min(pair.a, pair.b), std::max(pair.a, pair.b) };
+        std::sort(pairs->begin(), pairs->end(),
+                  [](broadphase_pair x, broadphase_pair y) {
+            return x.a < y.a || (x.a == y.a && x.b < y.b);
+        });
+    };
+    sort_pairs(&a);
+    sort_pairs(&b);
+    return a.size() == b.size() &&
+           !memcmp(a.data(), b.data(), a.size() * sizeof(broadphase_pair));
+}
+
+/* World outline of a circle, rect or tri, from the instance it draws with */
+struct plain_shape {
+    bool circle;
+    point center;
+    float radius;
+    point corners[4];
+    uint num_corners;
+};
+
+static plain_shape plain_shape_of(shape *s)
+{
+    shape_instance inst;
+    s->get_instance(&inst);
+    auto place = [&inst](float mx, float my) {
+        float x = inst.pos[0] + mx * inst.axis_x[0] + my * inst.axis_y[0];
+        float y = inst.pos[1] + mx * inst.axis_x[1] + my * inst.axis_y[1];
+        return point { inst.rot[0] * x - inst.rot[1] * y + inst.offset[0],
+                       inst.rot[1] * x + inst.rot[0] * y + inst.offset[1] };
+    };
+
+    plain_shape plain = {};
+    instance_mesh mesh = s->get_instance_mesh();
+    plain.circle = mesh == INSTANCE_CIRCLE;
+    if (plain.circle) {
+        plain.center = { inst.pos[0] + inst.offset[0],
+                         inst.pos[1] + inst.offset[1] };
+        plain.radius = hypotf(inst.axis_x[0], inst.axis_x[1]);
+    } else if (mesh == INSTANCE_RECT) {
+        plain.corners[0] = place(0.0f, 0.0f);
+        plain.corners[1] = place(1.0f, 0.0f);
+        plain.corners[2] = place(1.0f, 1.0f);
+        plain.corners[3] = place(0.0f, 1.0f);
+        plain.num_corners = 4;
+    } else {
+        plain.corners[0] = place(0.0f, 0.0f);
+        plain.corners[1] = place(1.0f, 0.0f);
+        plain.corners[2] = place(0.0f, 1.0f);
+        plain.num_corners = 3;
+    }
+    return plain;
+}
+
+static float cross(point o, point a, point b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static float segment_distance(point p, point a, point b)
+{
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float len_sq = dx * dx + dy * dy;
+    float t = len_sq > 0.0f ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / len_sq
+                            : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return hypotf(p.x - a.x - t * dx, p.y - a.y - t * dy);
+}
+
+static bool inside_corners(point p, const plain_shape *s)
+{
+    bool left = false, right = false;
+    for (uint i = 0; i < s->num_corners; i++) {
+        float c = cross(s->corners[i], s->corners[(i + 1) % s->num_corners], p);
+        left |= c > 0.0f;
+        right |= c < 0.0f;
+    }
+    return !(left && right);
+}
+
+/* Distance between the outlines, 0 when they cross or one holds the other */
+static float outline_distance(const plain_shape *a, const plain_shape *b)
+{
+    float dist = INFINITY;
+    for (int side = 0; side < 2; side++) {
+        const plain_shape *s = side ? b : a, *o = side ? a : b;
+        for (uint i = 0; i < s->num_corners; i++) {
+            point p = s->corners[i];
+            if (inside_corners(p, o))
+                return 0.0f;
+            for (uint j = 0; j < o->num_corners; j++)
+                dist = std::min(dist, segment_distance(p, o->corners[j],
+                                o->corners[(j + 1) % o->num_corners]));
+        }
+    }
+    for (uint i = 0; i < a->num_corners; i++) {
+        point p0 = a->corners[i], p1 = a->corners[(i + 1) % a->num_corners];
+        for (uint j = 0; j < b->num_corners; j++) {
+            point q0 = b->corners[j], q1 = b->corners[(j + 1) % b->num_corners];
+            if (cross(p0, p1, q0) * cross(p0, p1, q1) < 0.0f &&
+                cross(q0, q1, p0) * cross(q0, q1, p1) < 0.0f)
+                return 0.0f;
+        }
+    }
+    return dist;
+}
+
+/* 1 when the shapes intersect, 0 when not, -1 when they are too close to
+ * touching to tell apart from rounding */
+static int plain_intersect(shape *shape_a, shape *shape_b)
+{
+    const float eps = 1e-3f;
+    plain_shape a = plain_shape_of(shape_a), b = plain_shape_of(shape_b);
+    if (a.circle && !b.circle)
+        std::swap(a, b);
+
+    float gap;
+    if (a.circle && b.circle) {
+        gap = hypotf(a.center.x - b.center.x, a.center.y - b.center.y) -
+              a.radius - b.radius;
+    } else if (b.circle) {
+        float dist = INFINITY;
+        for (uint i = 0; i < a.num_corners; i++)
+            dist = std::min(dist, segment_distance(b.center, a.corners[i],
+                            a.corners[(i + 1) % a.num_corners]));
+        gap = inside_corners(b.center, &a) ? -b.radius : dist - b.radius;
+    } else {
+        float dist = outline_distance(&a, &b);
+        gap = dist > 0.0f ? dist : -INFINITY;
+    }
+
+    if (fabsf(gap) < eps)
+        return -1;
+    return gap < 0.0f;
+}
+
+#define COLLISION_SCENE "collision"
+/* Circles per shape of the -n option */
+#define COLLISION_SCALE 25
+
+enum collision_method {
+    COLLISION_GRID,
+    COLLISION_SWEEP_PRUNE,
+    NUM_COLLISION_METHODS
+};
+
+static const char *collision_method_names[NUM_COLLISION_METHODS] = {
+    "grid",
+    "sweep_prune",
+};
+
+/* "random" moves every circle by up to 1 each frame, "coherent" a tenth of
+ * them by up to 0.25, the kind of motion sweep and prune is made for */
+enum collision_motion {
+    MOTION_RANDOM,
+    MOTION_COHERENT,
+    NUM_MOTIONS
+};
+
+static const char *motion_names[NUM_MOTIONS] = {
+    "random",
+    "coherent",
+};
+
+struct collision_result {
+    double frame_ms;    /* Per frame, updating and finding the contacts */
+    double pairs;       /* Per frame, intersecting */
+    double events;      /* Per frame, contacts begun or ended */
+};
+
+/* Random walk of small circles, density stays about constant in n */
+static collision_result run_collision(collision_method method,
+                                      collision_motion motion,
+                                      uint num_circles,
+                                      const bench_options *options)
+{
+    rng_state = 1;
+    float extent = 10.0f * sqrtf((float)num_circles);
+    shape_list shapes;
+    for (uint i = 0; i < num_circles; i++) {
+        shapes.emplace_back(new shape_circle({ rand_float(0.0f, extent),
+                                               rand_float(0.0f, extent) },
+                                             rand_float(1.0f, 4.0f)));
+    }
+
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+    std::vector<broadphase_pair> pairs, expected;
+    std::vector<contact_event> events;
+
+    bench_timer time;
+    size_t total_pairs = 0, total_events = 0, contacts = 0;
+    uint mismatches = 0;
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        uint step = motion == MOTION_RANDOM ? 1 : 10;
+        float dist = motion == MOTION_RANDOM ? 1.0f : 0.25f;
+        for (uint i = frame % step; i < num_circles; i += step)
+            shapes[i]->move({ rand_float(-dist, dist), rand_float(-dist, dist) });
+
+        timer_start(&time);
+        if (method == COLLISION_GRID) {
+            find_colliding_shapes(&state, &pairs);
+        } else {
+            update_contacts(&state, &events);
+        }
+        timer_stop(&time, frame);
+
+        for (auto &event : events)
+            contacts += event.begin ? 1 : -1;
+        if (options->check) {
+            if (method != COLLISION_GRID)
+                sweep_prune_contacts(&state.contacts, &pairs);
+            reference_pairs(shapes, &expected);
+            mismatches += !same_pairs(pairs, expected) ||
+                          (method != COLLISION_GRID &&
+                           contacts != expected.size());
+        }
+        if (frame < WARMUP_FRAMES)
+            continue;
+        total_pairs += method == COLLISION_GRID ? pairs.size() : contacts;
+        total_events += events.size();
+    }
+
+    check(!mismatches, COLLISION_SCENE, collision_method_names[method]);
+    return { timer_ms(&time, options->num_frames),
+             (double)total_pairs / options->num_frames,
+             (double)total_events / options->num_frames };
+}
+
+struct narrowphase_result {
+    double pair_ns;     /* Per candidate pair */
+    uint candidates;
+    uint hits;
+};
+
+/* Equal parts circles, rects and rotated tris, the narrowphase alone over
+ * the candidate pairs of the broadphase */
+static narrowphase_result run_narrowphase(uint num_shapes,
+                                          const bench_options *options)
+{
+    rng_state = 1;
+    float extent = 10.0f * sqrtf((float)num_shapes);
+    shape_list shapes;
+    for (uint i = 0; i < num_shapes; i++) {
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        float size = rand_float(2.0f, 8.0f);
+        if (i % 3 == 0) {
+            shapes.emplace_back(new shape_circle(p, size / 2.0f));
+        } else if (i % 3 == 1) {
+            shapes.emplace_back(new shape_rect(p, size, size));
+        } else {
+            shapes.emplace_back(new shape_tri({ 0.0f, 0.0f }, { size, 0.0f },
+                                              { 0.0f, size }));
+            shapes.back()->rotate(rand_float(0.0f, 6.28f));
+            shapes.back()->move(p);
+        }
+    }
+
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+    std::vector<broadphase_pair> candidates, pairs;
+    update_broadphase(&state);
+    spatial_hash_find_pairs(&state.collisions, &candidates);
+
+    bench_timer time;
+    uint hits = 0;
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        pairs = candidates;
+        timer_start(&time);
+        hits = filter_intersecting_pairs(shapes.data(), pairs.data(),
+                                         pairs.size());
+        timer_stop(&time, frame);
+    }
+
+    /* Separating axes against edges crossing and corners inside */
+    if (options->check) {
+        uint mismatches = 0;
+        for (auto &pair : candidates) {
+            int plain = plain_intersect(&*shapes[pair.a], &*shapes[pair.b]);
+            mismatches += plain >= 0 &&
+                          plain != shapes_intersect(&*shapes[pair.a],
+                                                    &*shapes[pair.b]);
+        }
+        check(!mismatches, COLLISION_SCENE, "narrowphase");
+    }
+
+    uint num_candidates = candidates.size();
+    return { 1e6 * timer_ms(&time, options->num_frames) /
+             std::max(num_candidates, 1u), num_candidates, hits };
+}
+
+static void run_collisions(const bench_options *options)
+{
+    uint num_circles = options->num_shapes * COLLISION_SCALE;
+    report_list("collision");
+    for (int motion = 0; motion < NUM_MOTIONS; motion++) {
+        for (int method = 0; method < NUM_COLLISION_METHODS; method++) {
+            collision_result result =
+                run_collision((collision_method)method,
+                              (collision_motion)motion, num_circles, options);
+            report_entry();
+            report_string("method", collision_method_names[method]);
+            report_string("motion", motion_names[motion]);
+            report_uint("count", num_circles);
+            report_number("frame_ms", result.frame_ms, 3);
+            report_number("pairs", result.pairs, 1);
+            report_number("events", result.events, 1);
+            report_end();
+        }
+    }
+    report_end_list();
+
+    narrowphase_result narrow = run_narrowphase(num_circles, options);
+    report_object("narrowphase");
+    report_uint("count", num_circles);
+    report_uint("candidates", narrow.candidates);
+    report_uint("hits", narrow.hits);
+    report_number("pair_ns", narrow.pair_ns, 1);
+    report_end();
+}
+
+#define PICKING_SCENE "picking"
+/* Shapes per shape of the -n option */
+#define PICKING_SCALE 50
+#define PICKS_PER_FRAME 100
+
+/* Points picked against the draw order, the selection against every box */
+static bool check_picking(shape_manager_state<std::unique_ptr<shape>> *state,
+                          const std::vector<uint> &order, float extent,
+                          rect *area, const std::vector<uint> &selected)
+{
+    bool ok = true;
+    for (uint i = 0; i < PICKS_PER_FRAME; i++) {
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        uint picked, expected = SHAPE_CAST_MISS;
+        for (uint idx : order) {
+            if (state->shapes[idx]->contains_point(p)) {
+                expected = idx;
+                break;
+            }
+        }
+        if (!pick_shape(state, p, &picked))
+            picked = SHAPE_CAST_MISS;
+        ok &= picked == expected;
+    }
+
+    aabb box = bounding_box(area);
+    std::vector<uint> expected, sorted = selected;
+    for (uint i = 0; i < state->num_shapes; i++) {
+        aabb shape_box = state->shapes[i]->get_aabb();
+        if (intersect(&shape_box, &box))
+            expected.push_back(i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    return ok && sorted == expected;
+}
+
+/* build_ms is the first update_pick_tree, update_ms per frame after moving
+ * some shapes, pick_us per pick_shape, linear_pick_us per pick testing the
+ * shapes top down, select_ms and selected per select_shapes_in_rect */
+static void run_pickings(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * PICKING_SCALE;
+    rng_state = 1;
+    float extent = 10.0f * sqrtf((float)num_shapes);
+    shape_list shapes;
+    for (uint i = 0; i < num_shapes; i++) {
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        float size = rand_float(2.0f, 8.0f);
+        if (i % 2)
+            shapes.emplace_back(new shape_rect(p, size, size));
+        else
+            shapes.emplace_back(new shape_circle(p, size / 2.0f));
+        shapes.back()->set_color(colors[i % num_colors]);
+        shapes.back()->set_layer(i % 4);
+    }
+
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+    state.top_layer = 3;
+
+    bench_timer build_time;
+    timer_start(&build_time);
+    update_pick_tree(&state);
+    timer_stop(&build_time);
+
+    std::vector<uint> order, selected;
+    bench_timer update_time, pick_time, linear_time, select_time;
+    size_t total_selected = 0;
+    uint mismatches = 0;
+    for (uint frame = 0; frame < options->num_frames; frame++) {
+        animate_shapes(shapes, frame);
+        timer_start(&update_time);
+        update_pick_tree(&state);
+        timer_stop(&update_time);
+
+        uint picked;
+        for (uint i = 0; i < PICKS_PER_FRAME; i++) {
+            point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+            timer_start(&pick_time);
+            pick_shape(&state, p, &picked);
+            timer_stop(&pick_time);
+        }
+
+        /* What try_drag_all_shapes did before, order from the last draw */
+        draw_all_shapes(&state);
+        get_pick_order(&state, &order);
+        timer_start(&linear_time);
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        for (uint idx : order) {
+            if (state.shapes[idx]->contains_point(p))
+                break;
+        }
+        timer_stop(&linear_time);
+
+        float w = rand_float(0.0f, extent / 4.0f);
+        rect area = { rand_float(0.0f, extent - w), rand_float(0.0f, extent - w),
+                      w, w };
+        timer_start(&select_time);
+        select_shapes_in_rect(&state, &area, &selected);
+        timer_stop(&select_time);
+        total_selected += selected.size();
+
+        if (options->check)
+            mismatches += !check_picking(&state, order, extent, &area,
+                                         selected);
+    }
+
+    check(!mismatches, PICKING_SCENE, "picks or selection");
+    double frames = options->num_frames;
+    report_list("picking");
+    report_entry();
+    report_string("method", "aabb_tree");
+    report_uint("count", num_shapes);
+    report_number("build_ms", timer_ms(&build_time), 3);
+    report_number("update_ms", timer_ms(&update_time, frames), 3);
+    report_number("pick_us", 1000.0 * timer_ms(&pick_time,
+                                               frames * PICKS_PER_FRAME), 2);
+    report_number("linear_pick_us", 1000.0 * timer_ms(&linear_time, frames),
+                  2);
+    report_number("select_ms", timer_ms(&select_time, frames), 3);
+    report_number("selected", total_selected / frames, 1);
+    report_end();
+    report_end_list();
+}
+
+#define RAYCAST_SCENE "raycast"
+#define RAYS_PER_FRAME 2000
+/* Rays per frame for the loop over all shapes, it is that slow */
+#define LINEAR_RAYS_PER_FRAME 20
+
+/* Per ray ray_us for the nearest hit, all_ray_us for all hits and
+ * linear_ray_us casting against every shape. hit_rate is of rays hitting
+ * something. */
+static void run_raycasts(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * PICKING_SCALE;
+    rng_state = 1;
+    float extent = 10.0f * sqrtf((float)num_shapes);
+    shape_list shapes;
+    for (uint i = 0; i < num_shapes; i++) {
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        float size = rand_float(2.0f, 8.0f);
+        if (i % 3 == 0) {
+            shapes.emplace_back(new shape_circle(p, size / 2.0f));
+        } else if (i % 3 == 1) {
+            shapes.emplace_back(new shape_rect(p, size, size));
+        } else {
+            shapes.emplace_back(new shape_tri(p, { p.x + size, p.y },
+                                              { p.x, p.y + size }));
+        }
+        shapes.back()->rotate(rand_float(0.0f, 0.1f));
+    }
+
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+    update_pick_tree(&state);
+
+    /* Lasers about 50 shapes long */
+    std::vector<line> rays(RAYS_PER_FRAME);
+    std::vector<shape_cast_hit> hits(RAYS_PER_FRAME), all;
+    std::vector<uint> first;
+
+    bench_timer ray_time, all_time, linear_time;
+    size_t total_hit = 0;
+    uint mismatches = 0;
+    std::vector<uint> along, expected;
+    for (uint frame = 0; frame < options->num_frames; frame++) {
+        for (auto &ray : rays) {
+            point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+            vect dir = { rand_float(-1.0f, 1.0f), rand_float(-1.0f, 1.0f) };
+            ray = ray_segment(p, dir, 500.0f);
+        }
+
+        timer_start(&ray_time);
+        cast_segments(&state, rays.data(), rays.size(), hits.data());
+        timer_stop(&ray_time);
+        for (auto &hit : hits)
+            total_hit += hit.idx != SHAPE_CAST_MISS;
+
+        timer_start(&all_time);
+        cast_segments_all(&state, rays.data(), rays.size(), &all, &first);
+        timer_stop(&all_time);
+
+        timer_start(&linear_time);
+        for (uint i = 0; i < LINEAR_RAYS_PER_FRAME; i++) {
+            uint nearest = SHAPE_CAST_MISS;
+            float nearest_t = 2.0f;
+            for (uint j = 0; j < num_shapes; j++) {
+                segment_hit hit;
+                if (cast_segment(&rays[i], &*shapes[j], &hit) &&
+                    hit.t < nearest_t) {
+                    nearest = j;
+                    nearest_t = hit.t;
+                }
+            }
+            mismatches += nearest != hits[i].idx;
+        }
+        timer_stop(&linear_time);
+
+        /* Every shape along the ray, not just the nearest */
+        for (uint i = 0; options->check && i < LINEAR_RAYS_PER_FRAME; i++) {
+            along.clear();
+            expected.clear();
+            for (uint j = first[i]; j < first[i + 1]; j++)
+                along.push_back(all[j].idx);
+            for (uint j = 0; j < num_shapes; j++) {
+                segment_hit hit;
+                if (cast_segment(&rays[i], &*shapes[j], &hit))
+                    expected.push_back(j);
+            }
+            std::sort(along.begin(), along.end());
+            mismatches += along != expected;
+        }
+    }
+
+    check(!mismatches, RAYCAST_SCENE, "hits");
+    double num_rays = options->num_frames * RAYS_PER_FRAME;
+    report_list("raycast");
+    report_entry();
+    report_string("method", "aabb_tree");
+    report_uint("count", num_shapes);
+    report_uint("rays", RAYS_PER_FRAME);
+    report_number("ray_us", 1000.0 * timer_ms(&ray_time, num_rays), 2);
+    report_number("all_ray_us", 1000.0 * timer_ms(&all_time, num_rays), 2);
+    report_number("linear_ray_us", 1000.0 * timer_ms(&linear_time,
+                  options->num_frames * LINEAR_RAYS_PER_FRAME), 2);
+    report_number("hit_rate", total_hit / num_rays, 3);
+    report_number("hits_per_ray", (double)all.size() / RAYS_PER_FRAME, 1);
+    report_end();
+    report_end_list();
+}
+
+#define PARALLEL_SCENE "parallel"
+/* Shapes per shape of the -n option */
+#define PARALLEL_SCALE 100
+/* Largest pool tried, pools double from 1 up to the core count */
+#define MAX_PARALLEL_THREADS 16
+
+struct parallel_result {
+    double frame_ms;    /* Per frame, world update, broadphase, narrowphase */
+    double pairs;       /* Per frame, intersecting */
+    bool same;          /* Pairs equal to find_colliding_shapes every frame */
+};
+
+static void make_mixed_shapes(uint num_shapes, shape_list *shapes)
+{
+    rng_state = 1;
+    float extent = 10.0f * sqrtf((float)num_shapes);
+    for (uint i = 0; i < num_shapes; i++) {
+        point p = { rand_float(0.0f, extent), rand_float(0.0f, extent) };
+        float size = rand_float(2.0f, 8.0f);
+        if (i % 3 == 0) {
+            shapes->emplace_back(new shape_circle(p, size / 2.0f));
+        } else if (i % 3 == 1) {
+            shapes->emplace_back(new shape_rect(p, size, size));
+        } else {
+            shapes->emplace_back(new shape_tri(p, { p.x + size, p.y },
+                                               { p.x, p.y + size }));
+        }
+    }
+}
+
+/* Every shape moves every frame. num_threads 0 runs the serial pipeline. */
+static parallel_result run_parallel(uint num_threads, uint num_shapes,
+                                    const bench_options *options)
+{
+    shape_list shapes;
+    make_mixed_shapes(num_shapes, &shapes);
+
+    shape_manager_state<std::unique_ptr<shape>> state, reference;
+    state.shapes = reference.shapes = shapes.data();
+    state.num_shapes = reference.num_shapes = shapes.size();
+    std::vector<broadphase_pair> pairs, expected;
+    thread_pool pool;
+    if (num_threads)
+        thread_pool_init(&pool, num_threads);
+
+    bench_timer time;
+    size_t total_pairs = 0;
+    bool same = true;
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        for (auto &s : shapes) {
+            s->move({ rand_float(-1.0f, 1.0f), rand_float(-1.0f, 1.0f) });
+            s->rotate(rand_float(-0.05f, 0.05f));
+        }
+
+        timer_start(&time);
+        if (num_threads)
+            find_colliding_shapes_parallel(&state, &pool, &pairs);
+        else
+            find_colliding_shapes(&state, &pairs);
+        timer_stop(&time, frame);
+
+        if (num_threads) {
+            find_colliding_shapes(&reference, &expected);
+            same &= pairs.size() == expected.size() &&
+                    !memcmp(pairs.data(), expected.data(),
+                            pairs.size() * sizeof(broadphase_pair));
+        }
+        if (frame < WARMUP_FRAMES)
+            continue;
+        total_pairs += pairs.size();
+    }
+
+    if (num_threads)
+        thread_pool_destroy(&pool);
+    check(same, PARALLEL_SCENE, "pairs differ from the serial ones");
+    return { timer_ms(&time, options->num_frames),
+             (double)total_pairs / options->num_frames, same };
+}
+
+static void run_parallels(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * PARALLEL_SCALE;
+    uint cores = std::max(std::thread::hardware_concurrency(), 1u);
+    /* Two threads at least, so the threaded path always gets checked */
+    uint max_threads = std::min(std::max(cores, 2u),
+                                (uint)MAX_PARALLEL_THREADS);
+
+    parallel_result serial = run_parallel(0, num_shapes, options);
+    report_list("parallel");
+    report_entry();
+    report_string("threads", "serial");
+    report_uint("count", num_shapes);
+    report_uint("cores", cores);
+    report_number("frame_ms", serial.frame_ms, 3);
+    report_number("pairs", serial.pairs, 1);
+    report_end();
+    for (uint threads = 1; threads <= max_threads; threads *= 2) {
+        parallel_result result = run_parallel(threads, num_shapes, options);
+        report_entry();
+        report_uint("threads", threads);
+        report_uint("count", num_shapes);
+        report_number("frame_ms", result.frame_ms, 3);
+        report_number("speedup", serial.frame_ms / result.frame_ms, 2);
+        report_number("pairs", result.pairs, 1);
+        report_bool("same", result.same);
+        report_end();
+    }
+    report_end_list();
+}
+
+#define STORE_SCENE "store"
+#define STORE_SCALE 100
+
+struct store_result {
+    double move_ms;     /* Per frame, all shapes moved and turned */
+    double collide_ms;  /* Per frame, world update, broadphase, narrowphase */
+    double draw_ms;     /* Per frame, CPU side of the instanced draws */
+    double pairs;       /* Per frame, intersecting */
+};
+
+/* Objects when store is NULL. Both see the same moves, the pairs only
+ * differ by rounding, the store keeping rotations as cosine and sine. */
+static store_result run_store(shape_store *store, uint num_shapes,
+                              const bench_options *options)
+{
+    shape_list shapes;
+    make_mixed_shapes(num_shapes, &shapes);
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+
+    std::vector<broadphase_pair> pairs;
+    std::vector<shape_handle_pair> handle_pairs;
+    std::vector<shape_handle> handles;
+    if (store) {
+        shape_store_clear(store);
+        for (auto &s : shapes)
+            handles.push_back(shape_store_add_shape(store, &*s));
+    }
+
+    /* Unmoved, store and objects hold the same geometry. Slots are the
+     * object indices in a fresh store. */
+    if (store && options->check) {
+        std::vector<broadphase_pair> expected;
+        shape_store_find_pairs(store, &handle_pairs);
+        for (auto &pair : handle_pairs)
+            pairs.push_back({ pair.a.slot, pair.b.slot });
+        reference_pairs(shapes, &expected);
+        check(same_pairs(pairs, expected), STORE_SCENE, "pairs");
+    }
+
+    std::vector<vect> moves(num_shapes);
+    std::vector<float> turns(num_shapes);
+    bench_timer move_time, collide_time, draw_time;
+    size_t total_pairs = 0;
+    start_2d(&space);
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        for (uint i = 0; i < num_shapes; i++) {
+            moves[i] = { rand_float(-1.0f, 1.0f), rand_float(-1.0f, 1.0f) };
+            turns[i] = rand_float(-0.05f, 0.05f);
+        }
+
+        timer_start(&move_time);
+        for (uint i = 0; i < num_shapes; i++) {
+            if (store) {
+                shape_store_move(store, handles[i], moves[i]);
+                shape_store_rotate(store, handles[i], turns[i]);
+            } else {
+                shapes[i]->move(moves[i]);
+                shapes[i]->rotate(turns[i]);
+            }
+        }
+        timer_stop(&move_time, frame);
+        timer_start(&collide_time);
+        if (store)
+            shape_store_find_pairs(store, &handle_pairs);
+        else
+            find_colliding_shapes(&state, &pairs);
+        timer_stop(&collide_time, frame);
+        glClear(GL_COLOR_BUFFER_BIT);
+        timer_start(&draw_time);
+        if (store)
+            shape_store_draw(store);
+        else
+            draw_all_shapes_instanced(&state);
+        timer_stop(&draw_time, frame);
+        glFinish();
+
+        if (frame < WARMUP_FRAMES)
+            continue;
+        total_pairs += store ? handle_pairs.size() : pairs.size();
+    }
+
+    /* Boxes kept up to date shape by shape against all redone */
+    if (store && options->check) {
+        std::vector<broadphase_pair> updated, expected;
+        for (auto &pair : handle_pairs)
+            updated.push_back({ pair.a.slot, pair.b.slot });
+        shape_store_touch(store);
+        shape_store_find_pairs(store, &handle_pairs);
+        for (auto &pair : handle_pairs)
+            expected.push_back({ pair.a.slot, pair.b.slot });
+        check(same_pairs(updated, expected), STORE_SCENE, "moved pairs");
+    }
+
+    return { timer_ms(&move_time, options->num_frames),
+             timer_ms(&collide_time, options->num_frames),
+             timer_ms(&draw_time, options->num_frames),
+             (double)total_pairs / options->num_frames };
+}
+
+static void run_stores(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * STORE_SCALE;
+    store_result objects = run_store(NULL, num_shapes, options);
+    shape_store store;
+    store_result stored = run_store(&store, num_shapes, options);
+
+    const char *names[] = { "objects", "store" };
+    const store_result *results[] = { &objects, &stored };
+    report_list("store");
+    for (uint i = 0; i < 2; i++) {
+        report_entry();
+        report_string("method", names[i]);
+        report_uint("count", num_shapes);
+        report_number("move_ms", results[i]->move_ms, 3);
+        report_number("collide_ms", results[i]->collide_ms, 3);
+        report_number("draw_ms", results[i]->draw_ms, 3);
+        report_number("pairs", results[i]->pairs, 1);
+        report_end();
+    }
+    report_end_list();
+}
+
+#define COMPACT_SCENE "compact"
+#define COMPACT_SCALE 10
+/* Tiles 1024 units across, steps of 1/16 unit reach 2048 units out of the
+ * tile center */
+#define COMPACT_TILE_SIZE 1024.0f
+#define COMPACT_STEP (1.0f / 16.0f)
+
+struct compact_result {
+    double bytes_per_shape;     /* Instance data kept on the CPU */
+    double first_upload;        /* Bytes, first frame */
+    double upload;              /* Bytes per frame afterwards */
+    double frame_ms;
+    double draw_calls;          /* Per frame */
+};
+
+static compact_result finish_compact(double first_upload, size_t uploaded,
+                                     const bench_timer *time,
+                                     size_t draw_calls,
+                                     const bench_options *options)
+{
+    compact_result result;
+    result.first_upload = first_upload;
+    result.upload = (double)uploaded / options->num_frames;
+    result.frame_ms = timer_ms(time, options->num_frames);
+    result.draw_calls = (double)draw_calls / options->num_frames;
+    return result;
+}
+
+/* Static mixed shapes, turned at random. Retained instance buffers when
+ * compact is false. */
+static compact_result run_compact(bool compact, uint num_shapes,
+                                  const bench_options *options)
+{
+    shape_list shapes;
+    make_mixed_shapes(num_shapes, &shapes);
+    for (auto &s : shapes)
+        s->rotate(rand_float(0.0f, 6.28f));
+
+    instance_buffer buffers[NUM_INSTANCE_MESHES];
+    std::map<std::pair<std::pair<int, int>, uint>, compact_tile> tiles;
+    compact_palette palette;
+    for (uint mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++)
+        init_instance_buffer(&buffers[mesh], (instance_mesh)mesh);
+
+    for (auto &s : shapes) {
+        shape_instance inst;
+        s->get_instance(&inst);
+        instance_mesh mesh = s->get_instance_mesh();
+        if (!compact) {
+            instance_buffer_add(&buffers[mesh], &inst);
+            continue;
+        }
+
+        aabb box = s->get_aabb();
+        int tx = (int)floorf(box.min.x / COMPACT_TILE_SIZE);
+        int ty = (int)floorf(box.min.y / COMPACT_TILE_SIZE);
+        compact_tile *tile = &tiles[{ { tx, ty }, mesh }];
+        if (tile->instances.empty()) {
+            point origin = { (tx + 0.5f) * COMPACT_TILE_SIZE,
+                             (ty + 0.5f) * COMPACT_TILE_SIZE };
+            init_compact_tile(tile, mesh, origin, COMPACT_STEP);
+        }
+
+        compact_instance c;
+        int color = compact_palette_index(&palette, s->get_color());
+        if (color >= 0 && !compact_encode(tile, &inst, color, &c))
+            compact_tile_add(tile, &c);
+    }
+    set_compact_palette(palette.colors.data(), palette.colors.size());
+
+    bench_timer time;
+    double first_upload = 0.0;
+    size_t uploaded = 0, draw_calls = 0;
+    for (uint frame = 0; frame < WARMUP_FRAMES + options->num_frames; frame++) {
+        timer_start(&time);
+        reset_stats_2d();
+        glClear(GL_COLOR_BUFFER_BIT);
+        start_2d(&space);
+        if (compact) {
+            for (auto &tile : tiles)
+                draw_compact_tile(&tile.second);
+        } else {
+            for (instance_buffer &buf : buffers)
+                draw_instance_buffer(&buf);
+        }
+        glFinish();
+        timer_stop(&time, frame);
+
+        stats_2d stats = get_stats_2d();
+        if (frame == 0)
+            first_upload = stats.bytes_uploaded;
+        if (frame < WARMUP_FRAMES)
+            continue;
+        uploaded += stats.bytes_uploaded;
+        draw_calls += stats.draw_calls;
+    }
+
+    compact_result result = finish_compact(first_upload, uploaded, &time,
+                                           draw_calls, options);
+    result.bytes_per_shape = compact ? sizeof(compact_instance)
+                                     : sizeof(shape_instance);
+    for (auto &tile : tiles)
+        destroy_compact_tile(&tile.second);
+    for (instance_buffer &buf : buffers)
+        destroy_instance_buffer(&buf);
+    return result;
+}
+
+static void run_compacts(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * COMPACT_SCALE;
+    report_list("compact");
+    for (uint compact = 0; compact < 2; compact++) {
+        compact_result result = run_compact(compact, num_shapes, options);
+        report_entry();
+        report_string("method", compact ? "compact" : "retained");
+        report_uint("count", num_shapes);
+        report_number("bytes_per_shape", result.bytes_per_shape, 0);
+        report_number("first_upload", result.first_upload, 0);
+        report_number("upload", result.upload, 0);
+        report_number("frame_ms", result.frame_ms, 3);
+        report_number("draw_calls", result.draw_calls, 1);
+        report_end();
+    }
+    report_end_list();
+}
+
+#define FILE_SCENE "file"
+#define FILE_SCALE 500
+#define FILE_PATH "bench_scene.bin"
+
+/* Every column of every mesh as it was saved */
+static bool same_columns(const shape_store *a, const shape_store *b)
+{
+    bool same = true;
+    for (uint mesh = 0; mesh < NUM_INSTANCE_MESHES; mesh++) {
+        const shape_store_columns *x = &a->columns[mesh];
+        const shape_store_columns *y = &b->columns[mesh];
+        uint n = x->slots.size();
+        same &= n == y->slots.size() &&
+                !memcmp(x->offsets.data(), y->offsets.data(),
+                        n * sizeof(point)) &&
+                !memcmp(x->rotations.data(), y->rotations.data(),
+                        n * sizeof(vect)) &&
+                !memcmp(x->anchors.data(), y->anchors.data(),
+                        n * sizeof(point)) &&
+                !memcmp(x->axes_x.data(), y->axes_x.data(),
+                        n * sizeof(vect)) &&
+                !memcmp(x->axes_y.data(), y->axes_y.data(),
+                        n * sizeof(vect)) &&
+                !memcmp(x->colors.data(), y->colors.data(),
+                        n * sizeof(color)) &&
+                x->flags == y->flags && x->layers == y->layers &&
+                x->serials == y->serials;
+    }
+    return same;
+}
+
+static void run_scene_file(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * FILE_SCALE;
+    shape_list shapes;
+    make_mixed_shapes(num_shapes, &shapes);
+    shape_store store;
+    for (uint i = 0; i < num_shapes; i++) {
+        shapes[i]->set_layer(i % 7);
+        shape_store_add_shape(&store, &*shapes[i]);
+    }
+    shapes.clear();
+    /* Gaps, and shapes moved into them, go through the file as well */
+    for (uint i = 0; i < num_shapes; i += 11)
+        shape_store_remove(&store, { i, 1 });
+
+    bench_timer save_time, open_time, verify_time, load_time;
+    timer_start(&save_time);
+    int ret = save_scene_file(FILE_PATH, &store);
+    timer_stop(&save_time);
+
+    scene_file file;
+    timer_start(&open_time);
+    ret |= open_scene_file(&file, FILE_PATH, false);
+    timer_stop(&open_time);
+    close_scene_file(&file);
+
+    timer_start(&verify_time);
+    ret |= open_scene_file(&file, FILE_PATH, true);
+    timer_stop(&verify_time);
+
+    shape_store loaded;
+    timer_start(&load_time);
+    ret |= load_scene_file(&file, &loaded);
+    timer_stop(&load_time);
+    close_scene_file(&file);
+    remove(FILE_PATH);
+
+    bool ok = !ret && shape_store_size(&loaded) == shape_store_size(&store);
+    check(ok, FILE_SCENE, "round trip");
+    if (options->check)
+        check(same_columns(&store, &loaded), FILE_SCENE, "loaded columns");
+
+    report_object("file");
+    report_uint("count", shape_store_size(&store));
+    report_bool("ok", ok);
+    report_number("save_ms", timer_ms(&save_time), 3);
+    report_number("open_ms", timer_ms(&open_time), 3);
+    report_number("verify_ms", timer_ms(&verify_time), 3);
+    report_number("load_ms", timer_ms(&load_time), 3);
+    report_end();
+}
+
+#define GRAPH_SCENE "graph"
+#define GRAPH_SCALE 10
+#define GRAPH_GROUP_SIZE 500
+
+/* Boxes of the shapes through the graph against the boxes of the shapes
+ * themselves, those of the first group moved by the drag */
+static bool check_graph(scene_graph *graph, shape_list &shapes, vect drag)
+{
+    shape_manager_state<std::unique_ptr<shape>> state;
+    state.shapes = shapes.data();
+    state.num_shapes = shapes.size();
+    scene_graph_update(graph);
+
+    uint mismatches = 0;
+    for (uint node = 0; node < scene_graph_size(graph); node++) {
+        uint32_t user = graph->users[node];
+        if (user == SCENE_GRAPH_NULL)
+            continue;
+        aabb box = scene_graph_shape_aabb(graph, &state, node);
+        aabb expected = shapes[user]->get_aabb();
+        if (user < GRAPH_GROUP_SIZE) {
+            expected.min = { expected.min.x + drag.x, expected.min.y + drag.y };
+            expected.max = { expected.max.x + drag.x, expected.max.y + drag.y };
+        }
+        float tolerance = 1e-5f * (fabsf(expected.max.x) +
+                                   fabsf(expected.max.y) + 1.0f);
+        mismatches += fabsf(box.min.x - expected.min.x) > tolerance ||
+                      fabsf(box.min.y - expected.min.y) > tolerance ||
+                      fabsf(box.max.x - expected.max.x) > tolerance ||
+                      fabsf(box.max.y - expected.max.y) > tolerance;
+    }
+    return !mismatches;
+}
+
+/* Shapes in groups of GRAPH_GROUP_SIZE, the first group gets dragged */
+static void run_graph(const bench_options *options)
+{
+    uint num_shapes = options->num_shapes * GRAPH_SCALE;
+    shape_list shapes;
+    make_mixed_shapes(num_shapes, &shapes);
+
+    scene_graph graph;
+    uint32_t group = SCENE_GRAPH_NULL, first_group = SCENE_GRAPH_NULL;
+    for (uint i = 0; i < num_shapes; i++) {
+        if (i % GRAPH_GROUP_SIZE == 0) {
+            group = scene_graph_add(&graph, SCENE_GRAPH_NULL,
+                                    SCENE_GRAPH_NULL,
+                                    &scene_transform_identity);
+            if (!i)
+                first_group = group;
+        }
+        scene_graph_add(&graph, group, i, &scene_transform_identity);
+    }
+    scene_graph_update(&graph);
+
+    bench_timer drag_time, update_time, shapes_time;
+    uint group_size = std::min(num_shapes, (uint)GRAPH_GROUP_SIZE);
+    vect dragged = { 0.0f, 0.0f };
+    for (uint frame = 0; frame < options->num_frames; frame++) {
+        vect v = { rand_float(-1.0f, 1.0f), rand_float(-1.0f, 1.0f) };
+        timer_start(&drag_time);
+        scene_graph_move(&graph, first_group, v);
+        timer_stop(&drag_time);
+        timer_start(&update_time);
+        scene_graph_update(&graph);
+        timer_stop(&update_time);
+        timer_start(&shapes_time);
+        for (uint i = 0; i < group_size; i++)
+            shapes[i]->move(v);
+        timer_stop(&shapes_time);
+        dragged = { dragged.x + v.x, dragged.y + v.y };
+    }
+
+    /* The shapes moved by themselves as well, the graph adds the drag */
+    if (options->check)
+        check(check_graph(&graph, shapes, dragged), GRAPH_SCENE,
+              "world boxes");
+
+    report_object("graph");
+    report_uint("count", num_shapes);
+    report_uint("group", group_size);
+    report_number("drag_us", 1000.0 * timer_ms(&drag_time,
+                                               options->num_frames), 3);
+    report_number("update_ms", timer_ms(&update_time, options->num_frames), 3);
+    report_number("shapes_us", 1000.0 * timer_ms(&shapes_time,
+                                                 options->num_frames), 3);
+    report_end();
+}
+
+static bool parse_options(int argc, char **argv, bench_options *options)
+{
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c")) {
+            options->check = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+
+        const char *value = argv[++i];
+        if (!strcmp(argv[i - 1], "-n"))
+            options->num_shapes = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "-f"))
+            options->num_frames = strtoul(value, NULL, 10);
+        else if (!strcmp(argv[i - 1], "-W"))
+            options->width = atoi(value);
+        else if (!strcmp(argv[i - 1], "-H"))
+            options->height = atoi(value);
+        else if (!strcmp(argv[i - 1], "-s"))
+            options->scene = value;
+        else if (!strcmp(argv[i - 1], "-m"))
+            options->mode = value;
+        else
+            return false;
+    }
+
+    return options->num_frames > 0 && options->width > 0 &&
+           options->height > 0;
+}
+
+int main(int argc, char **argv)
+{
+    /* stdout only carries the JSON, the library reports its errors on
+     * std::cout */
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    bench_options options;
+    if (!parse_options(argc, argv, &options)) {
+        std::cerr << "usage: " << argv[0] << " [-c] [-n shapes] [-f frames] "
+                  << "[-s scene] [-m mode] [-W width] [-H height]\n";
+        return -1;
+    }
+
+    if (!create_offscreen_context(options.width, options.height))
+        return -1;
+
+    rect r {0.f, 0.f, 1.0f, 1.0f};
+    use_rectangle(&space, &r, 100.0f);
+    if (init_2d())
+        return -1;
+    glClearColor(0.4f, 0.0f, 0.4f, 1.0f);
+
+    printf("{\n  \"renderer\": \"%s\",\n  \"version\": \"%s\",\n",
+           glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    printf("  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %u",
+           options.width, options.height, options.num_frames);
+
+    report_list("results");
+    for (uint scene = 0; scene < NUM_SCENES; scene++) {
+        if (options.scene && strcmp(options.scene, scene_names[scene]))
+            continue;
+
+        for (uint mode = 0; mode < NUM_MODES; mode++) {
+            if (options.mode && strcmp(options.mode, mode_names[mode]))
+                continue;
+            /* Lines have no instanced or retained path */
+            if (!scene_uses_shapes((scene_kind)scene) &&
+                mode != MODE_IMMEDIATE && mode != MODE_BATCH)
+                continue;
+
+            bench_result result = run_scene((scene_kind)scene,
+                                            (draw_mode)mode, &options);
+            report_entry();
+            report_string("scene", scene_names[scene]);
+            report_string("mode", mode_names[mode]);
+            report_uint("count", options.num_shapes);
+            report_number("fps", result.fps, 2);
+            report_number("cpu_ms", result.cpu_ms, 3);
+            report_number("frame_ms", result.frame_ms, 3);
+            report_number("draw_calls", result.draw_calls, 1);
+            report_number("bytes_uploaded", result.bytes_uploaded, 0);
+            report_end();
+        }
+    }
+    report_end_list();
+
+    if (!options.scene || !strcmp(options.scene, GEOMETRY_SCENE))
+        run_geometry(&options);
+    if (!options.scene || !strcmp(options.scene, COLLISION_SCENE))
+        run_collisions(&options);
+    if (!options.scene || !strcmp(options.scene, PICKING_SCENE))
+        run_pickings(&options);
+    if (!options.scene || !strcmp(options.scene, RAYCAST_SCENE))
+        run_raycasts(&options);
+    if (!options.scene || !strcmp(options.scene, PARALLEL_SCENE))
+        run_parallels(&options);
+    if (!options.scene || !strcmp(options.scene, STORE_SCENE))
+        run_stores(&options);
+    if (!options.scene || !strcmp(options.scene, COMPACT_SCENE))
+        run_compacts(&options);
+    if (!options.scene || !strcmp(options.scene, FILE_SCENE))
+        run_scene_file(&options);
+    if (!options.scene || !strcmp(options.scene, GRAPH_SCENE))
+        run_graph(&options);
+    printf("\n}\n");
+    checkOpenGLError();
+    destroy_2d();
+    if (num_failures)
+        fprintf(stderr, "%u checks failed\n", num_failures);
+    return num_failures ? 1 : 0;
+}
@@ -1,5 +1,6 @@
 #include "../gl_sdl_utils.hpp"
 #include "../gl_sdl_2d.hpp"
+#include "../gl_sdl_state.hpp"
 #include "../gl_sdl_shape_obj.hpp"
 #include <memory>
 
@@ -16,7 +17,7 @@ static std::unique_ptr<shape> shapes[3] = { std::unique_ptr<shape>(new shape_tri
 shape_manager_state<std::unique_ptr<shape>> manager_state = {
     .shapes = shapes,
     .num_shapes = ARRAY_SIZE(shapes),
-    .first_to_draw = 0
+    .top_layer = 0
 };
 
 space_2d space;
@@ -36,13 +37,28 @@ int res_init()
     EM_JS(int, get_canvas_height, (), { return canvas.height; });
 #endif
 
+/* Kept from the contact events, only shapes touching the circle get
+ * highlighted. Their own color comes back when the contact ends. */
+static bool touching_circle[3];
+static color own_colors[3];
+
 int display()
 {
+    static std::vector<contact_event> contacts;
+
     start_2d(&space);
-    shape_circle *inter_circle = dynamic_cast<shape_circle*>(shapes[2].get());
-    for (uint i = 0; i < 2; i++) {
-        if (shapes[i]->intersects_circle(inter_circle))
-            shapes[i]->set_color(magenta);
+    update_contacts(&manager_state, &contacts);
+    for (auto &contact : contacts) {
+        if (contact.b != 2)
+            continue;
+
+        touching_circle[contact.a] = contact.begin;
+        if (contact.begin) {
+            own_colors[contact.a] = shapes[contact.a]->get_color();
+            shapes[contact.a]->set_color(magenta);
+        } else {
+            shapes[contact.a]->set_color(own_colors[contact.a]);
+        }
     }
 
     draw_all_shapes(&manager_state);
@@ -60,18 +76,27 @@ static void reset_viewport_to_window(SDL_Window *window)
     h = get_canvas_height();
 #endif
     aspect = (float)w / (float)h;
-    glViewport(0, 0, w, h);
+    gl_state_viewport(0, 0, w, h);
+
+    int window_w, window_h;
+    SDL_GetWindowSize(window, &window_w, &window_h);
+    update_space_2d(&space, w, h, window_w, window_h);
 }
 
-static bool handle_mouse(SDL_Event *event)
+/* Once per frame with the mouse events gathered since the last one */
+static bool handle_mouse(input_frame *input)
 {
-    if (event->type != SDL_MOUSEMOTION &&
-        event->type != SDL_MOUSEBUTTONUP &&
-        event->type != SDL_MOUSEBUTTONDOWN)
+    if (!input->num_events)
         return false;
 
     assign_random_colors<std::unique_ptr<shape>>(&manager_state);
-    try_drag_all_shapes<std::unique_ptr<shape>>(event, &manager_state, &space);
+    try_drag_all_shapes<std::unique_ptr<shape>>(input, &manager_state, &space);
+    for (uint i = 0; i < 2; i++) {
+        if (!touching_circle[i])
+            continue;
+        own_colors[i] = shapes[i]->get_color();
+        shapes[i]->set_color(magenta);
+    }
 
     return false;
 }
@@ -145,12 +170,14 @@ int main(int, char**)
     reset_viewport_to_window(window);
 
     bool done = false;
+    input_frame input = {};
     while (!done)
     {
 #ifdef __EMSCRIPTEN__
     emscripten_sleep(0);
 #endif
         SDL_Event event;
+        begin_input_frame(&input);
         while (SDL_PollEvent(&event))
         {
             if (event.type == SDL_QUIT)
@@ -159,10 +186,14 @@ int main(int, char**)
                 event.window.event == SDL_WINDOWEVENT_CLOSE &&
                 event.window.windowID == SDL_GetWindowID(window))
                 done = true;
+            if (event.type == SDL_WINDOWEVENT &&
+                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                reset_viewport_to_window(window);
 
-            handle_mouse(&event);
-            handle_keyboard(&event);
+            if (!input_frame_add(&input, &event))
+                handle_keyboard(&event);
         }
+        handle_mouse(&input);
 
         glClearColor(0.4f, 0.0f, 0.4f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);